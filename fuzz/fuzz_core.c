@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+
+/*
+ *  Fuzz target for run8080(): the input is the memory image, loaded at
+ *  0x0000, with its first two bytes doubling as the IN port latches.
+ *  It runs for a bounded number of cycles or until the core stops on an
+ *  opcode it doesn't implement.
+ *
+ *  One machine is reset in place for every input, as allocating 64KB
+ *  per run would cost more than running it.
+ */
+
+#define FUZZ_CYCLE_BUDGET 100000
+
+static Chip8080 *chip;
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (chip == NULL)
+        chip = make_chip8080();
+    reset_chip_state(chip);
+    memset(chip->memory, 0, MAX_MEMORY);
+    memset(chip->in_ports, size > 0 ? data[0] : 0, 256);
+    chip->in_ports[1] = size > 1 ? data[1] : 0;
+    load_memory(chip, data, size, 0x0000);
+
+    run8080_until(chip, FUZZ_CYCLE_BUDGET);
+    return 0;
+}
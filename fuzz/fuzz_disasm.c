@@ -0,0 +1,35 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "../src/tools.h"
+#include "../src/flow.h"
+
+/*
+ *  Fuzz target for the disassemblers: the input is a code image of any
+ *  size, run through the linear sweep and the flow following listing.
+ *  The output buffer and the flow map are allocated once.
+ */
+
+#define FUZZ_OUTPUT_SIZE (64 << 10)
+
+static char *out;
+static FlowMap *map;
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size > ADDRESS_SPACE)
+        return 0;
+    if (out == NULL) {
+        out = malloc(FUZZ_OUTPUT_SIZE);
+        map = malloc(sizeof(FlowMap));
+    }
+    int pc = 0;
+    while (pc < (int) size)
+        disassemble_range(data, &pc, size, out, FUZZ_OUTPUT_SIZE);
+
+    analyze_flow(data, size, default_entry_points, 9, map);
+    pc = 0;
+    while (pc < (int) size)
+        disassemble_flow(data, &pc, size, map, out, FUZZ_OUTPUT_SIZE);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include "../src/tools.h"
+
+/*
+ *  Runner for the fuzz targets where libFuzzer isn't available (gcc):
+ *  replays the files given as arguments, or feeds random inputs, and
+ *  reports execs/sec. Like libFuzzer it hands over each input in a
+ *  buffer of exactly its size, so with the sanitizers built in any read
+ *  past the end is reported.
+ *
+ *  usage: fuzz_X [-n runs] [-s seed] [file...]
+ */
+
+#define MAX_INPUT_SIZE 0x10000
+
+int LLVMFuzzerTestOneInput(const uint8_t*, size_t);
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static u_int32_t next_random(u_int32_t *state) {
+    /* xorshift32 */
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+int main(int argc, char **argv) {
+    long runs = 10000;
+    u_int32_t seed = 0x8080;
+    int i = 1;
+
+    for (; i < argc - 1 && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-n") == 0)
+            runs = atol(argv[i + 1]);
+        else if (strcmp(argv[i], "-s") == 0)
+            seed = strtoul(argv[i + 1], NULL, 0) | 1;
+    }
+
+    if (i < argc) {
+        for (; i < argc; i++) {
+            size_t size;
+            unsigned char *file = map_file(argv[i], &size);
+            if (file == NULL) {
+                fprintf(stderr, "error: could not open %s\n", argv[i]);
+                return 1;
+            }
+            uint8_t *data = malloc(size);
+            memcpy(data, file, size);
+            LLVMFuzzerTestOneInput(data, size);
+            free(data);
+            unmap_file(file, size);
+        }
+        return 0;
+    }
+
+    /* Mostly small inputs, which reach the interesting ends of buffers
+     * quickly, with the occasional full 64KB image */
+    double start = now_seconds();
+    for (long run = 0; run < runs; run++) {
+        size_t size = next_random(&seed) % 16 == 0 ? next_random(&seed) % (MAX_INPUT_SIZE + 1)
+                                                    : next_random(&seed) % 64;
+        uint8_t *data = malloc(size);
+        for (size_t j = 0; j < size; j++)
+            data[j] = next_random(&seed);
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+    }
+    double elapsed = now_seconds() - start;
+    printf("%ld runs in %.2fs, %.0f execs/sec\n", runs, elapsed, runs / elapsed);
+    return 0;
+}
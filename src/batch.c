@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "batch.h"
+#include "tools.h"
+
+int find_resync_point(const unsigned char *code, int size, int boundary) {
+    /* Finds the first pc >= boundary that a linear sweep from 0 is
+     * guaranteed to decode as an instruction start.
+     *
+     * The instruction covering boundary starts at boundary-2, -1 or 0,
+     * so decoding from each of those three places and waiting for all of
+     * them to meet at a common address gives a point the sequential
+     * sweep must pass through, whichever alignment it had.
+     * return that pc, or size if the decodes never meet */
+
+    for (int candidate = boundary; candidate < size; candidate += RESYNC_WINDOW) {
+        int pc[3];
+        for (int i = 0; i < 3; i++)
+            pc[i] = (candidate - 2 + i < 0) ? candidate : candidate - 2 + i;
+
+        for (;;) {
+            if (pc[0] == pc[1] && pc[1] == pc[2])
+                return pc[0] < size ? pc[0] : size;
+
+            int lowest = 0;
+            for (int i = 1; i < 3; i++)
+                if (pc[i] < pc[lowest])
+                    lowest = i;
+            if (pc[lowest] >= size)
+                return size;
+            if (pc[lowest] >= candidate + RESYNC_WINDOW)
+                break;
+            pc[lowest] += opcode_table[code[pc[lowest]]].size;
+        }
+    }
+    return size;
+}
+
+int split_image(const unsigned char *code, int size, int chunk_size,
+                DisasmJob *jobs, int max_jobs) {
+    /* Cuts code into jobs of roughly chunk_size bytes at resync points,
+     * so the concatenated listings equal a single linear sweep
+     * return the number of jobs filled in */
+
+    int n_jobs = 0;
+    int start = 0;
+
+    while (start < size && n_jobs < max_jobs) {
+        int end = size;
+        if (n_jobs < max_jobs - 1 && start + chunk_size < size)
+            end = find_resync_point(code, size, start + chunk_size);
+
+        memset(&jobs[n_jobs], 0, sizeof(DisasmJob));
+        jobs[n_jobs].code = code;
+        jobs[n_jobs].start = start;
+        jobs[n_jobs].end = end;
+        n_jobs++;
+        start = end;
+    }
+    return n_jobs;
+}
+
+typedef struct JobQueue {
+    DisasmJob *jobs;
+    int n_jobs;
+    int next;
+    pthread_mutex_t lock;
+    pthread_cond_t job_done;
+} JobQueue;
+
+static void disassemble_job(DisasmJob *job) {
+    size_t out_size = (size_t) (job->end - job->start) * DISASM_LINE_MAX;
+    int pc = job->start;
+
+    job->out = malloc(out_size);
+    job->out_len = disassemble_range(job->code, &pc, job->end, job->out, out_size);
+    job->out = realloc(job->out, job->out_len ? job->out_len : 1);
+}
+
+static void *worker(void *arg) {
+    JobQueue *queue = arg;
+
+    for (;;) {
+        int index = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (index >= queue->n_jobs)
+            return NULL;
+
+        disassemble_job(&queue->jobs[index]);
+
+        pthread_mutex_lock(&queue->lock);
+        queue->jobs[index].done = 1;
+        pthread_cond_broadcast(&queue->job_done);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+static int write_all(int fd, const char *buffer, size_t len) {
+    /* One write() per listing; only loops on short writes */
+    while (len > 0) {
+        ssize_t n = write(fd, buffer, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buffer += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int run_disasm_jobs(DisasmJob *jobs, int n_jobs, int n_threads, int out_fd) {
+    /* Disassembles jobs on n_threads workers while the calling thread
+     * writes finished listings to out_fd in job order (out_fd < 0
+     * discards them). Listings are freed once written.
+     * return 0, or -1 if a write failed */
+
+    JobQueue queue = { .jobs = jobs, .n_jobs = n_jobs, .next = 0 };
+    pthread_t *threads = malloc(n_threads * sizeof(pthread_t));
+    int status = 0;
+
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.job_done, NULL);
+    for (int i = 0; i < n_threads; i++)
+        pthread_create(&threads[i], NULL, worker, &queue);
+
+    for (int i = 0; i < n_jobs; i++) {
+        pthread_mutex_lock(&queue.lock);
+        while (!jobs[i].done)
+            pthread_cond_wait(&queue.job_done, &queue.lock);
+        pthread_mutex_unlock(&queue.lock);
+
+        if (out_fd >= 0 && status == 0)
+            status = write_all(out_fd, jobs[i].out, jobs[i].out_len);
+        free(jobs[i].out);
+        jobs[i].out = NULL;
+    }
+
+    for (int i = 0; i < n_threads; i++)
+        pthread_join(threads[i], NULL);
+    pthread_cond_destroy(&queue.job_done);
+    pthread_mutex_destroy(&queue.lock);
+    free(threads);
+    return status;
+}
+
+int disassemble_files(char **paths, int n_paths, int n_threads, int out_fd) {
+    /* Batch mode: maps every file (- reads standard input), splits large
+     * ones at resync points and disassembles all of them in parallel,
+     * listing files in the order they were given
+     * return 0, or -1 if a file couldn't be read or a write failed */
+
+    Input *inputs = calloc(n_paths, sizeof(Input));
+    int max_jobs = 0;
+    int status = 0;
+
+    for (int i = 0; i < n_paths; i++) {
+        if (open_input(paths[i], &inputs[i]) < 0) {
+            status = -1;
+            continue;
+        }
+        max_jobs += inputs[i].size / BATCH_CHUNK_SIZE + 1;
+    }
+
+    DisasmJob *jobs = malloc((max_jobs ? max_jobs : 1) * sizeof(DisasmJob));
+    int n_jobs = 0;
+    for (int i = 0; i < n_paths; i++)
+        if (inputs[i].data != NULL)
+            n_jobs += split_image(inputs[i].data, inputs[i].size, BATCH_CHUNK_SIZE,
+                                  &jobs[n_jobs], max_jobs - n_jobs);
+
+    if (run_disasm_jobs(jobs, n_jobs, n_threads, out_fd) < 0)
+        status = -1;
+
+    for (int i = 0; i < n_paths; i++)
+        if (inputs[i].data != NULL)
+            close_input(&inputs[i]);
+    free(jobs);
+    free(inputs);
+    return status;
+}
@@ -0,0 +1,26 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+/* Split points are looked for every BATCH_CHUNK_SIZE bytes of an image */
+#define BATCH_CHUNK_SIZE 0x10000
+/* How far decodes from the three candidate alignments may run apart */
+#define RESYNC_WINDOW 64
+
+typedef struct DisasmJob {
+    const unsigned char *code;
+    int start;          // first pc to disassemble
+    int end;            // first pc not to disassemble
+    char *out;          // listing, filled by a worker
+    size_t out_len;
+    int done;
+} DisasmJob;
+
+int find_resync_point(const unsigned char*, int, int);
+int split_image(const unsigned char*, int, int, DisasmJob*, int);
+int run_disasm_jobs(DisasmJob*, int, int, int);
+int disassemble_files(char**, int, int, int);
+
+#endif
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "tools.h"
+#include "flow.h"
+#include "batch.h"
+#include "bench.h"
+#include "video.h"
+#include "chip8080.h"
+#include "debugger.h"
+
+/* Benchmark suite; run with `make bench` or ./emulator bench <rom> */
+
+#define BENCH_IMAGE_SIZE (8 << 20)
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double value, const char *unit) {
+    printf("%-32s %12.2f %s\n", name, value, unit);
+}
+
+static void bench_disassemble_range(const unsigned char *image, int size) {
+    size_t out_size = 1 << 20;
+    char *out = malloc(out_size);
+    double start = now_seconds();
+    int pc = 0;
+
+    while (pc < size)
+        disassemble_range(image, &pc, size, out, out_size);
+
+    report("disassemble_range", size / (now_seconds() - start) / 1e6, "MB/s");
+    free(out);
+}
+
+static void bench_analyze_flow(const unsigned char *rom, int rom_size) {
+    FlowMap *map = malloc(sizeof(FlowMap));
+    int rounds = 1000;
+    double start = now_seconds();
+
+    for (int i = 0; i < rounds; i++)
+        analyze_flow(rom, rom_size, default_entry_points, 9, map);
+
+    report("analyze_flow", (now_seconds() - start) / rounds * 1e6, "us/ROM");
+    free(map);
+}
+
+static void bench_batch(const unsigned char *image, int size, int n_threads) {
+    int max_jobs = size / BATCH_CHUNK_SIZE + 1;
+    DisasmJob *jobs = malloc(max_jobs * sizeof(DisasmJob));
+    char name[64];
+    double start = now_seconds();
+
+    int n_jobs = split_image(image, size, BATCH_CHUNK_SIZE, jobs, max_jobs);
+    run_disasm_jobs(jobs, n_jobs, n_threads, -1);
+
+    snprintf(name, sizeof(name), "batch disassembly (%d thread%s)", n_threads, n_threads > 1 ? "s" : "");
+    report(name, size / (now_seconds() - start) / 1e6, "MB/s");
+    free(jobs);
+}
+
+static void bench_rasterizer() {
+    u_int8_t *memory = calloc(MAX_MEMORY, 1);
+    u_int8_t *gray = malloc(VIDEO_WIDTH * VIDEO_HEIGHT);
+    u_int32_t *rgba = malloc(VIDEO_WIDTH * VIDEO_HEIGHT * sizeof(u_int32_t));
+    Rasterizer *rasterizer = malloc(sizeof(Rasterizer));
+    int rounds = 2000;
+
+    for (int i = VIDEO_RAM; i < VIDEO_RAM + VIDEO_RAM_SIZE; i++)
+        memory[i] = i * 37;
+    init_rasterizer(rasterizer, 1);
+
+    double start = now_seconds();
+    for (int i = 0; i < rounds; i++)
+        rasterize_gray(rasterizer, memory, gray);
+    report("rasterize_gray", (now_seconds() - start) / rounds * 1e6, "us/frame");
+
+    start = now_seconds();
+    for (int i = 0; i < rounds; i++)
+        rasterize_rgba(rasterizer, memory, rgba);
+    report("rasterize_rgba (overlay)", (now_seconds() - start) / rounds * 1e6, "us/frame");
+
+    /* A typical frame: a handful of lines touched by moving sprites */
+    u_int8_t lines[VIDEO_DIRTY_BYTES] = {0};
+    for (int x = 100; x < 108; x++)
+        lines[x >> 3] |= 1 << (x & 7);
+
+    start = now_seconds();
+    for (int i = 0; i < rounds; i++)
+        rasterize_gray_lines(rasterizer, memory, lines, gray);
+    report("rasterize_gray_lines (8 lines)", (now_seconds() - start) / rounds * 1e6, "us/frame");
+
+    start = now_seconds();
+    for (int i = 0; i < rounds; i++)
+        rasterize_rgba_lines(rasterizer, memory, lines, rgba);
+    report("rasterize_rgba_lines (8 lines)", (now_seconds() - start) / rounds * 1e6, "us/frame");
+
+    free(rasterizer);
+    free(rgba);
+    free(gray);
+    free(memory);
+}
+
+static void bench_interpreter(const char *name, int n_breakpoints) {
+    /* A loop of loads, ALU ops, stores and jumps over 0x2000-0x7fff,
+     * which writes memory so it is never skipped as idle, with
+     * n_breakpoints set where it never goes */
+    const unsigned char program[] = {
+        0x01, 0x00, 0x20,   // 0000 LXI B,$2000
+        0x11, 0x34, 0x12,   // 0003 LXI D,$1234
+        0x0a,               // 0006 LDAX B
+        0x2f,               // 0007 CMA
+        0xa2,               // 0008 ANA D
+        0x02,               // 0009 STAX B
+        0x19,               // 000a DAD D
+        0x0c,               // 000b INR C
+        0xc2, 0x06, 0x00,   // 000c JNZ $0006
+        0x04,               // 000f INR B
+        0xf2, 0x06, 0x00,   // 0010 JP $0006
+        0x06, 0x20,         // 0013 MVI B,$20
+        0xc3, 0x06, 0x00,   // 0015 JMP $0006
+    };
+    Chip8080 *chip = make_chip8080();
+    u_int64_t cycles = 200000000;
+
+    load_memory(chip, program, sizeof(program), 0x0000);
+    for (int i = 0; i < n_breakpoints; i++)
+        set_breakpoint(chip, 0x1000 + i * 0x100);
+    double start = now_seconds();
+    run8080_until(chip, cycles);
+    report(name, cycles / (now_seconds() - start) / 1e6, "MHz");
+    destroy_chip8080(chip);
+}
+
+int bench_main(int argc, char **argv) {
+    /* argv[0] is the ROM to benchmark with, invaders/invaders if missing */
+    const char *path = argc > 0 ? argv[0] : "invaders/invaders";
+    size_t rom_size;
+    unsigned char *rom = map_file(path, &rom_size);
+    if (rom == NULL || rom_size == 0) {
+        fprintf(stderr, "error: could not open %s\n", path);
+        return 1;
+    }
+
+    /* A large image made of back to back copies of the ROM */
+    unsigned char *image = malloc(BENCH_IMAGE_SIZE);
+    for (size_t offset = 0; offset < BENCH_IMAGE_SIZE; offset += rom_size) {
+        size_t n = BENCH_IMAGE_SIZE - offset < rom_size ? BENCH_IMAGE_SIZE - offset : rom_size;
+        memcpy(image + offset, rom, n);
+    }
+    int n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    bench_disassemble_range(image, BENCH_IMAGE_SIZE);
+    bench_analyze_flow(rom, rom_size);
+    bench_batch(image, BENCH_IMAGE_SIZE, 1);
+    if (n_cpus > 1)
+        bench_batch(image, BENCH_IMAGE_SIZE, n_cpus);
+    bench_rasterizer();
+    bench_interpreter("interpreter (run8080_until)", 0);
+    bench_interpreter("interpreter (4 breakpoints)", 4);
+
+    free(image);
+    unmap_file(rom, rom_size);
+    return 0;
+}
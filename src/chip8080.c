@@ -1,67 +1,142 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include "chip8080.h"
 #include "tools.h"
 
-int run8080(Chip8080 *chip) {
-    unsigned char *program_data = &chip->memory[chip->reg_pc];
-
-    switch(*program_data) {
-        case 0x00: nop(chip); break;
-        case 0x01: lxi_b_d16(chip, program_data); break;
-        case 0x02: stax_b(chip); break;
-        case 0x03: inx_b(chip); break;
-        case 0x04: inr_b(chip); break;
-        case 0x05: dcr_b(chip); break;
-        case 0x06: mvi_b_d8(chip, program_data); break;
-        case 0x07: unimplementedInstruction(chip); // rlc(chip)
-        case 0x08: nop(chip); break;
-        case 0x09: dad_b(chip); break;
-        case 0x0a: ldax_b(chip); break;
-        case 0x0b: dcx_b(chip); break;
-        case 0x0c: inr_c(chip); break;
-        case 0x0d: dcr_c(chip); break;
-        case 0x0e: mvi_c_d8(chip, program_data); break;
-        case 0x0f: unimplementedInstruction(chip); break; // rrc(chip)
-        case 0x10: nop(chip); break;
-        case 0x11: lxi_d_d16(chip, program_data); break;
-        case 0x12: stax_d(chip); break;
-        case 0x13: inx_d(chip); break;
-        case 0x14: inr_d(chip); break;
-        case 0x15: dcr_d(chip); break;
-        case 0x16: mvi_d_d8(chip, program_data); break;
-        case 0x17: unimplementedInstruction(chip); break; // ral(chip)
-        case 0x18: nop(chip); break;
-        case 0x19: dad_d(chip); break;
-        case 0x1a: ldax_d(chip); break;
-        case 0x1b: dcx_d(chip); break;
-        case 0x1c: inr_e(chip); break;
-        case 0x1d: dcr_e(chip); break;
-        case 0x1f: unimplementedInstruction(chip); break; // rar(chip)
-        case 0x20: nop(chip); break;
-        case 0x21: lxi_h_d16(chip, program_data); break;
-        case 0x22: shld_addr(chip, program_data); break;
-        case 0x23: inx_h(chip); break; 
-        case 0x24: inr_h(chip); break;
-        case 0x25: dcr_h(chip); break;
-        case 0x26: mvi_h_d8(chip, program_data); break;
-        case 0x27: unimplementedInstruction(chip); break; // daa(chip)
-        case 0x28: nop(chip); break;
-        case 0x29: dad_h(chip); break;
-        case 0x2a: lhld_adr(chip, program_data);
-        case 0x2b: dcx_h(chip); break;
-        case 0x2c: inr_l(chip); break;
-        case 0x2d: dcr_l(chip); break;
-        case 0x2e: mvi_l_d8(chip, program_data); break;
-        case 0x2f: cma(chip); break;
+/* Clock cycles per opcode; conditional CALL/RET count the not taken case */
+const u_int8_t opcode_cycles[256] = {
+     4, 10,  7,  5,  5,  5,  7,  4,   4, 10,  7,  5,  5,  5,  7,  4, // 0x00
+     4, 10,  7,  5,  5,  5,  7,  4,   4, 10,  7,  5,  5,  5,  7,  4, // 0x10
+     4, 10, 16,  5,  5,  5,  7,  4,   4, 10, 16,  5,  5,  5,  7,  4, // 0x20
+     4, 10, 13,  5, 10, 10, 10,  4,   4, 10, 13,  5,  5,  5,  7,  4, // 0x30
+     5,  5,  5,  5,  5,  5,  7,  5,   5,  5,  5,  5,  5,  5,  7,  5, // 0x40
+     5,  5,  5,  5,  5,  5,  7,  5,   5,  5,  5,  5,  5,  5,  7,  5, // 0x50
+     5,  5,  5,  5,  5,  5,  7,  5,   5,  5,  5,  5,  5,  5,  7,  5, // 0x60
+     7,  7,  7,  7,  7,  7,  7,  7,   5,  5,  5,  5,  5,  5,  7,  5, // 0x70
+     4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4, // 0x80
+     4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4, // 0x90
+     4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4, // 0xa0
+     4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4, // 0xb0
+     5, 10, 10, 10, 11, 11,  7, 11,   5, 10, 10, 10, 11, 17,  7, 11, // 0xc0
+     5, 10, 10, 10, 11, 11,  7, 11,   5, 10, 10, 10, 11, 17,  7, 11, // 0xd0
+     5, 10, 10, 18, 11, 11,  7, 11,   5,  5, 10,  4, 11, 17,  7, 11, // 0xe0
+     5, 10, 10,  4, 11, 11,  7, 11,   5,  5, 10,  4, 11, 17,  7, 11, // 0xf0
+};
+
+static void skip_idle_loop(Chip8080 *chip, u_int64_t deadline) {
+    /* Credits every whole iteration of a proven idle loop that ends
+     * before deadline. Each one would leave the machine as it found it
+     * but for the cycles, so the instruction that reaches the deadline,
+     * and everything after, is the same as without skipping */
+    u_int64_t period = chip->idle.period;
+    chip->idle.period = 0;
+    if (chip->cycles >= deadline)
+        return;
+    u_int64_t skip = (deadline - 1 - chip->cycles) / period * period;
+    chip->cycles += skip;
+    chip->idle.cycles += skip;
+    chip->idle.skipped += skip;
+}
+
+static RunStatus run_debugged_until(Chip8080 *chip, u_int64_t deadline) {
+    /* run8080_until() with a debugger attached: stops before any
+     * instruction with a breakpoint but the one being resumed from, and
+     * after any that wrote to a watched address. Idle loops are run in
+     * full, as a breakpoint may sit in one */
+    Debugger *debug = chip->debug;
+    while (chip->cycles < deadline) {
+        if (debug->watch_hit)
+            return RUN_WATCHPOINT;
+        if (chip->halted) {
+            chip->cycles = deadline;
+            break;
+        }
+        if (chip->reg_pc != debug->resume_pc
+            && (debug->breakpoints[chip->reg_pc >> 3] >> (chip->reg_pc & 7)) & 1)
+            return RUN_BREAKPOINT;
+        debug->resume_pc = NO_BRANCH;
+        if (run8080(chip) == RUN_UNIMPLEMENTED)
+            return RUN_UNIMPLEMENTED;
+    }
+    if (debug->watch_hit)
+        return RUN_WATCHPOINT;
+    return is_parked(chip) ? RUN_HALTED : RUN_BUDGET;
+}
+
+RunStatus run8080_until(Chip8080 *chip, u_int64_t deadline) {
+    /* Batched run loop: executes whole instructions until the cycle
+     * counter reaches deadline (it may overshoot by one instruction).
+     * Idle loops are only trusted within one call, as whatever the
+     * caller does between calls may change memory, and a halted chip
+     * sleeps straight through to the deadline, where the caller's next
+     * event may interrupt it
+     * return RUN_BUDGET, RUN_HALTED if the chip sleeps with interrupts
+     * off, or RUN_UNIMPLEMENTED with reg_pc at the opcode */
+    if (chip->debug != NULL)
+        return run_debugged_until(chip, deadline);
+    chip->idle.branch = NO_BRANCH;
+    chip->idle.period = 0;
+    while (chip->cycles < deadline) {
+        if (chip->halted) {
+            chip->cycles = deadline;
+            break;
+        }
+        if (run8080(chip) == RUN_UNIMPLEMENTED)
+            return RUN_UNIMPLEMENTED;
+        if (chip->idle.period != 0)
+            skip_idle_loop(chip, deadline);
+    }
+    return is_parked(chip) ? RUN_HALTED : RUN_BUDGET;
+}
+
+int generate_interrupt(Chip8080 *chip, u_int8_t rst) {
+    /* Executes RST rst (0-7) for an interrupting device: pushes PC,
+     * jumps to rst * 8 and disables interrupts. Interrupts requested
+     * while disabled are dropped.
+     * return 1 if the interrupt was taken */
+    if (!chip->irq_enable)
+        return 0;
+    chip->reg_sp -= 2;
+    write_memory(chip, chip->reg_sp + 1, get_register_pair_h(chip->reg_pc));
+    write_memory(chip, chip->reg_sp, get_register_pair_l(chip->reg_pc));
+    chip->reg_pc = rst * 8;
+    chip->irq_enable = 0;
+    chip->halted = 0;
+    chip->idle.branch = NO_BRANCH;
+    chip->cycles += opcode_cycles[0xc7];
+    return 1;
+}
+
+void hit_watched_page(Chip8080 *chip, u_int16_t address) {
+    /* Slow path of write_memory() for pages holding a watchpoint: notes
+     * the first watched address written since the debugger's last stop */
+    Debugger *debug = chip->debug;
+    if (debug != NULL && !debug->watch_hit && (debug->watchpoints[address >> 3] >> (address & 7)) & 1) {
+        debug->watch_hit = 1;
+        debug->watch_address = address;
     }
-    return 0;
 }
 
 Chip8080* make_chip8080() {
-    Chip8080 *chip8080 = malloc(sizeof(Chip8080));
+    Chip8080 *chip8080 = aligned_alloc(CACHE_LINE_SIZE, sizeof(Chip8080));
     chip8080->memory = _make_memory_bank();
+    memset(chip8080->dirty, 0, sizeof(chip8080->dirty));
+    memset(chip8080->watched_pages, 0, sizeof(chip8080->watched_pages));
+    chip8080->debug = NULL;
+    memset(chip8080->in_ports, 0, sizeof(chip8080->in_ports));
+    memset(chip8080->out_ports, 0, sizeof(chip8080->out_ports));
+    memset(chip8080->port_in, 0, sizeof(chip8080->port_in));
+    memset(chip8080->port_out, 0, sizeof(chip8080->port_out));
+    chip8080->machine = NULL;
+#ifdef HEATMAP
+    // Skipped idle loops would go uncounted, so every iteration runs
+    chip8080->heat = calloc(1, sizeof(Heatmap));
+    chip8080->idle.enabled = 0;
+#else
+    chip8080->idle.enabled = 1;
+#endif
     reset_chip_state(chip8080);
     return chip8080;
 }
@@ -82,6 +157,31 @@ void reset_chip_state(Chip8080 *chip) {
     chip->flags.cy = 0;
     chip->flags.ac = 0;
     chip->flags.pad = 0;
+    chip->irq_enable = 0;
+    chip->halted = 0;
+    chip->cycles = 0;
+    chip->idle.branch = NO_BRANCH;
+    chip->idle.period = 0;
+    chip->idle.skipped = 0;
+}
+
+size_t load_memory(Chip8080 *chip, const unsigned char *data, size_t size, u_int16_t address) {
+    /* Copies data into memory at address, truncating at the end of memory,
+     * and marks the blocks it covers dirty
+     * return the number of bytes copied */
+    if (size > MAX_MEMORY - address)
+        size = MAX_MEMORY - address;
+    memcpy(&chip->memory[address], data, size);
+    for (size_t block = address >> DIRTY_BLOCK_SHIFT; size > 0 && block <= (address + size - 1) >> DIRTY_BLOCK_SHIFT; block++)
+        chip->dirty[block >> 3] |= 1 << (block & 7);
+    return size;
+}
+
+void set_port_handlers(Chip8080 *chip, u_int8_t port, PortIn in, PortOut out) {
+    /* Either handler may be NULL; IN then reads chip->in_ports[port]
+     * and OUT only latches into chip->out_ports[port] */
+    chip->port_in[port] = in;
+    chip->port_out[port] = out;
 }
 
 u_int8_t* _make_memory_bank() {
@@ -126,34 +226,39 @@ int has_parity(int x, int size) {
 	return (0 == (p & 0x1));
 }
 
-int is_multiple_of_16(u_int8_t reg) {
-    return reg % 16 == 0;
+int has_ac_inr(u_int8_t res) {
+    /* INR carries out of bit 3 when the low nibble wrapped to 0 */
+    return (res & 0x0f) == 0x00;
 }
 
-int has_ac(u_int8_t reg) {
-    return !is_zero(reg) && is_multiple_of_16(reg);
+int has_ac_dcr(u_int8_t res) {
+    /* DCR adds 0xff, which carries out of bit 3 unless the low nibble
+     * had to borrow and wrapped to 0xf */
+    return (res & 0x0f) != 0x0f;
 }
 
 void destroy_chip8080(Chip8080 *chip) {
+    free(chip->debug);
+#ifdef HEATMAP
+    free(chip->heat);
+#endif
     free(chip->memory);
     free(chip);
 }
 
-
 /*
  *  Instrucions
  *
  */
 
 void unimplementedInstruction(Chip8080 *chip) {
+    /* Reports the opcode at PC after run8080() returned RUN_UNIMPLEMENTED */
     printf("Error: Unimplemented Instruction!\n");
-    chip->reg_pc--;
-    disassemble_machine_code(chip->memory, chip->reg_pc);
+    disassemble_machine_code(chip->memory, chip->reg_pc, MAX_MEMORY);
     printf("\n");
-    exit(1);
 }
 
-void nop(Chip8080 *chip) {
+static inline void exec_nop(Chip8080 *chip) {
     /* [0x00] NOP; No operation,
      * PC += 1,
      * Instrucion Size: 1 BYTE
@@ -161,72 +266,143 @@ void nop(Chip8080 *chip) {
     chip->reg_pc++;
 }
 
-void lxi_b_d16(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x01] LXI B,D16; B <- byte 3, C <- byte 2;
-     * Flags: None,
-     * Instruction Size: 3 BYTES
-     */
-    chip->reg_b = program_data[2];
-    chip->reg_c = program_data[1];
-    chip->reg_pc += 3;
-}
+/*
+ *  Register-specialized families
+ *
+ *  One handler per register operand, generated from FOR_EACH_REGISTER and
+ *  FOR_EACH_PAIR in chip8080.h, as are their declarations, their cases in
+ *  run8080() and their entries in implemented_opcodes.
+ */
 
-void stax_b(Chip8080 *chip) {
-    /* [0x02] STAX B; (BC) <- A;
-     * Flags: None,
-     * Instruction Size: 1 BYTE
-     */
-    u_int16_t reg_bc = make_register_pair_from(chip->reg_b, chip->reg_c);
-    chip->memory[reg_bc] = chip->reg_a;
+/* [0x04 | r << 3] INR r: r <- r + 1
+ * Flags: Z, S, P, AC
+ * Bytes: 1
+ */
+#define INR(r, field, code) \
+static inline void exec_inr_##r(Chip8080 *chip) { \
+    chip->field++; \
+    chip->flags.z = is_zero(chip->field); \
+    chip->flags.s = has_sign(chip->field); \
+    chip->flags.p = has_parity(chip->field, 8); \
+    chip->flags.ac = has_ac_inr(chip->field); \
+    chip->reg_pc++; \
+}
+
+/* [0x05 | r << 3] DCR r: r <- r - 1
+ * Flags: Z, S, P, AC
+ * Bytes: 1
+ */
+#define DCR(r, field, code) \
+static inline void exec_dcr_##r(Chip8080 *chip) { \
+    chip->field--; \
+    chip->flags.z = is_zero(chip->field); \
+    chip->flags.s = has_sign(chip->field); \
+    chip->flags.p = has_parity(chip->field, 8); \
+    chip->flags.ac = has_ac_dcr(chip->field); \
+    chip->reg_pc++; \
+}
+
+/* [0x06 | r << 3] MVI r,D8: r <- byte 2
+ * Flags: None
+ * Bytes: 2
+ */
+#define MVI(r, field, code) \
+static inline void exec_mvi_##r##_d8(Chip8080 *chip, unsigned char *program_data) { \
+    chip->field = program_data[1]; \
+    chip->reg_pc += 2; \
+}
+
+static inline void ana(Chip8080 *chip, u_int8_t value) {
+    /* A <- A & value; the 8080 sets AC from bit 3 of either operand */
+    chip->flags.ac = ((chip->reg_a | value) & 0x08) != 0;
+    chip->reg_a &= value;
+    chip->flags.z = is_zero(chip->reg_a);
+    chip->flags.s = has_sign(chip->reg_a);
+    chip->flags.p = has_parity(chip->reg_a, 8);
+    chip->flags.cy = 0;
     chip->reg_pc++;
 }
 
-void inx_b(Chip8080 *chip) {
-    /* [0x03] INX B; BC <- BC + 1;
-     * Flags: None,
-     * Instruction Size: 1 BYTE
-     */
-    u_int16_t reg_bc = make_register_pair_from(chip->reg_b, chip->reg_c);
-    reg_bc++;
-    chip->reg_b = get_register_pair_h(reg_bc);
-    chip->reg_c = get_register_pair_l(reg_bc);
-    chip->reg_pc++;
+/* [0xa0 | r] ANA r: A <- A & r
+ * Flags: Z, S, P, CY, AC
+ * Bytes: 1
+ */
+#define ANA(r, field, code) \
+static inline void exec_ana_##r(Chip8080 *chip) { \
+    ana(chip, chip->field); \
 }
 
-void inr_b(Chip8080 *chip) {
-    /* [0x04] INR B; B <- B+1
-     * Flags: Z, S, P, AC
-     * BYTES: 1
-    */
-    chip->reg_b++;
-    chip->flags.z = is_zero(chip->reg_b);
-    chip->flags.s = has_sign(chip->reg_b);
-    chip->flags.p = has_parity(chip->reg_b, 8);
-    chip->flags.ac = has_ac(chip->reg_b);
-    chip->reg_pc++;
+/* [0x01 | rp << 4] LXI rp,D16: high <- byte 3, low <- byte 2
+ * Flags: None
+ * Bytes: 3
+ */
+#define LXI(rp, high, low, code) \
+static inline void exec_lxi_##rp##_d16(Chip8080 *chip, unsigned char *program_data) { \
+    chip->high = program_data[2]; \
+    chip->low = program_data[1]; \
+    chip->reg_pc += 3; \
 }
 
-void dcr_b(Chip8080 *chip) {
-    /* [0x05] DCR B; B <- B-1; 1 BYTE
-     * Flags: Z, S, P, AC
-     * BYTES: 1
+/* [0x03 | rp << 4] INX rp: rp <- rp + 1
+ * Flags: None
+ * Bytes: 1
+ */
+#define INX(rp, high, low, code) \
+static inline void exec_inx_##rp(Chip8080 *chip) { \
+    u_int16_t pair = make_register_pair_from(chip->high, chip->low); \
+    pair++; \
+    chip->high = get_register_pair_h(pair); \
+    chip->low = get_register_pair_l(pair); \
+    chip->reg_pc++; \
+}
+
+/* [0x09 | rp << 4] DAD rp: HL <- HL + rp
+ * Flags: CY
+ * Bytes: 1
+ */
+#define DAD(rp, high, low, code) \
+static inline void exec_dad_##rp(Chip8080 *chip) { \
+    u_int32_t hl = make_register_pair_from(chip->reg_h, chip->reg_l); \
+    u_int32_t res = hl + make_register_pair_from(chip->high, chip->low); \
+    chip->reg_h = get_register_pair_h(res); \
+    chip->reg_l = get_register_pair_l(res); \
+    chip->flags.cy = ((res & 0xffff0000) > 0); \
+    chip->reg_pc++; \
+}
+
+/* [0x0b | rp << 4] DCX rp: rp <- rp - 1
+ * Flags: None
+ * Bytes: 1
+ */
+#define DCX(rp, high, low, code) \
+static inline void exec_dcx_##rp(Chip8080 *chip) { \
+    u_int16_t pair = make_register_pair_from(chip->high, chip->low); \
+    pair--; \
+    chip->high = get_register_pair_h(pair); \
+    chip->low = get_register_pair_l(pair); \
+    chip->reg_pc++; \
+}
+
+FOR_EACH_REGISTER(INR)
+FOR_EACH_REGISTER(DCR)
+FOR_EACH_REGISTER(MVI)
+FOR_EACH_REGISTER(ANA)
+ANA(a, reg_a, 7)
+FOR_EACH_PAIR(LXI)
+FOR_EACH_PAIR(INX)
+FOR_EACH_PAIR(DAD)
+FOR_EACH_PAIR(DCX)
+
+static inline void exec_stax_b(Chip8080 *chip) {
+    /* [0x02] STAX B; (BC) <- A;
+     * Flags: None,
+     * Instruction Size: 1 BYTE
      */
-    chip->reg_b--;
-    chip->flags.z = is_zero(chip->reg_b);
-    chip->flags.s = has_sign(chip->reg_b);
-    chip->flags.p = has_parity(chip->reg_b, 8);
-    chip->flags.ac = has_ac(chip->reg_b);
+    u_int16_t reg_bc = make_register_pair_from(chip->reg_b, chip->reg_c);
+    write_memory(chip, reg_bc, chip->reg_a);
     chip->reg_pc++;
 }
 
-void mvi_b_d8(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x06] MVI B,D8; B <- byte 2
-     * Flags: None
-     * BYTES 2 */
-    chip->reg_b = program_data[1];
-    chip->reg_pc += 2;
-}
-
 void rlc(Chip8080 *chip) {
     /* [0x07] A = A << 1; bit 0 = prev bit 7; CY = prev bit 7
      * Flags: CY
@@ -236,386 +412,449 @@ void rlc(Chip8080 *chip) {
      */
 }
 
-void dad_b(Chip8080 *chip) {
-    /* [0x09] DAD B; HL = HL+BC
-     * Flags: CY
-     * BYTES = 1
-     */
-    u_int32_t hl = make_register_pair_from(chip->reg_h, chip->reg_l);
-    u_int32_t bc = make_register_pair_from(chip->reg_b, chip->reg_c);
-    u_int32_t res = hl + bc;
-    chip->reg_h = get_register_pair_h(res);
-    chip->reg_l = get_register_pair_l(res);
-    chip->flags.cy = ((res & 0xffff0000) > 0);
-    chip->reg_pc++;
-}
-
-void ldax_b(Chip8080 *chip) {
+static inline void exec_ldax_b(Chip8080 *chip) {
     /* [0x0a] A <- (BC)
      * Flags: None
      * BYTES: 1
      */
     u_int16_t reg_bc = make_register_pair_from(chip->reg_b, chip->reg_c);
-    chip->reg_a = chip->memory[reg_bc];
+    chip->reg_a = read_memory(chip, reg_bc);
     chip->reg_pc++;
 }
 
-void dcx_b(Chip8080 *chip) {
-    /* [0x0b] BC = BC - 1
-     * Flags: None
-     * BYTES: 1
+void rrc(Chip8080 *chip) {
+    /* [0x0f] A = A>>1; bit 7 = prev bit 0; CY = prev bit 0
+     * Flags: CY
+     * Instruction Size: 1 Byte
      */
-    u_int16_t reg_bc = make_register_pair_from(chip->reg_b, chip->reg_c);
-    reg_bc--;
-    chip->reg_b = get_register_pair_h(reg_bc);
-    chip->reg_c = get_register_pair_l(reg_bc);
-    chip->reg_pc++;
+     // TODO: Implement
 }
 
-void inr_c(Chip8080 *chip) {
-    /* [0x0c] C = C + 1
-     * Flags: Z, S, P, AC
-     * BYTES: 1
+static inline void exec_stax_d(Chip8080 *chip) {
+    /* [0x12] STAX D; (DE) <- A;
+     * Flags: None,
+     * Instruction Size: 1 BYTE
      */
-    chip->reg_c++;
-    chip->flags.z = is_zero(chip->reg_c);
-    chip->flags.s = has_sign(chip->reg_c);
-    chip->flags.p = has_parity(chip->reg_c, 8);
-    chip->flags.ac = has_ac(chip->reg_c);
+    u_int16_t reg_de = make_register_pair_from(chip->reg_d, chip->reg_e);
+    write_memory(chip, reg_de, chip->reg_a);
     chip->reg_pc++;
 }
 
-void dcr_c(Chip8080 *chip) {
-    /* [0x0d] C = C - 1
-     * Flags: Z, S, P, AC
-     * Bytes: 1
+void ral(Chip8080 *chip) {
+    /* [0x17] RAL; A = A << 1; bit 0 = prev CY; CY = prev bit 7
+     * Flags: CY
+     * Instruction Size: 1 Byte
      */
-    chip->reg_c--;
-    chip->flags.z = is_zero(chip->reg_c);
-    chip->flags.s = has_sign(chip->reg_c);
-    chip->flags.p = has_parity(chip->reg_c, 8);
-    chip->flags.ac = has_ac(chip->reg_c);
-    chip->reg_pc++;
+
+    //TODO: Implement
 }
 
-void mvi_c_d8(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x0e] C = Byte 2
+static inline void exec_ldax_d(Chip8080 *chip) {
+    /* [0x1a] LDAX D; A <- (DE)
      * Flags: None
-     * Bytes: 2
+     * Instruction Size: 1 Byte
      */
-    chip->reg_c = program_data[1];
-    chip->reg_pc += 2;
+    u_int16_t reg_de = make_register_pair_from(chip->reg_d, chip->reg_e);
+    chip->reg_a = read_memory(chip, reg_de);
+    chip->reg_pc++;
 }
 
-void rrc(Chip8080 *chip) {
-    /* [0x0f] A = A>>1; bit 7 = prev bit 0; CY = prev bit 0
+void rar(Chip8080 *chip) {
+    /* [0x1f] RAR; A = A >> 1; bit 7 = prev bit 7; CY = prev bit 0
      * Flags: CY
      * Instruction Size: 1 Byte
      */
-     // TODO: Implement
+
+    //TODO: Implement
 }
 
-void lxi_d_d16(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x11] LXI D,D16; D <- byte 3, E <- byte 2;
-     * Flags: None,
-     * Instruction Size: 3 BYTES
+static inline void exec_shld_addr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0x22] SHLD addr; (addr) <- L; (addr + 1) <- H
+     * Flags: None
+     * Instruction Size: 3 Bytes
      */
-    chip->reg_d = program_data[2];
-    chip->reg_e = program_data[1];
+    write_memory(chip, make_register_pair_from(program_data[2], program_data[1]), chip->reg_l);
+    write_memory(chip, make_register_pair_from(program_data[2], program_data[1]) + 1, chip->reg_h);
     chip->reg_pc += 3;
 }
 
-void stax_d(Chip8080 *chip) {
-    /* [0x12] STAX D; (DE) <- A;
-     * Flags: None,
-     * Instruction Size: 1 BYTE
-     */
-    u_int16_t reg_de = make_register_pair_from(chip->reg_d, chip->reg_e);
-    chip->memory[reg_de] = chip->reg_a;
-    chip->reg_pc++;
+void daa(Chip8080 *chip) {
+    /* [0x27] 1 Byte */
+    // TODO: Implement
 }
 
-void inx_d(Chip8080 *chip) {
-    /* [0x13] INX DE; (DE) <- DE+1
-     * Flags: None,
-     * Instruction Size: 1 Byte
+static inline void exec_lhld_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0x2a] LHLD addr; L <- (addr), H <- (addr+1)
+     * Flags: None
+     * Bytes: 3
      */
-    u_int16_t reg_de = make_register_pair_from(chip->reg_d, chip->reg_e);
-    reg_de++;
-    chip->reg_d = get_register_pair_h(reg_de);
-    chip->reg_e = get_register_pair_l(reg_de);
-    chip->reg_pc++;
+    u_int16_t address = make_register_pair_from(program_data[2], program_data[1]);
+    chip->reg_l = read_memory(chip, address);
+    chip->reg_h = read_memory(chip, address + 1);
+    chip->reg_pc += 3;
 }
 
-void inr_d(Chip8080 *chip) {
-    /* [0x14] INR D; D <- D+1
-     * Flags: Z, S, P, AC
-     * Instruction Size: 1 Byte
+static inline void exec_cma(Chip8080 *chip) {
+    /* [0x2f] CMA: A <- !A,
+     * Flags: None,
+     * Bytes: 1
      */
-    chip->reg_d++;
-    chip->flags.z = is_zero(chip->reg_d);
-    chip->flags.s = has_sign(chip->reg_d);
-    chip->flags.p = has_parity(chip->reg_d, 8);
-    chip->flags.ac = has_ac(chip->reg_d);
+    chip->reg_a = ~chip->reg_a; 
     chip->reg_pc++;
 }
 
-void dcr_d(Chip8080 *chip) {
-    /* [0x15] DCR D; D <- D-1
-     * Flags: Z, S, P, AC
-     * Instruction Size: 1 Byte
+static inline void exec_out_d8(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xd3] OUT D8: Port Byte 2 <- A
+     * Flags: None
+     * Bytes: 2
      */
-    chip->reg_d--;
-    chip->flags.z = is_zero(chip->reg_d);
-    chip->flags.s = has_sign(chip->reg_d);
-    chip->flags.p = has_parity(chip->reg_d, 8);
-    chip->flags.ac = has_ac(chip->reg_d);
-    chip->reg_pc++;
+    write_port(chip, program_data[1], chip->reg_a);
+    chip->reg_pc += 2;
 }
 
-void mvi_d_d8(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x16] MVI D, D8; D <- Byte 2
+static inline void exec_in_d8(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xdb] IN D8: A <- Port Byte 2
      * Flags: None
-     * Instruction Size: 2 Bytes
+     * Bytes: 2
      */
-    chip->reg_d = program_data[1];
+    chip->reg_a = read_port(chip, program_data[1]);
     chip->reg_pc += 2;
 }
 
-void ral(Chip8080 *chip) {
-    /* [0x17] RAL; A = A << 1; bit 0 = prev CY; CY = prev bit 7
-     * Flags: CY
-     * Instruction Size: 1 Byte
+static inline void exec_di(Chip8080 *chip) {
+    /* [0xf3] DI: Disable Interrupts
+     * Flags: None
+     * Bytes: 1
      */
-
-    //TODO: Implement
+    chip->irq_enable = 0;
+    chip->reg_pc++;
 }
 
-void dad_d(Chip8080 *chip) {
-    /* [0x19] DAD D; HL = HL+DE
-     * Flags: CY
-     * BYTES = 1
+static inline void exec_ei(Chip8080 *chip) {
+    /* [0xfb] EI: Enable Interrupts
+     * Flags: None
+     * Bytes: 1
      */
-    u_int32_t hl = make_register_pair_from(chip->reg_h, chip->reg_l);
-    u_int32_t de = make_register_pair_from(chip->reg_d, chip->reg_e);
-    u_int32_t res = hl + de;
-    chip->reg_h = get_register_pair_h(res);
-    chip->reg_l = get_register_pair_l(res);
-    chip->flags.cy = ((res & 0xffff0000) > 0);
+    chip->irq_enable = 1;
     chip->reg_pc++;
 }
 
-void ldax_d(Chip8080 *chip) {
-    /* [0x1a] LDAX D; A <- (DE)
+static inline void exec_sta_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0x32] STA addr: (addr) <- A
      * Flags: None
-     * Instruction Size: 1 Byte
+     * Bytes: 3
      */
-    u_int16_t reg_de = make_register_pair_from(chip->reg_d, chip->reg_e);
-    chip->reg_a = chip->memory[reg_de];
-    chip->reg_pc++;
+    write_memory(chip, make_register_pair_from(program_data[2], program_data[1]), chip->reg_a);
+    chip->reg_pc += 3;
 }
 
-void dcx_d(Chip8080 * chip) {
-    /* [0x0b] DE = DE - 1
+static inline void exec_lda_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0x3a] LDA addr: A <- (addr)
      * Flags: None
-     * BYTES: 1
+     * Bytes: 3
      */
-    u_int16_t reg_de = make_register_pair_from(chip->reg_d, chip->reg_e);
-    reg_de--;
-    chip->reg_d = get_register_pair_h(reg_de);
-    chip->reg_e = get_register_pair_l(reg_de);
-    chip->reg_pc++;
+    chip->reg_a = read_memory(chip, make_register_pair_from(program_data[2], program_data[1]));
+    chip->reg_pc += 3;
 }
 
-void inr_e(Chip8080 *chip) {
-    /* [0x1c] INR E; E <- E+1
-     * Flags: Z, S, P, AC
-     * BYTES: 1
-    */
-
-    chip->reg_e++;
-    chip->flags.z = is_zero(chip->reg_e);
-    chip->flags.s = has_sign(chip->reg_e);
-    chip->flags.p = has_parity(chip->reg_e, 8);
-    chip->flags.ac = has_ac(chip->reg_e);
+static inline void exec_hlt(Chip8080 *chip) {
+    /* [0x76] HLT: stop until an interrupt; PC points past the HLT, so
+     * that is where the interrupt returns to
+     * Flags: None
+     * Bytes: 1
+     */
+    chip->halted = 1;
     chip->reg_pc++;
 }
 
-void dcr_e(Chip8080 *chip) {
-    /* [0x1d] DCR E; E <- E-1
-     * Flags: Z, S, P, AC
-     * BYTES: 1
+static inline void exec_ana_m(Chip8080 *chip) {
+    /* [0xa6] ANA M: A <- A & (HL)
+     * Flags: Z, S, P, CY, AC
+     * Bytes: 1
      */
-    chip->reg_e--;
-    chip->flags.z = is_zero(chip->reg_e);
-    chip->flags.s = has_sign(chip->reg_e);
-    chip->flags.p = has_parity(chip->reg_e, 8);
-    chip->flags.ac = has_ac(chip->reg_e);
-    chip->reg_pc++;
+    ana(chip, read_memory(chip, make_register_pair_from(chip->reg_h, chip->reg_l)));
 }
 
-void mvi_e_d8(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x1e] MVI E,D8; E <- byte 2
-     * Flags: None
-     * BYTES 2 */
-    chip->reg_e = program_data[1];
-    chip->reg_pc += 2;
+/*
+ *  Jumps and idle loop detection
+ */
+
+static void save_idle_state(const Chip8080 *chip, u_int8_t *state) {
+    state[0] = chip->reg_a;
+    state[1] = chip->reg_b;
+    state[2] = chip->reg_c;
+    state[3] = chip->reg_d;
+    state[4] = chip->reg_e;
+    state[5] = chip->reg_h;
+    state[6] = chip->reg_l;
+    state[7] = chip->reg_sp >> 8;
+    state[8] = chip->reg_sp;
+    state[9] = (chip->flags.s << 4) | (chip->flags.z << 3) | (chip->flags.ac << 2)
+               | (chip->flags.p << 1) | chip->flags.cy;
+}
+
+static int is_read_only(const Chip8080 *chip, u_int16_t address) {
+    /* Whether the instruction at address leaves memory, ports and the
+     * interrupt enable alone; IN and OUT count when the port is a plain
+     * latch, which nothing changes during a run8080_until() call */
+    u_int8_t opcode = chip->memory[address];
+    u_int8_t port = chip->memory[(u_int16_t) (address + 1)];
+    switch (opcode) {
+        case 0x02: case 0x12: case 0x22: case 0x32: // STAX B, STAX D, SHLD, STA
+        case 0x34: case 0x35: case 0x36:            // INR M, DCR M, MVI M
+        case 0x70: case 0x71: case 0x72: case 0x73: // MOV M,r
+        case 0x74: case 0x75: case 0x77:
+        case 0xf3: case 0xfb:                       // DI, EI
+            return 0;
+        case 0xd3: return chip->port_out[port] == NULL;
+        case 0xdb: return chip->port_in[port] == NULL;
+        default: return implemented_opcodes[opcode];
+    }
 }
 
-void rar(Chip8080 *chip) {
-    /* [0x1f] RAR; A = A >> 1; bit 7 = prev bit 7; CY = prev bit 0
-     * Flags: CY
-     * Instruction Size: 1 Byte
-     */
+static void detect_idle_loop(Chip8080 *chip, u_int16_t target) {
+    /* Called as the jump at reg_pc goes back to target. Between two
+     * takes of the same jump with no other backward jump or interrupt,
+     * only [target, reg_pc] can have run, as the core has no calls or
+     * returns; if none of it writes and the registers came round the
+     * same, every further iteration is the same too */
+    IdleLoop *idle = &chip->idle;
+    u_int8_t state[sizeof(idle->state)];
 
-    //TODO: Implement
+    if (chip->reg_pc - target > IDLE_LOOP_MAX_BYTES) {
+        idle->branch = NO_BRANCH;
+        return;
+    }
+    save_idle_state(chip, state);
+    if (idle->branch == chip->reg_pc && memcmp(idle->state, state, sizeof(state)) == 0) {
+        int read_only = 1;
+        for (int pc = target; pc <= chip->reg_pc && read_only; pc += opcode_table[chip->memory[pc]].size)
+            read_only = is_read_only(chip, pc);
+        if (read_only)
+            idle->period = chip->cycles - idle->cycles;
+    }
+    idle->branch = chip->reg_pc;
+    idle->cycles = chip->cycles;
+    memcpy(idle->state, state, sizeof(state));
 }
 
-void lxi_h_d16(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x01] LXI H,D16; h <- byte 3, L <- byte 2;
-     * Flags: None,
-     * Instruction Size: 3 BYTES
-     */
-    chip->reg_h = program_data[2];
-    chip->reg_l = program_data[1];
-    chip->reg_pc += 3;
+static inline void jump_if(Chip8080 *chip, unsigned char *program_data, int condition) {
+    u_int16_t target = make_register_pair_from(program_data[2], program_data[1]);
+    if (!condition) {
+        chip->reg_pc += 3;
+        return;
+    }
+    if (target <= chip->reg_pc && chip->idle.enabled)
+        detect_idle_loop(chip, target);
+    chip->reg_pc = target;
 }
 
-void shld_addr(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x22] SHLD addr; (addr) <- L; (addr + 1) <- H
+static inline void exec_jnz_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xc2] JNZ addr: if !Z, PC <- addr
      * Flags: None
-     * Instruction Size: 3 Bytes
+     * Bytes: 3
      */
-    chip->memory[make_register_pair_from(program_data[2], program_data[1])] = chip->reg_l;
-    chip->memory[make_register_pair_from(program_data[2], program_data[1])+1] = chip->reg_h;
-    chip->reg_pc += 3;
+    jump_if(chip, program_data, !chip->flags.z);
 }
 
-void inx_h(Chip8080 *chip) {
-    /* [0x23] INX H; HL <- HL + 1
+static inline void exec_jmp_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xc3] JMP addr: PC <- addr
      * Flags: None
-     * Instruction Size: 1 Byte
+     * Bytes: 3
      */
-    u_int16_t reg_hl = make_register_pair_from(chip->reg_h, chip->reg_l);
-    reg_hl++;
-    chip->reg_h = get_register_pair_h(reg_hl);
-    chip->reg_l = get_register_pair_l(reg_hl);
-    chip->reg_pc++;
+    jump_if(chip, program_data, 1);
 }
 
-void inr_h(Chip8080 *chip) {
-    /* [0x24] INR H: H <- H+1
-     * Flags: Z, S, P, AC
-     * Instruction Size: 1 Byte
+static inline void exec_jz_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xca] JZ addr: if Z, PC <- addr
+     * Flags: None
+     * Bytes: 3
      */
-    chip->reg_h++;
-    chip->flags.z = is_zero(chip->reg_h);
-    chip->flags.s = has_sign(chip->reg_h);
-    chip->flags.p = has_parity(chip->reg_h, 8);
-    chip->flags.ac = has_ac(chip->reg_h);
-    chip->reg_pc++;
+    jump_if(chip, program_data, chip->flags.z);
 }
 
-void dcr_h(Chip8080 *chip) {
-    /* [0x25] DCR H: H <- H-1  
-     * Flags: Z, S, P, AC 
-     * Instruction Size: 1 Byte
+static inline void exec_jnc_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xd2] JNC addr: if !CY, PC <- addr
+     * Flags: None
+     * Bytes: 3
      */
-    chip->reg_h--;
-    chip->flags.z = is_zero(chip->reg_h);
-    chip->flags.s = has_sign(chip->reg_h);
-    chip->flags.p = has_parity(chip->reg_h, 8);
-    chip->flags.ac = has_ac(chip->reg_h);
-    chip->reg_pc++;
+    jump_if(chip, program_data, !chip->flags.cy);
 }
 
-void mvi_h_d8(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x26] MVI H,D8; B <- byte 2
+static inline void exec_jc_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xda] JC addr: if CY, PC <- addr
      * Flags: None
-     * BYTES 2 */
-    chip->reg_h = program_data[1];
-    chip->reg_pc += 2;
-}
-
-void daa(Chip8080 *chip) {
-    /* [0x27] 1 Byte */
-    // TODO: Implement
-}
-
-void dad_h(Chip8080 *chip) {
-    /* [0x29] DAD H; HL = HL + HL
-     * Flags: CY
-     * BYTES = 1
+     * Bytes: 3
      */
-    u_int32_t hl = make_register_pair_from(chip->reg_h, chip->reg_l);
-    u_int32_t res = 2 * hl;
-    chip->reg_h = get_register_pair_h(res);
-    chip->reg_l = get_register_pair_l(res);
-    chip->flags.cy = ((res & 0xffff0000) > 0);
-    chip->reg_pc++;
+    jump_if(chip, program_data, chip->flags.cy);
 }
 
-void lhld_adr(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x2a] LHLD addr; L <- (addr), H <- (addr+1)
+static inline void exec_jpo_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xe2] JPO addr: if !P, PC <- addr
      * Flags: None
      * Bytes: 3
      */
-    chip->reg_l = chip->memory[make_register_pair_from(program_data[2], program_data[1])];
-    chip->reg_h = chip->memory[make_register_pair_from(program_data[2], program_data[1]) + 1];
-    chip->reg_pc += 3;
+    jump_if(chip, program_data, !chip->flags.p);
 }
 
-void dcx_h(Chip8080 *chip) {
-    /* [0x2b] DCX H: HL <- HL - 1
+static inline void exec_jpe_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xea] JPE addr: if P, PC <- addr
      * Flags: None
-     * Bytes: 1*/
-    u_int16_t hl = make_register_pair_from(chip->reg_h, chip->reg_l);
-    hl--;
-    chip->reg_h = get_register_pair_h(hl);
-    chip->reg_l = get_register_pair_l(hl);
-    chip->reg_pc++;
+     * Bytes: 3
+     */
+    jump_if(chip, program_data, chip->flags.p);
 }
 
-void inr_l(Chip8080 *chip) {
-    /* [0x2c] INR L: L <- L + 1
-     * Flags: Z, S, P, AC
-     * Bytes: 1
+static inline void exec_jp_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xf2] JP addr: if !S, PC <- addr
+     * Flags: None
+     * Bytes: 3
      */
-    chip->reg_l++;
-    chip->flags.z = is_zero(chip->reg_l);
-    chip->flags.s =  has_sign(chip->reg_l);
-    chip->flags.p = has_parity(chip->reg_l, 8);
-    chip->flags.ac = has_ac(chip->reg_l);
-    chip->reg_pc++;
+    jump_if(chip, program_data, !chip->flags.s);
 }
 
-void dcr_l(Chip8080 *chip) {
-    /* [0x2d] DCR L: L <- L-1
-     * Flags: Z, S, P, AC
-     * Bytes: 1
+static inline void exec_jm_adr(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xfa] JM addr: if S, PC <- addr
+     * Flags: None
+     * Bytes: 3
      */
-    chip->reg_l--;
-    chip->flags.z = is_zero(chip->reg_l);
-    chip->flags.s = has_sign(chip->reg_l);
-    chip->flags.p = has_parity(chip->reg_l, 8);
-    chip->flags.ac = has_ac(chip->reg_l);
-    chip->reg_pc++;
+    jump_if(chip, program_data, chip->flags.s);
 }
 
-void mvi_l_d8(Chip8080 *chip, unsigned char *program_data) {
-    /* [0x2e] MVI L, D8: L <- Byte 2 of program_data 
-     * Flags: None 
-     * Byte: 2
+static inline void exec_cpi_d8(Chip8080 *chip, unsigned char *program_data) {
+    /* [0xfe] CPI D8: A - byte 2, A unchanged
+     * Flags: Z, S, P, CY, AC
+     * Bytes: 2
      */
-    chip->reg_l = program_data[1];
+    u_int8_t value = program_data[1];
+    u_int8_t res = chip->reg_a - value;
+    chip->flags.z = is_zero(res);
+    chip->flags.s = has_sign(res);
+    chip->flags.p = has_parity(res, 8);
+    chip->flags.cy = chip->reg_a < value;
+    // Subtraction adds the complement; AC is its carry out of bit 3
+    chip->flags.ac = (chip->reg_a & 0x0f) + (~value & 0x0f) + 1 > 0x0f;
     chip->reg_pc += 2;
 }
 
-void cma(Chip8080 *chip) {
-    /* [0x2f] CMA: A <- !A,
-     * Flags: None,
-     * Bytes: 1
-     */
-    chip->reg_a = ~chip->reg_a; 
-    chip->reg_pc++;
+/*
+ *  Dispatch
+ */
+
+/* The opcodes of each register-specialized family, by operand code */
+#define REGISTER_OPCODES(r, field, code) \
+    [0x04 | (code) << 3] = 1, [0x05 | (code) << 3] = 1, [0x06 | (code) << 3] = 1, [0xa0 | (code)] = 1,
+#define PAIR_OPCODES(rp, high, low, code) \
+    [0x01 | (code) << 4] = 1, [0x03 | (code) << 4] = 1, [0x09 | (code) << 4] = 1, [0x0b | (code) << 4] = 1,
+
+#define REGISTER_CASES(r, field, code) \
+        case 0x04 | (code) << 3: exec_inr_##r(chip); break; \
+        case 0x05 | (code) << 3: exec_dcr_##r(chip); break; \
+        case 0x06 | (code) << 3: exec_mvi_##r##_d8(chip, program_data); break; \
+        case 0xa0 | (code): exec_ana_##r(chip); break;
+#define PAIR_CASES(rp, high, low, code) \
+        case 0x01 | (code) << 4: exec_lxi_##rp##_d16(chip, program_data); break; \
+        case 0x03 | (code) << 4: exec_inx_##rp(chip); break; \
+        case 0x09 | (code) << 4: exec_dad_##rp(chip); break; \
+        case 0x0b | (code) << 4: exec_dcx_##rp(chip); break;
+
+/* 1 for the opcodes run8080 implements; it returns RUN_UNIMPLEMENTED
+ * for the others. Keep in step with the switch below */
+const u_int8_t implemented_opcodes[256] = {
+    FOR_EACH_REGISTER(REGISTER_OPCODES)
+    FOR_EACH_PAIR(PAIR_OPCODES)
+    [0x00] = 1, [0x02] = 1, [0x08] = 1, [0x0a] = 1, [0x10] = 1, [0x12] = 1, [0x18] = 1, [0x1a] = 1,
+    [0x20] = 1, [0x22] = 1, [0x28] = 1, [0x2a] = 1, [0x2f] = 1,
+    [0x32] = 1, [0x3a] = 1, [0x76] = 1, [0xa6] = 1, [0xa7] = 1,
+    [0xc2] = 1, [0xc3] = 1, [0xca] = 1, [0xcb] = 1, [0xd2] = 1, [0xd3] = 1, [0xda] = 1, [0xdb] = 1,
+    [0xe2] = 1, [0xea] = 1, [0xf2] = 1, [0xf3] = 1, [0xfa] = 1, [0xfb] = 1, [0xfe] = 1,
+};
+
+RunStatus run8080(Chip8080 *chip) {
+    unsigned char *program_data = &chip->memory[chip->reg_pc];
+    unsigned char wrapped[3];
+    u_int8_t opcode = *program_data;
+    u_int16_t pc = chip->reg_pc;
+
+    if (chip->halted) {
+        // A halted 8080 keeps idling through machine cycles until interrupted
+        chip->cycles += 4;
+        return is_parked(chip) ? RUN_HALTED : RUN_OK;
+    }
+    if (chip->reg_pc > MAX_MEMORY - 3) {
+        // Operands of an instruction at the top of memory wrap to 0x0000
+        for (int i = 0; i < 3; i++)
+            wrapped[i] = chip->memory[(u_int16_t) (chip->reg_pc + i)];
+        program_data = wrapped;
+    }
+
+    switch(opcode) {
+        FOR_EACH_REGISTER(REGISTER_CASES)
+        FOR_EACH_PAIR(PAIR_CASES)
+        case 0x00: exec_nop(chip); break;
+        case 0x02: exec_stax_b(chip); break;
+        case 0x07: return RUN_UNIMPLEMENTED; // rlc(chip)
+        case 0x08: exec_nop(chip); break;
+        case 0x0a: exec_ldax_b(chip); break;
+        case 0x0f: return RUN_UNIMPLEMENTED; // rrc(chip)
+        case 0x10: exec_nop(chip); break;
+        case 0x12: exec_stax_d(chip); break;
+        case 0x17: return RUN_UNIMPLEMENTED; // ral(chip)
+        case 0x18: exec_nop(chip); break;
+        case 0x1a: exec_ldax_d(chip); break;
+        case 0x1f: return RUN_UNIMPLEMENTED; // rar(chip)
+        case 0x20: exec_nop(chip); break;
+        case 0x22: exec_shld_addr(chip, program_data); break;
+        case 0x27: return RUN_UNIMPLEMENTED; // daa(chip)
+        case 0x28: exec_nop(chip); break;
+        case 0x2a: exec_lhld_adr(chip, program_data); break;
+        case 0x2f: exec_cma(chip); break;
+        case 0x32: exec_sta_adr(chip, program_data); break;
+        case 0x3a: exec_lda_adr(chip, program_data); break;
+        case 0x76: exec_hlt(chip); break;
+        case 0xa6: exec_ana_m(chip); break;
+        case 0xa7: exec_ana_a(chip); break;
+        case 0xc2: exec_jnz_adr(chip, program_data); break;
+        case 0xc3: exec_jmp_adr(chip, program_data); break;
+        case 0xca: exec_jz_adr(chip, program_data); break;
+        case 0xcb: exec_jmp_adr(chip, program_data); break;
+        case 0xd2: exec_jnc_adr(chip, program_data); break;
+        case 0xd3: exec_out_d8(chip, program_data); break;
+        case 0xda: exec_jc_adr(chip, program_data); break;
+        case 0xdb: exec_in_d8(chip, program_data); break;
+        case 0xe2: exec_jpo_adr(chip, program_data); break;
+        case 0xea: exec_jpe_adr(chip, program_data); break;
+        case 0xf2: exec_jp_adr(chip, program_data); break;
+        case 0xf3: exec_di(chip); break;
+        case 0xfa: exec_jm_adr(chip, program_data); break;
+        case 0xfb: exec_ei(chip); break;
+        case 0xfe: exec_cpi_d8(chip, program_data); break;
+        default: return RUN_UNIMPLEMENTED;
+    }
+    COUNT_ACCESS(chip, executes, pc);
+    chip->cycles += opcode_cycles[opcode];
+    return RUN_OK;
 }
+
+/*
+ *  Public per-instruction API
+ *
+ *  run8080() calls the static inline handlers above, so an instruction
+ *  costs no call; these thin wrappers keep each one callable on its own.
+ */
+
+#define WRAP(name) void name(Chip8080 *chip) { exec_##name(chip); }
+#define WRAP_DATA(name) \
+    void name(Chip8080 *chip, unsigned char *program_data) { exec_##name(chip, program_data); }
+#define WRAP_REGISTER(r, field, code) WRAP(inr_##r) WRAP(dcr_##r) WRAP_DATA(mvi_##r##_d8) WRAP(ana_##r)
+#define WRAP_PAIR(rp, high, low, code) WRAP_DATA(lxi_##rp##_d16) WRAP(inx_##rp) WRAP(dad_##rp) WRAP(dcx_##rp)
+
+FOR_EACH_REGISTER(WRAP_REGISTER)
+FOR_EACH_PAIR(WRAP_PAIR)
+WRAP(ana_a)
+WRAP(nop) WRAP(stax_b) WRAP(ldax_b) WRAP(stax_d) WRAP(ldax_d) WRAP(cma) WRAP(di) WRAP(ei)
+WRAP(hlt) WRAP(ana_m)
+WRAP_DATA(shld_addr) WRAP_DATA(lhld_adr) WRAP_DATA(out_d8) WRAP_DATA(in_d8)
+WRAP_DATA(sta_adr) WRAP_DATA(lda_adr) WRAP_DATA(jnz_adr) WRAP_DATA(jmp_adr)
+WRAP_DATA(jz_adr) WRAP_DATA(jnc_adr) WRAP_DATA(jc_adr) WRAP_DATA(jpo_adr)
+WRAP_DATA(jpe_adr) WRAP_DATA(jp_adr) WRAP_DATA(jm_adr) WRAP_DATA(cpi_d8)
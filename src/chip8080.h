@@ -1,6 +1,17 @@
+#ifndef CHIP8080_H
+#define CHIP8080_H
+
+#include <stddef.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
-#define MAX_MEMORY 0xffff
+#define MAX_MEMORY 0x10000
+/* Writes mark the 32 byte block they land in; dirty has one bit per block */
+#define DIRTY_BLOCK_SHIFT 5
+#define DIRTY_BYTES (MAX_MEMORY >> DIRTY_BLOCK_SHIFT >> 3)
+/* Watchpoints are looked up only on writes to a 256 byte page holding one */
+#define WATCH_PAGE_SHIFT 8
+#define WATCH_PAGE_BYTES (MAX_MEMORY >> WATCH_PAGE_SHIFT >> 3)
 
 typedef struct Flags {
     u_int8_t z:1;
@@ -11,23 +22,150 @@ typedef struct Flags {
     u_int8_t pad:3;
 } Flags;
 
+/* A backward jump taken twice in a row with the same registers, and
+ * nothing but reads in between, is a loop polling memory that only an
+ * interrupt can change; IDLE_LOOP_MAX_BYTES bounds the body checked */
+#define IDLE_LOOP_MAX_BYTES 32
+#define NO_BRANCH 0x10000
+
+typedef struct IdleLoop {
+    u_int8_t enabled;
+    u_int32_t branch;           // Address of the backward jump last taken, or NO_BRANCH
+    u_int64_t cycles;           // Cycle count when it was taken
+    u_int8_t state[10];         // A, B, C, D, E, H, L, SP and flags at that point
+    u_int64_t period;           // Cycles per iteration once proven idle, else 0
+    u_int64_t skipped;          // Cycles credited without being run
+} IdleLoop;
+
+/* Breakpoints and watchpoints of a debugger attached to a chip, one bit
+ * per address; see debugger.c. The core only looks at them while one
+ * is attached, and at watchpoints when a write lands on a watched page */
+typedef struct Debugger {
+    u_int8_t breakpoints[MAX_MEMORY / 8];
+    u_int8_t watchpoints[MAX_MEMORY / 8];
+    u_int32_t resume_pc;        // Breakpoint to run over once when resuming, or NO_BRANCH
+    u_int8_t watch_hit;         // A watched address was written since the last stop
+    u_int16_t watch_address;    // The first one
+} Debugger;
+
+/* Accesses per address, counted only in builds with -DHEATMAP: reads
+ * and writes by instructions, and executes of the opcode byte of each
+ * instruction run. Without it the counting compiles to nothing and the
+ * chip has no heatmap; see heatmap.c */
+typedef struct Heatmap {
+    u_int64_t reads[MAX_MEMORY];
+    u_int64_t writes[MAX_MEMORY];
+    u_int64_t executes[MAX_MEMORY];
+} Heatmap;
+
+#ifdef HEATMAP
+#define COUNT_ACCESS(chip, kind, address) ((chip)->heat->kind[(u_int16_t) (address)]++)
+#else
+#define COUNT_ACCESS(chip, kind, address) ((void) (address))
+#endif
+
+struct Chip8080;
+
+/* Why run8080() or a batched run loop returned. Nothing is executed on
+ * RUN_UNIMPLEMENTED and RUN_BREAKPOINT, so reg_pc is the faulting
+ * instruction and what to do about it is up to the host */
+typedef enum RunStatus {
+    RUN_OK,                     // The instruction ran
+    RUN_UNIMPLEMENTED,          // The opcode at reg_pc is not in the core
+    RUN_HALTED,                 // Halted with interrupts off, see is_parked()
+    RUN_BREAKPOINT,             // Stopped before an instruction with a breakpoint
+    RUN_WATCHPOINT,             // Stopped after a write to a watched address
+    RUN_BUDGET,                 // The cycle deadline was reached
+} RunStatus;
+
+/* I/O port handlers; a port without one reads its in_ports latch */
+typedef u_int8_t (*PortIn)(struct Chip8080*, u_int8_t);
+typedef void (*PortOut)(struct Chip8080*, u_int8_t, u_int8_t);
+
+/* Machines are allocated on cache line boundaries and span whole lines,
+ * so the first line holds the state every instruction touches and
+ * machines run side by side share none */
+#define CACHE_LINE_SIZE 64
+
 typedef struct Chip8080 {
-    u_int8_t reg_a;
-    u_int8_t reg_b;
-    u_int8_t reg_c;
-    u_int8_t reg_d;
-    u_int8_t reg_e;
-    u_int8_t reg_h;
-    u_int8_t reg_l;
-    u_int16_t reg_sp;
-    u_int16_t reg_pc;
-    u_int8_t *memory;
-    struct Flags flags;
-    u_int8_t irq_enable;
+    /* Hot: registers, flags and memory base, in one cache line */
+    struct {
+        u_int8_t *memory;
+        u_int64_t cycles;           // Clock cycles executed since reset
+        Debugger *debug;            // Attached debugger, or NULL
+        u_int16_t reg_sp;
+        u_int16_t reg_pc;
+        u_int8_t reg_a;
+        struct Flags flags;
+        u_int8_t reg_b;
+        u_int8_t reg_c;
+        u_int8_t reg_d;
+        u_int8_t reg_e;
+        u_int8_t reg_h;
+        u_int8_t reg_l;
+        u_int8_t irq_enable;
+        u_int8_t halted;            // Set by HLT, cleared by the next interrupt
+    } __attribute__((aligned(CACHE_LINE_SIZE)));
+    /* Warm: touched by stores and backward jumps */
+    IdleLoop idle;
+    u_int8_t dirty[DIRTY_BYTES];
+    u_int8_t watched_pages[WATCH_PAGE_BYTES];
+#ifdef HEATMAP
+    Heatmap *heat;
+#endif
+    /* Cold: I/O, only reached through IN and OUT */
+    struct {
+        u_int8_t in_ports[256];     // Value read by IN when the port has no handler
+        u_int8_t out_ports[256];    // Last value written by OUT
+        PortIn port_in[256];
+        PortOut port_out[256];
+        void *machine;              // Owner of the handlers, e.g. an Invaders
+    } __attribute__((aligned(CACHE_LINE_SIZE)));
 } Chip8080;
 
+_Static_assert(offsetof(Chip8080, idle) <= CACHE_LINE_SIZE, "hot Chip8080 state spans cache lines");
+
+void hit_watched_page(Chip8080*, u_int16_t);
+
+static inline u_int8_t read_memory(Chip8080 *chip, u_int16_t address) {
+    COUNT_ACCESS(chip, reads, address);
+    return chip->memory[address];
+}
+
+static inline void write_memory(Chip8080 *chip, u_int16_t address, u_int8_t value) {
+    u_int16_t block = address >> DIRTY_BLOCK_SHIFT;
+    u_int16_t page = address >> WATCH_PAGE_SHIFT;
+    COUNT_ACCESS(chip, writes, address);
+    chip->memory[address] = value;
+    chip->dirty[block >> 3] |= 1 << (block & 7);
+    if (chip->watched_pages[page >> 3] & (1 << (page & 7)))
+        hit_watched_page(chip, address);
+}
+
+static inline int is_parked(const Chip8080 *chip) {
+    /* Halted with interrupts off, nothing but a reset wakes the chip */
+    return chip->halted && !chip->irq_enable;
+}
+
+static inline u_int8_t read_port(Chip8080 *chip, u_int8_t port) {
+    PortIn handler = chip->port_in[port];
+    return handler ? handler(chip, port) : chip->in_ports[port];
+}
+
+static inline void write_port(Chip8080 *chip, u_int8_t port, u_int8_t value) {
+    PortOut handler = chip->port_out[port];
+    chip->out_ports[port] = value;
+    if (handler)
+        handler(chip, port, value);
+}
+
+extern const u_int8_t opcode_cycles[256];
+extern const u_int8_t implemented_opcodes[256];
+
 Chip8080* make_chip8080();
 void reset_chip_state(Chip8080*);
+size_t load_memory(Chip8080*, const unsigned char*, size_t, u_int16_t);
+void set_port_handlers(Chip8080*, u_int8_t, PortIn, PortOut);
 u_int8_t* _make_memory_bank();
 void _clean_memory_bank(u_int8_t*);
 u_int16_t make_register_pair_from(u_int8_t, u_int8_t);
@@ -37,50 +175,72 @@ int is_zero(u_int8_t);
 int has_sign_(u_int8_t);
 int has_parity(int, int);
 int is_multiple_of_8(u_int8_t);
-int has_ac(u_int8_t);
+int has_ac_inr(u_int8_t);
+int has_ac_dcr(u_int8_t);
 void destroy_chip8080(Chip8080*);
-int run8080(Chip8080*);
+RunStatus run8080(Chip8080*);
+RunStatus run8080_until(Chip8080*, u_int64_t);
+int generate_interrupt(Chip8080*, u_int8_t);
+
+/*
+ *  Register-specialized instruction families
+ *
+ *  X(name, field, code) for the register operands of INR, DCR, MVI and
+ *  ANA, and X(name, high, low, code) for the pairs of LXI, INX, DCX and
+ *  DAD, where code is the operand field of the opcode. chip8080.c expands
+ *  them into the handlers, their run8080() cases and implemented_opcodes.
+ */
+#define FOR_EACH_REGISTER(X) \
+    X(b, reg_b, 0) X(c, reg_c, 1) X(d, reg_d, 2) X(e, reg_e, 3) X(h, reg_h, 4) X(l, reg_l, 5)
+#define FOR_EACH_PAIR(X) \
+    X(b, reg_b, reg_c, 0) X(d, reg_d, reg_e, 1) X(h, reg_h, reg_l, 2)
+
+#define DECLARE_REGISTER_HANDLERS(r, field, code) \
+    void inr_##r(Chip8080*); \
+    void dcr_##r(Chip8080*); \
+    void mvi_##r##_d8(Chip8080*, unsigned char*); \
+    void ana_##r(Chip8080*);
+#define DECLARE_PAIR_HANDLERS(rp, high, low, code) \
+    void lxi_##rp##_d16(Chip8080*, unsigned char*); \
+    void inx_##rp(Chip8080*); \
+    void dad_##rp(Chip8080*); \
+    void dcx_##rp(Chip8080*);
+
+FOR_EACH_REGISTER(DECLARE_REGISTER_HANDLERS)
+FOR_EACH_PAIR(DECLARE_PAIR_HANDLERS)
+
 void nop(Chip8080*); // 0x00
-void lxi_b_d16(Chip8080*, unsigned char*); // 0x01
 void stax_b(Chip8080*); // 0x02
-void inx_b(Chip8080*); // 0x03
-void inr_b(Chip8080*); // 0x04
-void dcr_b(Chip8080*); // 0x05
-void mvi_b_d8(Chip8080*, unsigned char*); // 0x06
 void rlc(Chip8080*); // 0x07
-void dad_b(Chip8080*); // 0x09
 void ldax_b(Chip8080 *); // 0x0a
-void dcx_b(Chip8080*); // 0x0b
-void inr_c(Chip8080*); // 0x0c
-void dcr_c(Chip8080*); // 0x0d
-void mvi_c_d8(Chip8080*, unsigned char*); // 0x0e
 void rrc(Chip8080*); // 0x0f
-void lxi_d_d16(Chip8080*, unsigned char*); // 0x11
 void stax_d(Chip8080*); // 0x12
-void inx_d(Chip8080*); // 0x13
-void inr_d(Chip8080*); // 0x14
-void dcr_d(Chip8080*); // 0x15
-void mvi_d_d8(Chip8080*, unsigned char*); // 0x16
 void ral(Chip8080*); // 0x17
-void dad_d(Chip8080*); // 0x19
 void ldax_d(Chip8080*); // 0x1a
-void dcx_d(Chip8080*); // 0x1b
-void inr_e(Chip8080*); // 0x1c
-void dcr_e(Chip8080*); // 0x1d
-void mvi_e_d8(Chip8080*, unsigned char*); // 0x1e
 void rar(Chip8080*); // 0x1f
-void lxi_h_d16(Chip8080*, unsigned char*); // 0x21
 void shld_addr(Chip8080*, unsigned char*); // 0x22
-void inx_h(Chip8080*); // 0x23
-void inr_h(Chip8080*); // 0x24
-void dcr_h(Chip8080*); // 0x25
-void mvi_h_d8(Chip8080*, unsigned char*); // 0x26
 void daa(Chip8080*); // 0x27
-void dad_h(Chip8080*); // 0x29
 void lhld_adr(Chip8080*, unsigned char*); // 0x2a
-void dcx_h(Chip8080*); // 0x2b
-void inr_l(Chip8080*); // 0x2c
-void dcr_l(Chip8080*); // 0x2d
-void mvi_l_d8(Chip8080*, unsigned char*); // 0x2e
 void cma(Chip8080*); // 0x2f
+void sta_adr(Chip8080*, unsigned char*); // 0x32
+void lda_adr(Chip8080*, unsigned char*); // 0x3a
+void hlt(Chip8080*); // 0x76
+void ana_m(Chip8080*); // 0xa6
+void ana_a(Chip8080*); // 0xa7
+void jnz_adr(Chip8080*, unsigned char*); // 0xc2
+void jmp_adr(Chip8080*, unsigned char*); // 0xc3
+void jz_adr(Chip8080*, unsigned char*); // 0xca
+void jnc_adr(Chip8080*, unsigned char*); // 0xd2
+void out_d8(Chip8080*, unsigned char*); // 0xd3
+void jc_adr(Chip8080*, unsigned char*); // 0xda
+void in_d8(Chip8080*, unsigned char*); // 0xdb
+void jpo_adr(Chip8080*, unsigned char*); // 0xe2
+void jpe_adr(Chip8080*, unsigned char*); // 0xea
+void jp_adr(Chip8080*, unsigned char*); // 0xf2
+void di(Chip8080*); // 0xf3
+void jm_adr(Chip8080*, unsigned char*); // 0xfa
+void ei(Chip8080*); // 0xfb
+void cpi_d8(Chip8080*, unsigned char*); // 0xfe
 void unimplementedInstruction(Chip8080*);
+
+#endif
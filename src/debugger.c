@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "flow.h"
+#include "debugger.h"
+
+/*
+ *  Breakpoints and watchpoints
+ *
+ *  Without a debugger the run loops never look at either. With one,
+ *  run8080_until() tests the breakpoint bitmap before each instruction,
+ *  and write_memory() only leaves its fast path on the pages marked in
+ *  chip->watched_pages.
+ */
+
+Debugger* attach_debugger(Chip8080 *chip) {
+    /* return the chip's debugger, attaching an empty one if it has none */
+    if (chip->debug == NULL) {
+        chip->debug = calloc(1, sizeof(Debugger));
+        chip->debug->resume_pc = NO_BRANCH;
+    }
+    return chip->debug;
+}
+
+void detach_debugger(Chip8080 *chip) {
+    free(chip->debug);
+    chip->debug = NULL;
+    memset(chip->watched_pages, 0, sizeof(chip->watched_pages));
+}
+
+void set_breakpoint(Chip8080 *chip, u_int16_t address) {
+    bitmap_set(attach_debugger(chip)->breakpoints, address);
+}
+
+void clear_breakpoint(Chip8080 *chip, u_int16_t address) {
+    if (chip->debug != NULL)
+        chip->debug->breakpoints[address >> 3] &= ~(1 << (address & 7));
+}
+
+void set_watchpoint(Chip8080 *chip, u_int16_t address) {
+    u_int16_t page = address >> WATCH_PAGE_SHIFT;
+    bitmap_set(attach_debugger(chip)->watchpoints, address);
+    bitmap_set(chip->watched_pages, page);
+}
+
+void clear_watchpoint(Chip8080 *chip, u_int16_t address) {
+    /* The page leaves the slow path with its last watchpoint */
+    u_int16_t page = address >> WATCH_PAGE_SHIFT;
+    const int page_bytes = (1 << WATCH_PAGE_SHIFT) / 8;
+    if (chip->debug == NULL)
+        return;
+    chip->debug->watchpoints[address >> 3] &= ~(1 << (address & 7));
+    for (int i = 0; i < page_bytes; i++)
+        if (chip->debug->watchpoints[page * page_bytes + i] != 0)
+            return;
+    chip->watched_pages[page >> 3] &= ~(1 << (page & 7));
+}
+
+int has_debug_points(const Chip8080 *chip) {
+    /* return 1 if the chip's debugger has a breakpoint or watchpoint */
+    if (chip->debug == NULL)
+        return 0;
+    for (int i = 0; i < MAX_MEMORY / 8; i++)
+        if (chip->debug->breakpoints[i] != 0 || chip->debug->watchpoints[i] != 0)
+            return 1;
+    return 0;
+}
+
+void resume_debugged(Chip8080 *chip) {
+    /* Lets the next run go on from a stop: the breakpoint at PC, if
+     * any, is run over once and the watchpoint hit is forgotten */
+    Debugger *debug = attach_debugger(chip);
+    debug->resume_pc = chip->reg_pc;
+    debug->watch_hit = 0;
+}
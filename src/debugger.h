@@ -0,0 +1,17 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+
+Debugger* attach_debugger(Chip8080*);
+void detach_debugger(Chip8080*);
+void set_breakpoint(Chip8080*, u_int16_t);
+void clear_breakpoint(Chip8080*, u_int16_t);
+void set_watchpoint(Chip8080*, u_int16_t);
+void clear_watchpoint(Chip8080*, u_int16_t);
+int has_debug_points(const Chip8080*);
+void resume_debugged(Chip8080*);
+
+#endif
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "tools.h"
+#include "reference8080.h"
+#include "difftest.h"
+
+/*
+ *  Differential testing
+ *
+ *  The core and the reference model run the same instruction stream in
+ *  lockstep. Registers, flags, cycles and the interrupt and halt state are
+ *  compared after every instruction, memory and the OUT latches by hash
+ *  every DIFF_HASH_INTERVAL instructions, and the run stops at the first
+ *  difference with a trace of the instructions leading to it.
+ */
+
+static u_int32_t next_random(u_int32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static int is_jump(u_int8_t op) {
+    return (op & 0xc7) == 0xc2 || op == 0xc3 || op == 0xcb;
+}
+
+void make_random_program(u_int8_t *memory, int size, u_int32_t *seed) {
+    /* Fills memory[0, size) with random core instructions. Jumps go to
+     * the start of one of them, other absolute addresses point at 0x2000
+     * and up, away from the program, and the rest of memory gets random
+     * data. HLT is left out as it would end the stream */
+    u_int16_t *starts = malloc(size * sizeof(u_int16_t));
+    int n_starts = 0;
+    int pc = 0;
+
+    for (int i = size; i < MAX_MEMORY; i++)
+        memory[i] = next_random(seed);
+    while (pc < size) {
+        u_int8_t op;
+        do
+            op = next_random(seed);
+        while (!implemented_opcodes[op] || op == 0x76);
+        int op_size = opcode_table[op].size;
+        if (pc + op_size > size) {
+            op = 0x00;
+            op_size = 1;
+        }
+        memory[pc] = op;
+        if (op_size > 1)
+            memory[pc + 1] = next_random(seed);
+        if (op_size > 2)
+            memory[pc + 2] = 0x20 + next_random(seed) % 0xe0;
+        starts[n_starts++] = pc;
+        pc += op_size;
+    }
+    for (int i = 0; i < n_starts; i++) {
+        if (!is_jump(memory[starts[i]]))
+            continue;
+        u_int16_t target = starts[next_random(seed) % n_starts];
+        memory[starts[i] + 1] = get_register_pair_l(target);
+        memory[starts[i] + 2] = get_register_pair_h(target);
+    }
+    free(starts);
+}
+
+void make_rom_program(u_int8_t *memory, const u_int8_t *rom, int size) {
+    /* Copies rom into memory with every instruction the core lacks
+     * turned into NOPs, so real instruction mixes and operands can be
+     * run without the control flow the core can't follow yet */
+    int pc = 0;
+
+    memcpy(memory, rom, size);
+    while (pc < size) {
+        int op_size = opcode_table[rom[pc]].size;
+        if (!implemented_opcodes[rom[pc]])
+            memset(&memory[pc], 0x00, pc + op_size > size ? size - pc : op_size);
+        pc += op_size;
+    }
+}
+
+static void reference_as_chip(const RefState *ref, Chip8080 *chip) {
+    /* Just the fields format_chip_state() prints */
+    chip->reg_a = ref->reg[REF_A];
+    chip->reg_b = ref->reg[REF_B];
+    chip->reg_c = ref->reg[REF_C];
+    chip->reg_d = ref->reg[REF_D];
+    chip->reg_e = ref->reg[REF_E];
+    chip->reg_h = ref->reg[REF_H];
+    chip->reg_l = ref->reg[REF_L];
+    chip->reg_sp = ref->sp;
+    chip->reg_pc = ref->pc;
+    chip->flags.z = ref->z;
+    chip->flags.s = ref->s;
+    chip->flags.p = ref->p;
+    chip->flags.cy = ref->cy;
+    chip->flags.ac = ref->ac;
+}
+
+static int registers_match(const Chip8080 *chip, const RefState *ref) {
+    return chip->reg_a == ref->reg[REF_A] && chip->reg_b == ref->reg[REF_B]
+        && chip->reg_c == ref->reg[REF_C] && chip->reg_d == ref->reg[REF_D]
+        && chip->reg_e == ref->reg[REF_E] && chip->reg_h == ref->reg[REF_H]
+        && chip->reg_l == ref->reg[REF_L] && chip->reg_sp == ref->sp
+        && chip->reg_pc == ref->pc && chip->flags.z == ref->z
+        && chip->flags.s == ref->s && chip->flags.p == ref->p
+        && chip->flags.cy == ref->cy && chip->flags.ac == ref->ac
+        && chip->irq_enable == ref->irq_enable && chip->halted == ref->halted
+        && chip->cycles == ref->cycles;
+}
+
+static u_int64_t hash_memory(const u_int8_t *memory, const u_int8_t *out_ports) {
+    u_int64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < MAX_MEMORY; i++)
+        hash = (hash ^ memory[i]) * 0x100000001b3ULL;
+    for (int i = 0; i < 256; i++)
+        hash = (hash ^ out_ports[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+static int memory_matches(const Chip8080 *chip, const RefState *ref) {
+    return hash_memory(chip->memory, chip->out_ports) == hash_memory(ref->memory, ref->out_ports);
+}
+
+static void write_report(const Chip8080 *chip, const RefState *ref, u_int64_t steps,
+                         char trace[][DIFF_TRACE_LINE_MAX], char *report) {
+    Chip8080 *as_chip = aligned_alloc(CACHE_LINE_SIZE, sizeof(Chip8080));
+    char *out = report;
+
+    out += sprintf(out, "divergence at instruction %llu; the last ones were:\n", (unsigned long long) steps);
+    u_int64_t first = steps >= DIFF_TRACE_LINES ? steps - DIFF_TRACE_LINES + 1 : 0;
+    for (u_int64_t i = first; i <= steps; i++)
+        out += sprintf(out, "%s", trace[i % DIFF_TRACE_LINES]);
+
+    out += sprintf(out, "core:      ");
+    out += format_chip_state(chip, out);
+    reference_as_chip(ref, as_chip);
+    out += sprintf(out, "reference: ");
+    out += format_chip_state(as_chip, out);
+    if (chip->cycles != ref->cycles || chip->irq_enable != ref->irq_enable || chip->halted != ref->halted)
+        out += sprintf(out, "cycles %llu/%llu, interrupts %s/%s, %s/%s (core/reference)\n",
+                       (unsigned long long) chip->cycles, (unsigned long long) ref->cycles,
+                       chip->irq_enable ? "on" : "off", ref->irq_enable ? "on" : "off",
+                       chip->halted ? "halted" : "running", ref->halted ? "halted" : "running");
+    for (int i = 0; i < MAX_MEMORY; i++) {
+        if (chip->memory[i] != ref->memory[i]) {
+            out += sprintf(out, "memory %04x: %02x/%02x (core/reference)\n", i, chip->memory[i], ref->memory[i]);
+            break;
+        }
+    }
+    for (int i = 0; i < 256; i++) {
+        if (chip->out_ports[i] != ref->out_ports[i]) {
+            out += sprintf(out, "out port %d: %02x/%02x (core/reference)\n", i, chip->out_ports[i], ref->out_ports[i]);
+            break;
+        }
+    }
+    *out = '\0';
+    free(as_chip);
+}
+
+DiffResult difftest(Chip8080 *chip, RefState *ref, u_int64_t max_steps, char *report) {
+    /* Copies the state of chip into ref and runs both for up to max_steps
+     * instructions, stopping early at an opcode the core lacks or once
+     * halted, as nothing interrupts the chip here. report
+     * (DIFF_REPORT_MAX bytes) gets the trace of a divergence, else "" */
+    char trace[DIFF_TRACE_LINES][DIFF_TRACE_LINE_MAX];
+    DiffResult result = {0, 0};
+    int len;
+
+    sync_reference(ref, chip);
+    report[0] = '\0';
+    for (; result.steps < max_steps; result.steps++) {
+        if (chip->halted || !implemented_opcodes[chip->memory[chip->reg_pc]])
+            break;
+
+        char *line = trace[result.steps % DIFF_TRACE_LINES];
+        format_instruction(chip->memory, chip->reg_pc, MAX_MEMORY, line, &len);
+        line[len - 1] = '\t';
+        len += format_chip_state(chip, line + len);
+        line[len] = '\0';
+
+        run8080(chip);
+        reference_step(ref);
+
+        int check_memory = (result.steps + 1) % DIFF_HASH_INTERVAL == 0 || result.steps + 1 == max_steps;
+        if (!registers_match(chip, ref) || (check_memory && !memory_matches(chip, ref))) {
+            result.diverged = 1;
+            write_report(chip, ref, result.steps, trace, report);
+            result.steps++;
+            return result;
+        }
+    }
+
+    if (result.steps > 0 && !memory_matches(chip, ref)) {
+        result.diverged = 1;
+        write_report(chip, ref, result.steps - 1, trace, report);
+    }
+    return result;
+}
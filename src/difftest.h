@@ -0,0 +1,28 @@
+#ifndef DIFFTEST_H
+#define DIFFTEST_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "tools.h"
+#include "reference8080.h"
+
+/* Instructions listed before a divergence */
+#define DIFF_TRACE_LINES 8
+/* Memory and port latches are hashed and compared this often */
+#define DIFF_HASH_INTERVAL 64
+/* Instructions per stream before starting a fresh one */
+#define DIFF_STREAM_STEPS 4096
+#define DIFF_TRACE_LINE_MAX (DISASM_LINE_MAX + CHIP_STATE_LINE_MAX)
+#define DIFF_REPORT_MAX ((DIFF_TRACE_LINES + 6) * DIFF_TRACE_LINE_MAX)
+
+typedef struct DiffResult {
+    u_int64_t steps;        // Instructions run in lockstep
+    int diverged;           // 1 if the last of them diverged
+} DiffResult;
+
+void make_random_program(u_int8_t*, int, u_int32_t*);
+void make_rom_program(u_int8_t*, const u_int8_t*, int);
+DiffResult difftest(Chip8080*, RefState*, u_int64_t, char*);
+
+#endif
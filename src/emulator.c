@@ -1,27 +1,724 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include "chip8080.h"
 #include "tools.h"
+#include "flow.h"
+#include "batch.h"
+#include "bench.h"
+#include "invaders.h"
+#include "video.h"
+#include "recorder.h"
+#include "movie.h"
+#include "pacing.h"
+#include "sound.h"
+#include "reference8080.h"
+#include "difftest.h"
+#include "recompile.h"
+#include "recompiled.h"
+#include "debugger.h"
+#include "gdbstub.h"
+#include "heatmap.h"
 
-int main(int argc, char** argv) {
-    FILE *f = fopen(argv[1], "rb");
-    if(f==NULL) {
-        printf("error: could not open %s\n", argv[1]);
-        exit(1);
-    }
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define MAX_DEBUG_POINTS 16
 
-    /* Get the file size and read it into a memory buffer */
-    fseek(f, 0L, SEEK_END);
-    int fsize = ftell(f);
-    fseek(f, 0L, SEEK_SET);
+static const char usage[] =
+    "usage: emulator <command> [options] <file|->\n"
+    "\n"
+    "commands:\n"
+    "  disasm [-f] [-j threads] file...  disassemble (-f follows the flow of control,\n"
+    "                                    -j disassembles many files in parallel)\n"
+    "  run [-m machine] [-n count] [-f frames [-p] [-o dir [-s n]] [-r capture]\n"
+    "      [-M movie] [-S sounds]] [-b addr] [-w addr] [-H dir] file\n"
+    "                                    load file at 0x0000 and run count instructions\n"
+    "                                    (-m invaders adds the Space Invaders board,\n"
+    "                                    which can also run a number of frames: at\n"
+    "                                    the real 60Hz with -p, else as fast as it\n"
+    "                                    can; -o writes one frame in n (default 1,\n"
+    "                                    0 for none) to dir/NNNNNN.pgm, -r records\n"
+    "                                    the video to a capture file, -M saves\n"
+    "                                    the run as a movie and -S logs the sound\n"
+    "                                    triggers, as JSON lines if sounds ends in\n"
+    "                                    .jsonl, else as 12 byte records; -b stops\n"
+    "                                    before the instruction at hex addr, -w after\n"
+    "                                    a write to it, up to 16 of each; -H writes\n"
+    "                                    memory access heatmaps and the busiest\n"
+    "                                    addresses to dir, in `make emulator_heatmap`\n"
+    "                                    builds)\n"
+    "  trace [-m machine] [-n count] file  like run, listing every instruction and the\n"
+    "                                    registers before it executes\n"
+    "  frames [-s first] [-n count] capture directory\n"
+    "                                    decode recorded frames to directory/NNNNNN.pgm\n"
+    "  replay movie                      replay a movie unpaced, listing the state hash\n"
+    "                                    of every frame; fails if it diverges\n"
+    "  difftest [-n count] [-s seed] [file]\n"
+    "                                    run count instructions on the core and on a\n"
+    "                                    reference 8080 in lockstep, from random\n"
+    "                                    programs or from file with the instructions\n"
+    "                                    the core lacks taken out\n"
+    "  recompile [-o out.c] file         translate a ROM to C, one function per basic\n"
+    "                                    block; `make emulator_recompiled` builds it\n"
+    "                                    in for the run command\n"
+    "  gdb [-m machine] [-l address] file\n"
+    "                                    load file like run and serve gdb's remote\n"
+    "                                    protocol on address, a Unix socket path or\n"
+    "                                    a localhost TCP port (default 1234)\n"
+    "  bench [file]                      run the benchmark suite\n"
+    "\n"
+    "a file of - reads standard input\n";
 
-    unsigned char *buffer = malloc(fsize);
-    fread(buffer, fsize, 1, f);
-    fclose(f);
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-    int pc = 0;
-    while(pc < fsize) {
-        pc += disassemble(buffer, pc);
+static int write_all(const char *buffer, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, buffer, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("error: write");
+            return -1;
+        }
+        buffer += n;
+        len -= n;
     }
     return 0;
 }
+
+static int disasm_stream(const Input *input, int follow_flow) {
+    /* Streams the listing of one input through a single large buffer */
+    char *out = malloc(OUTPUT_BUFFER_SIZE);
+    FlowMap *map = NULL;
+    int pc = 0;
+    int status = 0;
+
+    if (follow_flow) {
+        map = malloc(sizeof(FlowMap));
+        analyze_flow(input->data, input->size, default_entry_points, 9, map);
+    }
+
+    while (pc < (int) input->size && status == 0) {
+        size_t written = follow_flow
+            ? disassemble_flow(input->data, &pc, input->size, map, out, OUTPUT_BUFFER_SIZE)
+            : disassemble_range(input->data, &pc, input->size, out, OUTPUT_BUFFER_SIZE);
+        status = write_all(out, written);
+    }
+
+    free(map);
+    free(out);
+    return status;
+}
+
+static int cmd_disasm(int argc, char **argv) {
+    int follow_flow = 0;
+    int n_threads = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "fj:")) != -1) {
+        switch (opt) {
+            case 'f': follow_flow = 1; break;
+            case 'j': n_threads = atoi(optarg); break;
+            default: fputs(usage, stderr); return 2;
+        }
+    }
+    if (optind >= argc) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    int n_files = argc - optind;
+    if (n_files > 1 || n_threads > 0) {
+        if (follow_flow) {
+            fprintf(stderr, "error: -f can't be combined with batch mode\n");
+            return 2;
+        }
+        if (n_threads <= 0)
+            n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        return disassemble_files(&argv[optind], n_files, n_threads, STDOUT_FILENO) < 0;
+    }
+
+    Input input;
+    if (open_input(argv[optind], &input) < 0)
+        return 1;
+    int status = disasm_stream(&input, follow_flow);
+    close_input(&input);
+    return status < 0;
+}
+
+static void write_sound_events(const SoundLog *sound, FILE *file, int jsonl) {
+    char line[SOUND_EVENT_LINE_MAX];
+    u_int8_t record[SOUND_EVENT_SIZE];
+    for (u_int32_t i = 0; i < sound->n_events; i++) {
+        if (jsonl) {
+            fwrite(line, 1, format_sound_event(&sound->events[i], line), file);
+        } else {
+            pack_sound_event(&sound->events[i], record);
+            fwrite(record, 1, SOUND_EVENT_SIZE, file);
+        }
+    }
+}
+
+static int cmd_run(int argc, char **argv, int trace) {
+    const char *machine = NULL;
+    long count = -1;
+    long frames = -1;
+    const char *capture = NULL;
+    const char *movie_path = NULL;
+    int paced = 0;
+    const char *frames_dir = NULL;
+    long skip_every = 1;
+    const char *sound_path = NULL;
+    const char *heatmap_dir = NULL;
+    u_int16_t breakpoints[MAX_DEBUG_POINTS], watchpoints[MAX_DEBUG_POINTS];
+    int n_breakpoints = 0, n_watchpoints = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:n:f:r:M:po:s:S:b:w:H:")) != -1) {
+        switch (opt) {
+            case 'm': machine = optarg; break;
+            case 'n': count = atol(optarg); break;
+            case 'f': frames = atol(optarg); break;
+            case 'r': capture = optarg; break;
+            case 'M': movie_path = optarg; break;
+            case 'p': paced = 1; break;
+            case 'o': frames_dir = optarg; break;
+            case 's': skip_every = atol(optarg); break;
+            case 'S': sound_path = optarg; break;
+            case 'H': heatmap_dir = optarg; break;
+            case 'b':
+                if (n_breakpoints == MAX_DEBUG_POINTS) {
+                    fputs("error: too many breakpoints\n", stderr);
+                    return 2;
+                }
+                breakpoints[n_breakpoints++] = strtol(optarg, NULL, 16);
+                break;
+            case 'w':
+                if (n_watchpoints == MAX_DEBUG_POINTS) {
+                    fputs("error: too many watchpoints\n", stderr);
+                    return 2;
+                }
+                watchpoints[n_watchpoints++] = strtol(optarg, NULL, 16);
+                break;
+            default: fputs(usage, stderr); return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    if (machine != NULL && strcmp(machine, "invaders") != 0) {
+        fprintf(stderr, "error: unknown machine %s\n", machine);
+        return 2;
+    }
+    if (frames >= 0 && (machine == NULL || trace)) {
+        fprintf(stderr, "error: -f needs -m invaders and can't be traced\n");
+        return 2;
+    }
+    if ((capture != NULL || movie_path != NULL || frames_dir != NULL || sound_path != NULL || paced)
+        && frames < 0) {
+        fprintf(stderr, "error: -p, -o, -r, -M and -S need -f\n");
+        return 2;
+    }
+    if (skip_every < 0) {
+        fprintf(stderr, "error: -s takes a count of 0 or more\n");
+        return 2;
+    }
+#ifndef HEATMAP
+    if (heatmap_dir != NULL) {
+        fprintf(stderr, "error: -H needs a build with -DHEATMAP, see `make emulator_heatmap`\n");
+        return 2;
+    }
+#endif
+
+    Input input;
+    if (open_input(argv[optind], &input) < 0)
+        return 1;
+    Invaders *invaders = NULL;
+    Chip8080 *chip;
+    if (machine != NULL) {
+        invaders = make_invaders();
+        chip = invaders->chip;
+        if (load_invaders_rom(invaders, input.data, input.size) < 0) {
+            fprintf(stderr, "error: %s is not an 8KB Space Invaders ROM\n", argv[optind]);
+            close_input(&input);
+            destroy_invaders(invaders);
+            return 1;
+        }
+    } else {
+        chip = make_chip8080();
+        load_memory(chip, input.data, input.size, 0x0000);
+    }
+    close_input(&input);
+    for (int i = 0; i < n_breakpoints; i++)
+        set_breakpoint(chip, breakpoints[i]);
+    for (int i = 0; i < n_watchpoints; i++)
+        set_watchpoint(chip, watchpoints[i]);
+#ifdef RECOMPILED
+    /* Built with a recompiled ROM, used whenever the machine runs it */
+    if (invaders != NULL && install_recompiled(&recompiled_rom, chip) == 0)
+        invaders->scheduler.run_until = run_recompiled_until;
+#endif
+
+    OutputBuffer out = {malloc(OUTPUT_BUFFER_SIZE), OUTPUT_BUFFER_SIZE, 0, STDOUT_FILENO, 0};
+    int line_len;
+
+    Recorder *recorder = NULL;
+    if (capture != NULL && (recorder = open_recorder(capture, DEFAULT_KEYFRAME_INTERVAL)) == NULL)
+        fprintf(stderr, "error: could not create %s\n", capture);
+
+    Movie *movie = NULL;
+    if (movie_path != NULL) {
+        movie = make_movie();
+        begin_movie(movie, invaders);
+        invaders->movie = movie;
+    }
+
+    Pacer pacer;
+    if (paced)
+        init_pacer(&pacer, FRAMES_PER_SECOND, DEFAULT_MAX_CATCH_UP);
+
+    /* Video output never touches the machine, so skipping frames or
+     * pacing leaves the run cycle for cycle the same */
+    Rasterizer *rasterizer = NULL;
+    u_int8_t *picture = NULL;
+    FrameSkip skip;
+    char path[4096];
+    if (frames_dir != NULL) {
+        rasterizer = malloc(sizeof(Rasterizer));
+        picture = malloc(VIDEO_WIDTH * VIDEO_HEIGHT);
+        init_rasterizer(rasterizer, 0);
+        init_frame_skip(&skip, skip_every);
+    }
+
+    SoundLog sound;
+    SoundEvent *sound_events = NULL;
+    FILE *sound_file = NULL;
+    size_t path_len = sound_path != NULL ? strlen(sound_path) : 0;
+    int sound_jsonl = path_len >= 6 && strcmp(sound_path + path_len - 6, ".jsonl") == 0;
+    if (sound_path != NULL) {
+        if ((sound_file = fopen(sound_path, "wb")) == NULL) {
+            fprintf(stderr, "error: could not create %s\n", sound_path);
+        } else {
+            sound_events = malloc(SOUND_LOG_CAPACITY * sizeof(SoundEvent));
+            init_sound_log(&sound, sound_events, SOUND_LOG_CAPACITY);
+            invaders->sound = &sound;
+        }
+    }
+
+    u_int8_t lines[VIDEO_DIRTY_BYTES];
+    RunStatus status = RUN_OK;
+    double start = now_seconds();
+    for (long i = 0; invaders != NULL && i < frames; i++) {
+        status = invaders_run_frame(invaders);
+        if (status == RUN_UNIMPLEMENTED) {
+            fprintf(stderr, "stopped at an unimplemented opcode at %04x in frame %ld\n", chip->reg_pc, i);
+            frames = i + 1;
+        } else if (status == RUN_BREAKPOINT) {
+            fprintf(stderr, "stopped at breakpoint %04x in frame %ld\n", chip->reg_pc, i);
+            frames = i + 1;
+        } else if (status == RUN_WATCHPOINT) {
+            fprintf(stderr, "stopped at %04x after a write to %04x in frame %ld\n", chip->reg_pc,
+                    chip->debug->watch_address, i);
+            frames = i + 1;
+        } else if (is_parked(chip)) {
+            fprintf(stderr, "halted with interrupts off at %04x in frame %ld\n", chip->reg_pc - 1, i);
+            frames = i + 1;
+        }
+        if (recorder != NULL || rasterizer != NULL)
+            take_dirty_lines(chip, lines);
+        if (recorder != NULL)
+            record_frame(recorder, chip->memory, lines);
+        if (rasterizer != NULL) {
+            const u_int8_t *redraw = next_frame_lines(&skip, lines);
+            if (redraw != NULL) {
+                rasterize_gray_lines(rasterizer, chip->memory, redraw, picture);
+                snprintf(path, sizeof(path), "%s/%06ld.pgm", frames_dir, i);
+                if (write_pgm(path, picture) < 0)
+                    fprintf(stderr, "error: could not write %s\n", path);
+            }
+        }
+        if (movie != NULL)
+            movie_end_frame(movie, invaders);
+        if (sound_file != NULL) {
+            write_sound_events(&sound, sound_file, sound_jsonl);
+            sound.n_events = 0;
+        }
+        if (paced)
+            pace_frame(&pacer);
+    }
+    if (frames > 0 && !paced) {
+        double elapsed = now_seconds() - start;
+        fprintf(stderr, "ran %ld frames in %.3fs, %.1fx real time", frames, elapsed,
+                frames / (double) FRAMES_PER_SECOND / elapsed);
+        if (rasterizer != NULL)
+            fprintf(stderr, ", %llu written", (unsigned long long) skip.rasterized);
+        fputc('\n', stderr);
+    }
+    free(picture);
+    free(rasterizer);
+    if (sound_file != NULL) {
+        if (sound.dropped > 0)
+            fprintf(stderr, "warning: %llu sound events dropped\n", (unsigned long long) sound.dropped);
+        if (fclose(sound_file) != 0)
+            fprintf(stderr, "error: could not write %s\n", sound_path);
+        invaders->sound = NULL;
+        free(sound_events);
+    }
+    if (paced) {
+        PacingStats stats;
+        get_pacing_stats(&pacer, &stats);
+        fprintf(stderr, "paced %llu frames, %llu late, %llu skipped, jitter p50 %.1fus p99 %.1fus max %.1fus\n",
+                (unsigned long long) stats.frames, (unsigned long long) stats.late,
+                (unsigned long long) stats.skipped,
+                stats.p50_ns / 1e3, stats.p99_ns / 1e3, stats.max_ns / 1e3);
+    }
+    if (recorder != NULL && close_recorder(recorder) < 0)
+        fprintf(stderr, "error: could not write %s\n", capture);
+    if (movie != NULL) {
+        invaders->movie = NULL;
+        if (save_movie(movie, movie_path) < 0)
+            fprintf(stderr, "error: could not write %s\n", movie_path);
+        destroy_movie(movie);
+    }
+
+    for (long i = 0; frames < 0 && (count < 0 || i < count); i++) {
+        if (trace) {
+            char *line = reserve_output(&out, DISASM_LINE_MAX + CHIP_STATE_LINE_MAX);
+            format_instruction(chip->memory, chip->reg_pc, MAX_MEMORY, line, &line_len);
+            line[line_len - 1] = '\t';
+            out.len += line_len + format_chip_state(chip, line + line_len);
+        }
+        if (invaders != NULL && chip->halted)
+            status = run_scheduled(&invaders->scheduler, chip, next_deadline(&invaders->scheduler));
+        else if (invaders != NULL)
+            status = run_scheduled(&invaders->scheduler, chip, chip->cycles + 1);
+        else
+            status = run8080_until(chip, chip->cycles + 1);
+        // Without a machine nothing interrupts the chip
+        if (status == RUN_UNIMPLEMENTED || is_parked(chip) || (invaders == NULL && chip->halted))
+            break;
+        if (status == RUN_BREAKPOINT) {
+            fprintf(stderr, "stopped at breakpoint %04x\n", chip->reg_pc);
+            break;
+        }
+        if (status == RUN_WATCHPOINT) {
+            fprintf(stderr, "stopped at %04x after a write to %04x\n", chip->reg_pc, chip->debug->watch_address);
+            break;
+        }
+    }
+
+    out.len += format_chip_state(chip, reserve_output(&out, CHIP_STATE_LINE_MAX));
+    if (flush_output(&out) < 0)
+        fputs("error: could not write to standard output\n", stderr);
+    if (status == RUN_UNIMPLEMENTED)
+        unimplementedInstruction(chip);
+#ifdef HEATMAP
+    if (heatmap_dir != NULL && write_heatmap(chip->heat, chip->memory, heatmap_dir) < 0)
+        fprintf(stderr, "error: could not write the heatmap to %s\n", heatmap_dir);
+#endif
+
+    free(out.data);
+    if (invaders != NULL)
+        destroy_invaders(invaders);
+    else
+        destroy_chip8080(chip);
+    return status == RUN_UNIMPLEMENTED;
+}
+
+static int cmd_frames(int argc, char **argv) {
+    long first = 0;
+    long count = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+        switch (opt) {
+            case 's': first = atol(optarg); break;
+            case 'n': count = atol(optarg); break;
+            default: fputs(usage, stderr); return 2;
+        }
+    }
+    if (optind != argc - 2 || first < 0) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    Playback *playback = open_playback(argv[optind]);
+    if (playback == NULL) {
+        fprintf(stderr, "error: %s is not a complete capture\n", argv[optind]);
+        return 1;
+    }
+    if (first < playback->n_frames && seek_frame(playback, first) < 0) {
+        fprintf(stderr, "error: could not seek to frame %ld\n", first);
+        close_playback(playback);
+        return 1;
+    }
+
+    Rasterizer *rasterizer = malloc(sizeof(Rasterizer));
+    u_int8_t *frame = malloc(VIDEO_WIDTH * VIDEO_HEIGHT);
+    char path[4096];
+    int status = 0;
+    init_rasterizer(rasterizer, 0);
+
+    for (long i = first; (count < 0 || i < first + count) && i < playback->n_frames; i++) {
+        if (read_frame(playback) < 0) {
+            fprintf(stderr, "error: frame %ld is corrupt\n", i);
+            status = 1;
+            break;
+        }
+        rasterize_gray(rasterizer, playback->memory, frame);
+        snprintf(path, sizeof(path), "%s/%06ld.pgm", argv[optind + 1], i);
+        if (write_pgm(path, frame) < 0) {
+            fprintf(stderr, "error: could not write %s\n", path);
+            status = 1;
+            break;
+        }
+    }
+
+    free(frame);
+    free(rasterizer);
+    close_playback(playback);
+    return status;
+}
+
+static int cmd_replay(int argc, char **argv) {
+    if (argc != 2) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    Movie *movie = load_movie(argv[1]);
+    if (movie == NULL) {
+        fprintf(stderr, "error: %s is not a complete movie\n", argv[1]);
+        return 1;
+    }
+
+    Invaders *invaders = make_invaders();
+    u_int64_t *hashes = malloc((movie->n_frames + 1) * sizeof(u_int64_t));
+    RunStatus status;
+    long diverged = replay_movie(movie, invaders, hashes, &status);
+    // A replay that stops short has hashes up to the frame it stopped in
+    long ran = status == RUN_BUDGET ? (long) movie->n_frames : diverged + 1;
+
+    OutputBuffer out = {malloc(OUTPUT_BUFFER_SIZE), OUTPUT_BUFFER_SIZE, 0, STDOUT_FILENO, 0};
+    for (long i = 0; i < ran; i++)
+        out.len += sprintf(reserve_output(&out, 48), "%ld %016llx\n", i, (unsigned long long) hashes[i]);
+    if (flush_output(&out) < 0)
+        fputs("error: could not write to standard output\n", stderr);
+    if (status == RUN_UNIMPLEMENTED)
+        fprintf(stderr, "error: replay stopped at an unimplemented opcode at %04x in frame %ld\n",
+                invaders->chip->reg_pc, diverged);
+    else if (status != RUN_BUDGET)
+        fprintf(stderr, "error: replay stopped early in frame %ld\n", diverged);
+    else if (diverged >= 0)
+        fprintf(stderr, "error: replay diverges at frame %ld\n", diverged);
+
+    free(out.data);
+    free(hashes);
+    destroy_invaders(invaders);
+    destroy_movie(movie);
+    return diverged >= 0;
+}
+
+static int cmd_difftest(int argc, char **argv) {
+    long count = 100000;
+    u_int32_t seed = 8080;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': count = atol(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default: fputs(usage, stderr); return 2;
+        }
+    }
+    if (optind < argc - 1) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    Input input = {NULL, 0, 0};
+    if (optind == argc - 1 && open_input(argv[optind], &input) < 0)
+        return 1;
+    if (input.size > MAX_MEMORY)
+        input.size = MAX_MEMORY;
+
+    Chip8080 *chip = make_chip8080();
+    RefState *ref = malloc(sizeof(RefState));
+    char *report = malloc(DIFF_REPORT_MAX);
+    u_int64_t steps = 0;
+    int streams = 0;
+    DiffResult result = {0, 0};
+
+    /* Each stream is a fresh machine: a random program, or the ROM
+     * entered at a different address each time so every instruction
+     * alignment gets decoded */
+    while (steps < (u_int64_t) count && !result.diverged) {
+        reset_chip_state(chip);
+        memset(chip->memory, 0, MAX_MEMORY);
+        if (input.data != NULL) {
+            make_rom_program(chip->memory, input.data, input.size);
+            chip->reg_pc = (streams * 0x101) % input.size;
+        } else {
+            make_random_program(chip->memory, 0x1000, &seed);
+            chip->reg_a = seed >> 8;
+            chip->reg_b = 0x20 | (seed >> 16);
+            chip->reg_d = 0x20 | (seed >> 24);
+        }
+        u_int64_t limit = count - steps < DIFF_STREAM_STEPS ? count - steps : DIFF_STREAM_STEPS;
+        result = difftest(chip, ref, limit, report);
+        steps += result.steps;
+        streams++;
+    }
+
+    if (result.diverged)
+        fputs(report, stdout);
+    else
+        printf("%llu instructions in %d streams, no divergence\n", (unsigned long long) steps, streams);
+
+    if (input.data != NULL)
+        close_input(&input);
+    free(report);
+    free(ref);
+    destroy_chip8080(chip);
+    return result.diverged;
+}
+
+static int cmd_recompile(int argc, char **argv) {
+    const char *out_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        switch (opt) {
+            case 'o': out_path = optarg; break;
+            default: fputs(usage, stderr); return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    Input input;
+    if (open_input(argv[optind], &input) < 0)
+        return 1;
+    FILE *out = out_path != NULL ? fopen(out_path, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "error: could not create %s\n", out_path);
+        close_input(&input);
+        return 1;
+    }
+    int n_blocks = recompile_rom(input.data, input.size, argv[optind], out);
+    if ((out != stdout && fclose(out) != 0) || n_blocks < 0) {
+        fprintf(stderr, "error: could not write %s\n", out_path != NULL ? out_path : "the output");
+        n_blocks = -1;
+    }
+    close_input(&input);
+    return n_blocks < 0;
+}
+
+static int cmd_gdb(int argc, char **argv) {
+    const char *machine = NULL;
+    const char *address = "1234";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:l:")) != -1) {
+        switch (opt) {
+            case 'm': machine = optarg; break;
+            case 'l': address = optarg; break;
+            default: fputs(usage, stderr); return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    if (machine != NULL && strcmp(machine, "invaders") != 0) {
+        fprintf(stderr, "error: unknown machine %s\n", machine);
+        return 2;
+    }
+
+    Input input;
+    if (open_input(argv[optind], &input) < 0)
+        return 1;
+    Invaders *invaders = NULL;
+    GdbTarget target = {NULL, NULL};
+    if (machine != NULL) {
+        invaders = make_invaders();
+        target.chip = invaders->chip;
+        target.scheduler = &invaders->scheduler;
+        if (load_invaders_rom(invaders, input.data, input.size) < 0) {
+            fprintf(stderr, "error: %s is not an 8KB Space Invaders ROM\n", argv[optind]);
+            close_input(&input);
+            destroy_invaders(invaders);
+            return 1;
+        }
+    } else {
+        target.chip = make_chip8080();
+        load_memory(target.chip, input.data, input.size, 0x0000);
+    }
+    close_input(&input);
+
+    int listener = open_gdb_listener(address);
+    if (listener < 0) {
+        fprintf(stderr, "error: could not listen on %s\n", address);
+    } else {
+        /* The machine stays stopped between connections, until one kills it */
+        fprintf(stderr, "waiting for gdb on %s\n", address);
+        for (int killed = 0; !killed; ) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd < 0)
+                break;
+            killed = serve_gdb(fd, &target);
+            close(fd);
+        }
+        close(listener);
+    }
+
+    if (invaders != NULL)
+        destroy_invaders(invaders);
+    else
+        destroy_chip8080(target.chip);
+    return listener < 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    const char *command = argv[1];
+    argc--;
+    argv++;
+
+    if (strcmp(command, "disasm") == 0)
+        return cmd_disasm(argc, argv);
+    if (strcmp(command, "run") == 0)
+        return cmd_run(argc, argv, 0);
+    if (strcmp(command, "trace") == 0)
+        return cmd_run(argc, argv, 1);
+    if (strcmp(command, "frames") == 0)
+        return cmd_frames(argc, argv);
+    if (strcmp(command, "replay") == 0)
+        return cmd_replay(argc, argv);
+    if (strcmp(command, "difftest") == 0)
+        return cmd_difftest(argc, argv);
+    if (strcmp(command, "recompile") == 0)
+        return cmd_recompile(argc, argv);
+    if (strcmp(command, "gdb") == 0)
+        return cmd_gdb(argc, argv);
+    if (strcmp(command, "bench") == 0)
+        return bench_main(argc - 1, argv + 1);
+
+    fputs(usage, stderr);
+    return 2;
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow.h"
+#include "tools.h"
+
+/* Reset followed by the RST 0-7 vectors. The reset entry is decoded
+ * first so that vectors landing inside its instructions are skipped. */
+const u_int16_t default_entry_points[9] = {
+    0x0000, 0x0000, 0x0008, 0x0010, 0x0018, 0x0020, 0x0028, 0x0030, 0x0038
+};
+
+enum flow_kind { FLOW_NEXT, FLOW_JUMP, FLOW_BRANCH, FLOW_CALL, FLOW_STOP };
+
+static enum flow_kind classify(u_int8_t opcode) {
+    /* How an opcode affects the flow of control */
+    switch (opcode) {
+        case 0xc3: case 0xcb: return FLOW_JUMP;                 // JMP and its undocumented copy
+        case 0xc9: case 0xe9: return FLOW_STOP;                 // RET, PCHL
+        case 0xcd: return FLOW_CALL;                            // CALL
+        case 0xc2: case 0xca: case 0xd2: case 0xda:
+        case 0xe2: case 0xea: case 0xf2: case 0xfa:
+            return FLOW_BRANCH;                                 // Jcc
+        case 0xc4: case 0xcc: case 0xd4: case 0xdc:
+        case 0xe4: case 0xec: case 0xf4: case 0xfc:
+            return FLOW_CALL;                                   // Ccc
+        case 0xc7: case 0xcf: case 0xd7: case 0xdf:
+        case 0xe7: case 0xef: case 0xf7: case 0xff:
+            return FLOW_CALL;                                   // RST n
+        default: return FLOW_NEXT;
+    }
+}
+
+static u_int16_t flow_target(const unsigned char *codebuffer, int pc, int size) {
+    u_int8_t opcode = codebuffer[pc];
+    if ((opcode & 0xc7) == 0xc7)
+        return opcode & 0x38;
+    u_int8_t lo = (pc + 1 < size) ? codebuffer[pc + 1] : 0;
+    u_int8_t hi = (pc + 2 < size) ? codebuffer[pc + 2] : 0;
+    return (hi << 8) | lo;
+}
+
+static void follow(const unsigned char *codebuffer, int size, u_int16_t entry,
+                   FlowMap *map, u_int16_t *worklist) {
+    /* Decodes everything reachable from entry, queueing each new
+     * jump/call target once (the label bit doubles as "queued") */
+    int pending = 0;
+    worklist[pending++] = entry;
+
+    while (pending > 0) {
+        int pc = worklist[--pending];
+
+        while (pc < size && !bitmap_test(map->start, pc)) {
+            u_int8_t opcode = codebuffer[pc];
+            int opbytes = opcode_table[opcode].size;
+            enum flow_kind kind = classify(opcode);
+
+            bitmap_set(map->start, pc);
+            for (int i = 0; i < opbytes && pc + i < size; i++)
+                bitmap_set(map->code, pc + i);
+
+            if (kind != FLOW_NEXT && kind != FLOW_STOP) {
+                u_int16_t target = flow_target(codebuffer, pc, size);
+                if (target < size && !bitmap_test(map->label, target)) {
+                    bitmap_set(map->label, target);
+                    worklist[pending++] = target;
+                }
+            }
+            if (kind == FLOW_JUMP || kind == FLOW_STOP)
+                break;
+            pc += opbytes;
+        }
+    }
+}
+
+void analyze_flow(const unsigned char *codebuffer, int size,
+                  const u_int16_t *entry_points, int n_entry_points, FlowMap *map) {
+    /* Recursive-descent pass over codebuffer (at most 64KB)
+     * , entry_points are decoded in order; an entry that was already
+     * decoded is only labeled, one inside an instruction is ignored
+     * , fills map with the code, instruction start, label and listed
+     * bitmaps */
+
+    u_int16_t *worklist = malloc(ADDRESS_SPACE * sizeof(u_int16_t));
+    memset(map, 0, sizeof(FlowMap));
+
+    if (size > ADDRESS_SPACE)
+        size = ADDRESS_SPACE;
+
+    for (int i = 0; i < n_entry_points; i++) {
+        u_int16_t entry = entry_points[i];
+        if (entry >= size)
+            continue;
+        if (bitmap_test(map->start, entry))
+            bitmap_set(map->label, entry);
+        if (bitmap_test(map->code, entry))
+            continue;
+        bitmap_set(map->label, entry);
+        follow(codebuffer, size, entry, map, worklist);
+    }
+
+    // The listing steps over whole instructions, so the start of one
+    // decoded inside another never gets a line or a label line
+    for (int pc = 0; pc < size; pc += bitmap_test(map->start, pc) ? opcode_table[codebuffer[pc]].size : 1)
+        bitmap_set(map->listed, pc);
+    free(worklist);
+}
+
+#define DATA_PER_LINE 8
+
+size_t disassemble_flow(const unsigned char *codebuffer, int *pc, int end,
+                        const FlowMap *map, char *out, size_t out_size) {
+    /* Like disassemble_range() but driven by map: decoded instructions
+     * are listed, with jump and call targets named by their labels,
+     * labels get their own "Lxxxx:" line and anything else is emitted
+     * as "DB" lines of up to 8 bytes
+     * return the number of chars written to out */
+
+    const size_t line_max = 8 + 5 + 7 + DATA_PER_LINE * 4 + 1;
+    size_t written = 0;
+    int line_len;
+
+    while (*pc < end && out_size - written >= line_max + DISASM_LINE_MAX) {
+        char *line = out + written;
+        int addr = *pc;
+
+        if (bitmap_test(map->label, addr)) {
+            *line++ = 'L';
+            line = put_hex8(line, addr >> 8);
+            line = put_hex8(line, addr & 0xff);
+            *line++ = ':';
+            *line++ = '\n';
+        }
+
+        if (bitmap_test(map->start, addr)) {
+            *pc += format_instruction(codebuffer, addr, end, line, &line_len);
+            enum flow_kind kind = classify(codebuffer[addr]);
+            // "$hhll\n" ends a 3 byte operand, "Lhhll\n" names its label
+            // when the listing has one
+            if (kind != FLOW_NEXT && kind != FLOW_STOP && opcode_table[codebuffer[addr]].size == 3) {
+                u_int16_t target = flow_target(codebuffer, addr, end);
+                if (bitmap_test(map->label, target) && bitmap_test(map->listed, target))
+                    line[line_len - 6] = 'L';
+            }
+            line += line_len;
+        } else {
+            line = put_hex8(line, addr >> 8);
+            line = put_hex8(line, addr & 0xff);
+            memcpy(line, " DB     ", 8);
+            line += 8;
+            for (int i = 0; i < DATA_PER_LINE && *pc < end; i++) {
+                if (i > 0 && (bitmap_test(map->start, *pc) || bitmap_test(map->label, *pc)))
+                    break;
+                if (i > 0)
+                    *line++ = ',';
+                *line++ = '$';
+                line = put_hex8(line, codebuffer[*pc]);
+                (*pc)++;
+            }
+            *line++ = '\n';
+        }
+        written = line - out;
+    }
+    return written;
+}
@@ -0,0 +1,31 @@
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+#define ADDRESS_SPACE 0x10000
+#define BITMAP_BYTES (ADDRESS_SPACE / 8)
+
+/* One bit per address of the 8080 address space */
+typedef struct FlowMap {
+    u_int8_t code[BITMAP_BYTES];    // byte belongs to a decoded instruction
+    u_int8_t start[BITMAP_BYTES];   // a decoded instruction starts here
+    u_int8_t label[BITMAP_BYTES];   // target of a jump, call, RST or entry point
+    u_int8_t listed[BITMAP_BYTES];  // disassemble_flow() lists a line from here
+} FlowMap;
+
+extern const u_int16_t default_entry_points[9];
+
+static inline int bitmap_test(const u_int8_t *bitmap, u_int16_t addr) {
+    return (bitmap[addr >> 3] >> (addr & 7)) & 1;
+}
+
+static inline void bitmap_set(u_int8_t *bitmap, u_int16_t addr) {
+    bitmap[addr >> 3] |= 1 << (addr & 7);
+}
+
+void analyze_flow(const unsigned char*, int, const u_int16_t*, int, FlowMap*);
+size_t disassemble_flow(const unsigned char*, int*, int, const FlowMap*, char*, size_t);
+
+#endif
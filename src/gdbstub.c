@@ -0,0 +1,453 @@
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "chip8080.h"
+#include "scheduler.h"
+#include "debugger.h"
+#include "gdbstub.h"
+
+/*
+ *  GDB remote serial protocol stub
+ *
+ *  Serves one gdb connection over a Unix socket or a localhost TCP port.
+ *  gdb reads and writes registers and memory while the machine is
+ *  stopped; on continue the machine runs through run_scheduled() or
+ *  run8080_until() in slices of GDB_RUN_SLICE cycles, at full batched
+ *  speed, until a breakpoint, a watchpoint or a ^C from gdb stops it.
+ *  Breakpoints and watchpoints are the debugger's bitmaps (debugger.c);
+ *  the debugger is only attached while some are set, so that the rest
+ *  of the time, and after gdb goes, the machine runs as it would without.
+ */
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static const char* parse_hex(const char *in, u_int32_t *value) {
+    /* return the first character after the hex number at in, or NULL
+     * if there is none */
+    const char *start = in;
+    *value = 0;
+    for (; hex_value(*in) >= 0 && in - start < 8; in++)
+        *value = (*value << 4) | hex_value(*in);
+    return in == start ? NULL : in;
+}
+
+static char* put_hex8(char *out, u_int8_t value) {
+    *out++ = hex_digits[value >> 4];
+    *out++ = hex_digits[value & 0xf];
+    return out;
+}
+
+static char* put_hex16(char *out, u_int16_t value) {
+    /* Registers go little endian, as gdb's z80 target expects */
+    out = put_hex8(out, value & 0xff);
+    return put_hex8(out, value >> 8);
+}
+
+int gdb_checksum(const char *data, size_t size) {
+    u_int8_t sum = 0;
+    for (size_t i = 0; i < size; i++)
+        sum += (u_int8_t) data[i];
+    return sum;
+}
+
+static u_int8_t get_psw_flags(const Chip8080 *chip) {
+    /* The 8080 PSW: S Z 0 AC 0 P 1 CY, the bits of the z80 F register */
+    return (chip->flags.s << 7) | (chip->flags.z << 6) | (chip->flags.ac << 4)
+        | (chip->flags.p << 2) | 0x02 | chip->flags.cy;
+}
+
+static void set_psw_flags(Chip8080 *chip, u_int8_t f) {
+    chip->flags.s = (f >> 7) & 1;
+    chip->flags.z = (f >> 6) & 1;
+    chip->flags.ac = (f >> 4) & 1;
+    chip->flags.p = (f >> 2) & 1;
+    chip->flags.cy = f & 1;
+}
+
+static u_int16_t get_register(const Chip8080 *chip, int n) {
+    switch (n) {
+        case 0: return make_register_pair_from(chip->reg_a, get_psw_flags(chip));
+        case 1: return make_register_pair_from(chip->reg_b, chip->reg_c);
+        case 2: return make_register_pair_from(chip->reg_d, chip->reg_e);
+        case 3: return make_register_pair_from(chip->reg_h, chip->reg_l);
+        case 4: return chip->reg_sp;
+        case 5: return chip->reg_pc;
+        default: return 0;  // z80 only
+    }
+}
+
+static void set_register(Chip8080 *chip, int n, u_int16_t value) {
+    switch (n) {
+        case 0: chip->reg_a = value >> 8; set_psw_flags(chip, value); break;
+        case 1: chip->reg_b = value >> 8; chip->reg_c = value; break;
+        case 2: chip->reg_d = value >> 8; chip->reg_e = value; break;
+        case 3: chip->reg_h = value >> 8; chip->reg_l = value; break;
+        case 4: chip->reg_sp = value; break;
+        case 5: chip->reg_pc = value; chip->halted = 0; break;
+        default: break;
+    }
+}
+
+static const char* parse_u16le(const char *in, u_int16_t *value) {
+    /* A register as gdb sends it: 4 hex digits, low byte first */
+    int digits[4];
+    for (int i = 0; i < 4; i++)
+        if ((digits[i] = hex_value(in[i])) < 0)
+            return NULL;
+    *value = (digits[0] << 4 | digits[1]) | (digits[2] << 4 | digits[3]) << 8;
+    return in + 4;
+}
+
+static const char* parse_range(const char *in, u_int32_t *address, u_int32_t *length) {
+    /* "addr,length" of m, M and Z packets */
+    if ((in = parse_hex(in, address)) == NULL || *in++ != ',')
+        return NULL;
+    return parse_hex(in, length);
+}
+
+static GdbAction read_memory_packet(const GdbTarget *target, const char *args, char *reply) {
+    u_int32_t address, length;
+    if (parse_range(args, &address, &length) == NULL || length > GDB_PACKET_MAX / 2) {
+        strcpy(reply, "E01");
+        return GDB_REPLY;
+    }
+    for (u_int32_t i = 0; i < length; i++)
+        reply = put_hex8(reply, target->chip->memory[(u_int16_t) (address + i)]);
+    *reply = '\0';
+    return GDB_REPLY;
+}
+
+static GdbAction write_memory_packet(GdbTarget *target, const char *args, char *reply) {
+    u_int32_t address, length;
+    const char *in = parse_range(args, &address, &length);
+    if (in == NULL || *in++ != ':' || strlen(in) != length * 2) {
+        strcpy(reply, "E01");
+        return GDB_REPLY;
+    }
+    for (u_int32_t i = 0; i < length; i++) {
+        int high = hex_value(in[2 * i]), low = hex_value(in[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            strcpy(reply, "E01");
+            return GDB_REPLY;
+        }
+        write_memory(target->chip, address + i, high << 4 | low);
+    }
+    strcpy(reply, "OK");
+    return GDB_REPLY;
+}
+
+static GdbAction point_packet(GdbTarget *target, const char *args, int insert, char *reply) {
+    /* Z/z type,addr,kind: 0 and 1 are breakpoints, 2 write watchpoints
+     * over kind bytes, at most the whole address space */
+    u_int32_t type, address, length;
+    if ((args = parse_hex(args, &type)) == NULL || *args++ != ','
+        || parse_range(args, &address, &length) == NULL) {
+        strcpy(reply, "E01");
+        return GDB_REPLY;
+    }
+    if (type == 0 || type == 1) {
+        (insert ? set_breakpoint : clear_breakpoint)(target->chip, address);
+    } else if (type == 2) {
+        if (length > MAX_MEMORY)
+            length = MAX_MEMORY;
+        for (u_int32_t i = 0; i < length; i++)
+            (insert ? set_watchpoint : clear_watchpoint)(target->chip, address + i);
+    } else {
+        *reply = '\0';      // unsupported
+        return GDB_REPLY;
+    }
+    if (!insert && !has_debug_points(target->chip))
+        detach_debugger(target->chip);
+    strcpy(reply, "OK");
+    return GDB_REPLY;
+}
+
+GdbAction handle_gdb_packet(GdbTarget *target, const char *packet, char *reply) {
+    /* Answers one packet payload (without $ and checksum) in reply, at
+     * least GDB_PACKET_MAX + 1 bytes; an empty reply means unsupported
+     * return what the host should do next */
+    Chip8080 *chip = target->chip;
+    u_int32_t n;
+    u_int16_t value;
+    const char *in;
+
+    *reply = '\0';
+    switch (packet[0]) {
+        case '?':
+            format_stop_reply(target, RUN_BREAKPOINT, reply);
+            return GDB_REPLY;
+        case 'g':
+            for (int i = 0; i < GDB_REGISTERS; i++)
+                reply = put_hex16(reply, get_register(chip, i));
+            *reply = '\0';
+            return GDB_REPLY;
+        case 'G':
+            in = packet + 1;
+            for (int i = 0; i < GDB_REGISTERS && *in != '\0'; i++) {
+                if ((in = parse_u16le(in, &value)) == NULL) {
+                    strcpy(reply, "E01");
+                    return GDB_REPLY;
+                }
+                set_register(chip, i, value);
+            }
+            strcpy(reply, "OK");
+            return GDB_REPLY;
+        case 'p':
+            if (parse_hex(packet + 1, &n) == NULL || n >= GDB_REGISTERS) {
+                strcpy(reply, "E01");
+                return GDB_REPLY;
+            }
+            *put_hex16(reply, get_register(chip, n)) = '\0';
+            return GDB_REPLY;
+        case 'P':
+            if ((in = parse_hex(packet + 1, &n)) == NULL || *in++ != '=' || n >= GDB_REGISTERS
+                || parse_u16le(in, &value) == NULL) {
+                strcpy(reply, "E01");
+                return GDB_REPLY;
+            }
+            set_register(chip, n, value);
+            strcpy(reply, "OK");
+            return GDB_REPLY;
+        case 'm':
+            return read_memory_packet(target, packet + 1, reply);
+        case 'M':
+            return write_memory_packet(target, packet + 1, reply);
+        case 'Z':
+        case 'z':
+            return point_packet(target, packet + 1, packet[0] == 'Z', reply);
+        case 'c':
+        case 's':
+            if (packet[1] != '\0' && parse_hex(packet + 1, &n) != NULL)
+                chip->reg_pc = n;
+            return packet[0] == 'c' ? GDB_CONTINUE : GDB_STEP;
+        case 'H':
+        case 'T':
+            strcpy(reply, "OK");
+            return GDB_REPLY;
+        case 'D':
+            strcpy(reply, "OK");
+            return GDB_DETACH;
+        case 'k':
+            return GDB_KILL;
+        case 'q':
+            if (strncmp(packet, "qSupported", 10) == 0)
+                sprintf(reply, "PacketSize=%x", GDB_PACKET_MAX);
+            else if (strcmp(packet, "qAttached") == 0)
+                strcpy(reply, "1");
+            else if (strcmp(packet, "qC") == 0)
+                strcpy(reply, "QC1");
+            else if (strcmp(packet, "qfThreadInfo") == 0)
+                strcpy(reply, "m1");
+            else if (strcmp(packet, "qsThreadInfo") == 0)
+                strcpy(reply, "l");
+            return GDB_REPLY;
+        default:
+            return GDB_REPLY;
+    }
+}
+
+void format_stop_reply(const GdbTarget *target, RunStatus status, char *reply) {
+    /* Stops are reported as signals: SIGTRAP for breakpoints and steps,
+     * SIGILL for an opcode the core lacks and SIGINT for a ^C, which
+     * ends a slice with RUN_BUDGET */
+    switch (status) {
+        case RUN_WATCHPOINT:
+            sprintf(reply, "T05watch:%04x;", target->chip->debug->watch_address);
+            break;
+        case RUN_UNIMPLEMENTED:
+            strcpy(reply, "S04");
+            break;
+        case RUN_BUDGET:
+            strcpy(reply, "S02");
+            break;
+        default:
+            strcpy(reply, "S05");
+            break;
+    }
+}
+
+RunStatus gdb_step(GdbTarget *target) {
+    /* Runs one instruction, with the events due on the way; a halted
+     * chip sleeps to its next event instead */
+    Chip8080 *chip = target->chip;
+    RunStatus status;
+    if (chip->debug != NULL)
+        resume_debugged(chip);
+    if (target->scheduler == NULL)
+        status = run8080_until(chip, chip->cycles + 1);
+    else if (chip->halted && next_deadline(target->scheduler) != NO_DEADLINE)
+        status = run_scheduled(target->scheduler, chip, next_deadline(target->scheduler));
+    else
+        status = run_scheduled(target->scheduler, chip, chip->cycles + 1);
+    return status == RUN_BUDGET ? RUN_OK : status;
+}
+
+/*
+ *  Connection
+ */
+
+static int send_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int send_packet(int fd, const char *payload) {
+    /* Sends $payload#checksum; gdb acks it, and the ack is skipped by
+     * read_packet() along with the next packet */
+    static char frame[GDB_PACKET_MAX + 5];
+    size_t size = strlen(payload);
+    frame[0] = '$';
+    memcpy(frame + 1, payload, size);
+    sprintf(frame + 1 + size, "#%02x", gdb_checksum(payload, size));
+    return send_all(fd, frame, size + 4);
+}
+
+static int read_byte(int fd) {
+    u_int8_t c;
+    ssize_t n;
+    while ((n = read(fd, &c, 1)) < 0 && errno == EINTR)
+        ;
+    return n == 1 ? c : -1;
+}
+
+static int read_packet(int fd, char *payload) {
+    /* Reads the next packet into payload and acks it; acks, naks and
+     * stray ^Cs outside packets are dropped
+     * return 0, or -1 once the connection is closed */
+    for (;;) {
+        int c;
+        while ((c = read_byte(fd)) != '$')
+            if (c < 0)
+                return -1;
+        size_t size = 0;
+        while ((c = read_byte(fd)) != '#') {
+            if (c < 0)
+                return -1;
+            if (size < GDB_PACKET_MAX)
+                payload[size++] = c;
+        }
+        int high = hex_value(read_byte(fd)), low = hex_value(read_byte(fd));
+        payload[size] = '\0';
+        if (high >= 0 && low >= 0 && (high << 4 | low) == gdb_checksum(payload, size))
+            return send_all(fd, "+", 1);
+        if (send_all(fd, "-", 1) < 0)
+            return -1;
+    }
+}
+
+static int interrupt_pending(int fd) {
+    /* A ^C from gdb while the machine runs, or a closed connection;
+     * anything else is left for read_packet() */
+    struct pollfd pfd = {fd, POLLIN, 0};
+    u_int8_t c;
+    if (poll(&pfd, 1, 0) <= 0)
+        return 0;
+    if (recv(fd, &c, 1, MSG_PEEK) != 1)
+        return 1;
+    return c == 0x03 && read_byte(fd) == 0x03;
+}
+
+static RunStatus run_until_stop(GdbTarget *target, int fd) {
+    /* Continues at full batched speed, one slice at a time
+     * return why it stopped; RUN_BUDGET for a ^C */
+    Chip8080 *chip = target->chip;
+    if (chip->debug != NULL)
+        resume_debugged(chip);
+    for (;;) {
+        u_int64_t until = chip->cycles + GDB_RUN_SLICE;
+        RunStatus status = target->scheduler != NULL
+            ? run_scheduled(target->scheduler, chip, until)
+            : run8080_until(chip, until);
+        if (status != RUN_BUDGET)
+            return status;
+        if (interrupt_pending(fd))
+            return RUN_BUDGET;
+    }
+}
+
+int open_gdb_listener(const char *address) {
+    /* address is a Unix socket path if it has a '/', else a TCP port
+     * on localhost
+     * return the listening socket, or -1 */
+    int fd;
+    if (strchr(address, '/') != NULL) {
+        struct sockaddr_un sun = {0};
+        if (strlen(address) >= sizeof(sun.sun_path))
+            return -1;
+        sun.sun_family = AF_UNIX;
+        strcpy(sun.sun_path, address);
+        unlink(address);
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+            return -1;
+        if (bind(fd, (struct sockaddr*) &sun, sizeof(sun)) < 0 || listen(fd, 1) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    struct sockaddr_in sin = {0};
+    int one = 1;
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(atoi(address));
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr*) &sin, sizeof(sin)) < 0 || listen(fd, 1) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_gdb(int fd, GdbTarget *target) {
+    /* Serves the gdb connected on fd until it detaches, kills or hangs up,
+     * then detaches the debugger with whatever gdb left set
+     * return 1 if gdb asked to kill the machine, else 0 */
+    char *packet = malloc(GDB_PACKET_MAX + 1);
+    char *reply = malloc(GDB_PACKET_MAX + 1);
+    int killed = 0;
+
+    while (read_packet(fd, packet) == 0) {
+        GdbAction action = handle_gdb_packet(target, packet, reply);
+        if (action == GDB_CONTINUE)
+            format_stop_reply(target, run_until_stop(target, fd), reply);
+        else if (action == GDB_STEP)
+            format_stop_reply(target, gdb_step(target), reply);
+        if (action == GDB_KILL) {
+            killed = 1;
+            break;
+        }
+        if (send_packet(fd, reply) < 0 || action == GDB_DETACH)
+            break;
+    }
+    detach_debugger(target->chip);
+    free(packet);
+    free(reply);
+    return killed;
+}
@@ -0,0 +1,39 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "scheduler.h"
+
+/* Largest packet payload accepted or sent, advertised as PacketSize */
+#define GDB_PACKET_MAX 4096
+/* Cycles run between checks for an interrupt from gdb while continuing */
+#define GDB_RUN_SLICE 100000
+/* Registers in gdb's z80 layout, of which the 8080 has the first six:
+ * AF, BC, DE, HL, SP, PC, IX, IY, AF', BC', DE', HL', IR; 16 bits each */
+#define GDB_REGISTERS 13
+
+/* What the host should do after a packet */
+typedef enum GdbAction {
+    GDB_REPLY,              // Send the reply
+    GDB_CONTINUE,           // Run until a stop, then send a stop reply
+    GDB_STEP,               // Run one instruction, then send a stop reply
+    GDB_DETACH,             // Send the reply and close the connection
+    GDB_KILL,               // Close the connection without a reply
+} GdbAction;
+
+/* The machine being debugged; scheduler, if not NULL, drives its events */
+typedef struct GdbTarget {
+    Chip8080 *chip;
+    Scheduler *scheduler;
+} GdbTarget;
+
+int gdb_checksum(const char*, size_t);
+GdbAction handle_gdb_packet(GdbTarget*, const char*, char*);
+void format_stop_reply(const GdbTarget*, RunStatus, char*);
+RunStatus gdb_step(GdbTarget*);
+int open_gdb_listener(const char*);
+int serve_gdb(int, GdbTarget*);
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "tools.h"
+#include "heatmap.h"
+
+/*
+ *  Memory access heatmap
+ *
+ *  Builds with -DHEATMAP count every read, write and execute per
+ *  address in chip->heat (see COUNT_ACCESS in chip8080.h). This file
+ *  turns the counts into images and a table of the busiest addresses;
+ *  it needs no counting of its own, so it builds either way.
+ */
+
+typedef struct HeatEntry {
+    u_int64_t total;
+    u_int32_t address;
+} HeatEntry;
+
+static int bit_length(u_int64_t value) {
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+void render_heatmap(const u_int64_t *counts, u_int8_t *image) {
+    /* Draws MAX_MEMORY counts into a HEATMAP_SIDE x HEATMAP_SIDE gray
+     * image, address 0 at the top left: black for none, white for the
+     * most, on a log2 scale so that rare accesses still show */
+    u_int64_t most = 0;
+    for (int i = 0; i < MAX_MEMORY; i++)
+        if (counts[i] > most)
+            most = counts[i];
+    int top = bit_length(most);
+    for (int i = 0; i < MAX_MEMORY; i++)
+        image[i] = top == 0 ? 0 : bit_length(counts[i]) * 255 / top;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    /* Busiest first, then by address */
+    const HeatEntry *x = a, *y = b;
+    if (x->total != y->total)
+        return x->total < y->total ? 1 : -1;
+    return x->address < y->address ? -1 : x->address > y->address;
+}
+
+size_t format_heatmap_table(const Heatmap *heat, const u_int8_t *memory, int rows, char *out) {
+    /* formats the rows busiest addresses of heat into out, one line each
+     * after a header, with the instruction there if it was executed and
+     * the byte there as DB if not
+     * , out must hold (rows + 1) * HEATMAP_LINE_MAX chars
+     * return the number of chars written to out */
+    HeatEntry *entries = malloc(MAX_MEMORY * sizeof(HeatEntry));
+    int n_entries = 0;
+    char *line = out;
+    char instruction[DISASM_LINE_MAX];
+    int instruction_len;
+
+    for (u_int32_t address = 0; address < MAX_MEMORY; address++) {
+        u_int64_t total = heat->reads[address] + heat->writes[address] + heat->executes[address];
+        if (total != 0)
+            entries[n_entries++] = (HeatEntry) {total, address};
+    }
+    qsort(entries, n_entries, sizeof(HeatEntry), compare_entries);
+
+    line += sprintf(line, "addr %12s %12s %12s  instruction\n", "reads", "writes", "executes");
+    for (int i = 0; i < n_entries && i < rows; i++) {
+        u_int32_t address = entries[i].address;
+        line += sprintf(line, "%04x %12llu %12llu %12llu  ", address,
+                        (unsigned long long) heat->reads[address],
+                        (unsigned long long) heat->writes[address],
+                        (unsigned long long) heat->executes[address]);
+        if (heat->executes[address] != 0) {
+            // Drop the address and newline format_instruction() puts around it
+            format_instruction(memory, address, MAX_MEMORY, instruction, &instruction_len);
+            memcpy(line, instruction + 5, instruction_len - 6);
+            line += instruction_len - 6;
+        } else {
+            line += sprintf(line, "DB     $%02x", memory[address]);
+        }
+        *line++ = '\n';
+    }
+    free(entries);
+    return line - out;
+}
+
+static int write_heatmap_pgm(const char *path, const u_int64_t *counts) {
+    u_int8_t image[HEATMAP_SIDE * HEATMAP_SIDE];
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return -1;
+    render_heatmap(counts, image);
+    fprintf(file, "P5\n%d %d\n255\n", HEATMAP_SIDE, HEATMAP_SIDE);
+    size_t written = fwrite(image, 1, sizeof(image), file);
+    return (fclose(file) == 0 && written == sizeof(image)) ? 0 : -1;
+}
+
+int write_heatmap(const Heatmap *heat, const u_int8_t *memory, const char *dir) {
+    /* Writes dir/reads.pgm, dir/writes.pgm and dir/executes.pgm, and the
+     * HEATMAP_TABLE_ROWS busiest addresses to dir/heatmap.txt
+     * return 0, or -1 if a file could not be written */
+    const char *names[3] = {"reads", "writes", "executes"};
+    const u_int64_t *counts[3] = {heat->reads, heat->writes, heat->executes};
+    char path[4096];
+    int result = 0;
+
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s.pgm", dir, names[i]);
+        if (write_heatmap_pgm(path, counts[i]) < 0)
+            result = -1;
+    }
+
+    char *table = malloc((HEATMAP_TABLE_ROWS + 1) * HEATMAP_LINE_MAX);
+    size_t size = format_heatmap_table(heat, memory, HEATMAP_TABLE_ROWS, table);
+    snprintf(path, sizeof(path), "%s/heatmap.txt", dir);
+    FILE *file = fopen(path, "w");
+    if (file == NULL || fwrite(table, 1, size, file) != size)
+        result = -1;
+    if (file != NULL && fclose(file) != 0)
+        result = -1;
+    free(table);
+    return result;
+}
@@ -0,0 +1,19 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+
+/* Heatmap images are one gray pixel per address, a row per 256 byte page */
+#define HEATMAP_SIDE 256
+/* Addresses listed in the table written by write_heatmap() */
+#define HEATMAP_TABLE_ROWS 256
+/* Longest table line: address, three counts and a disassembled instruction */
+#define HEATMAP_LINE_MAX 96
+
+void render_heatmap(const u_int64_t*, u_int8_t*);
+size_t format_heatmap_table(const Heatmap*, const u_int8_t*, int, char*);
+int write_heatmap(const Heatmap*, const u_int8_t*, const char*);
+
+#endif
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "tools.h"
+#include "invaders.h"
+#include "movie.h"
+
+/*
+ *  Shift register
+ *
+ *  The board has no barrel shifter on the CPU side, so sprites are
+ *  shifted by dedicated hardware: OUT 4 pushes a byte into the high
+ *  half of a 16 bit register, OUT 2 sets an offset and IN 3 reads 8
+ *  bits starting offset bits from the top. The result is recomputed
+ *  on every OUT and latched into in_ports[3], so IN 3 takes the plain
+ *  latch path of read_port() with no call.
+ */
+
+static void update_shift_result(Invaders *invaders) {
+    invaders->chip->in_ports[INVADERS_PORT_SHIFT_RESULT] =
+        (invaders->shift_register >> (8 - invaders->shift_amount)) & 0xff;
+}
+
+static void out_shift_amount(Chip8080 *chip, u_int8_t port, u_int8_t value) {
+    Invaders *invaders = chip->machine;
+    invaders->shift_amount = value & 0x07;
+    update_shift_result(invaders);
+}
+
+static void out_shift_data(Chip8080 *chip, u_int8_t port, u_int8_t value) {
+    Invaders *invaders = chip->machine;
+    invaders->shift_register = (value << 8) | (invaders->shift_register >> 8);
+    update_shift_result(invaders);
+}
+
+/*
+ *  Sound
+ *
+ *  There is no audio output; the triggers are only logged, with the
+ *  cycle they happened at.
+ */
+
+static void out_sound(Chip8080 *chip, u_int8_t port, u_int8_t value) {
+    Invaders *invaders = chip->machine;
+    if (invaders->sound != NULL)
+        log_sound(invaders->sound, chip->cycles, port, value);
+}
+
+/*
+ *  Video interrupts
+ *
+ *  The video hardware interrupts twice per frame: RST 1 when the beam
+ *  reaches the middle of the screen and RST 2 at vblank, which is also
+ *  where a frame ends.
+ */
+
+static void mid_screen(Chip8080 *chip, void *context) {
+    generate_interrupt(chip, 1);
+}
+
+static void vblank(Chip8080 *chip, void *context) {
+    Invaders *invaders = context;
+    generate_interrupt(chip, 2);
+    invaders->frames++;
+}
+
+Invaders* make_invaders() {
+    Invaders *invaders = malloc(sizeof(Invaders));
+    invaders->chip = make_chip8080();
+    invaders->chip->machine = invaders;
+    set_port_handlers(invaders->chip, INVADERS_PORT_SHIFT_AMOUNT, NULL, out_shift_amount);
+    set_port_handlers(invaders->chip, INVADERS_PORT_SHIFT_DATA, NULL, out_shift_data);
+    set_port_handlers(invaders->chip, INVADERS_PORT_SOUND_1, NULL, out_sound);
+    set_port_handlers(invaders->chip, INVADERS_PORT_SOUND_2, NULL, out_sound);
+    invaders->sound = NULL;
+    invaders->movie = NULL;
+    reset_invaders(invaders);
+    return invaders;
+}
+
+void reset_invaders(Invaders *invaders) {
+    /* CPU reset plus power on state of the board; ROM and RAM are kept */
+    reset_chip_state(invaders->chip);
+    invaders->shift_register = 0;
+    invaders->shift_amount = 0;
+    update_shift_result(invaders);
+    invaders->chip->in_ports[INVADERS_PORT_INPUTS_0] = 0x0e;
+    invaders->chip->in_ports[INVADERS_PORT_INPUTS_1] = 0x08;
+    invaders->chip->in_ports[INVADERS_PORT_INPUTS_2] = 0x00;
+
+    invaders->frames = 0;
+    init_scheduler(&invaders->scheduler);
+    schedule_event(&invaders->scheduler, CYCLES_PER_FRAME / 2, CYCLES_PER_FRAME, mid_screen, invaders);
+    schedule_event(&invaders->scheduler, CYCLES_PER_FRAME, CYCLES_PER_FRAME, vblank, invaders);
+}
+
+RunStatus invaders_run_frame(Invaders *invaders) {
+    /* Runs up to and including the vblank interrupt of the next frame
+     * return RUN_BUDGET, or why the chip stopped early */
+    return run_scheduled(&invaders->scheduler, invaders->chip, (invaders->frames + 1) * CYCLES_PER_FRAME);
+}
+
+void destroy_invaders(Invaders *invaders) {
+    destroy_chip8080(invaders->chip);
+    free(invaders);
+}
+
+int load_invaders_rom(Invaders *invaders, const unsigned char *rom, size_t size) {
+    /* rom is the 8KB image (invaders.h, .g, .f and .e back to back)
+     * return 0, or -1 if it has the wrong size */
+    if (size != INVADERS_ROM_SIZE)
+        return -1;
+    load_memory(invaders->chip, rom, size, 0x0000);
+    return 0;
+}
+
+static void set_input(Invaders *invaders, u_int8_t port, u_int8_t value) {
+    /* Every input change goes through here, so a movie being recorded
+     * sees all of them */
+    if (invaders->movie != NULL)
+        movie_set_input(invaders->movie, invaders, port, value);
+    else
+        invaders->chip->in_ports[port] = value;
+}
+
+void invaders_key_down(Invaders *invaders, u_int8_t port, u_int8_t mask) {
+    set_input(invaders, port, invaders->chip->in_ports[port] | mask);
+}
+
+void invaders_key_up(Invaders *invaders, u_int8_t port, u_int8_t mask) {
+    set_input(invaders, port, invaders->chip->in_ports[port] & ~mask);
+}
+
+/*
+ *  Snapshots
+ *
+ *  A snapshot is only taken between frames, where the scheduler state
+ *  follows from the frame count, so the events are rebuilt rather than
+ *  saved.
+ */
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static void save_state_header(const Invaders *invaders, u_int8_t *out) {
+    const Chip8080 *chip = invaders->chip;
+    out[0] = chip->reg_a;
+    out[1] = chip->reg_b;
+    out[2] = chip->reg_c;
+    out[3] = chip->reg_d;
+    out[4] = chip->reg_e;
+    out[5] = chip->reg_h;
+    out[6] = chip->reg_l;
+    put_u16(out + 7, chip->reg_sp);
+    put_u16(out + 9, chip->reg_pc);
+    // Flags in PSW order: S Z 0 AC 0 P 1 CY
+    out[11] = (chip->flags.s << 7) | (chip->flags.z << 6) | (chip->flags.ac << 4)
+              | (chip->flags.p << 2) | 0x02 | chip->flags.cy;
+    out[12] = chip->irq_enable | (chip->halted << 1);
+    put_u64(out + 13, chip->cycles);
+    put_u16(out + 21, invaders->shift_register);
+    out[23] = invaders->shift_amount;
+    put_u64(out + 24, invaders->frames);
+}
+
+void save_invaders_state(const Invaders *invaders, u_int8_t *out) {
+    /* Fills out with INVADERS_SNAPSHOT_SIZE bytes of machine state */
+    save_state_header(invaders, out);
+    out += INVADERS_STATE_HEADER_SIZE;
+    memcpy(out, invaders->chip->in_ports, 256);
+    memcpy(out + 256, invaders->chip->out_ports, 256);
+    memcpy(out + 512, invaders->chip->memory, MAX_MEMORY);
+}
+
+void restore_invaders_state(Invaders *invaders, const u_int8_t *in) {
+    /* Loads a snapshot from save_invaders_state(); all memory is dirty */
+    Chip8080 *chip = invaders->chip;
+    chip->reg_a = in[0];
+    chip->reg_b = in[1];
+    chip->reg_c = in[2];
+    chip->reg_d = in[3];
+    chip->reg_e = in[4];
+    chip->reg_h = in[5];
+    chip->reg_l = in[6];
+    chip->reg_sp = get_u16(in + 7);
+    chip->reg_pc = get_u16(in + 9);
+    chip->flags.s = in[11] >> 7;
+    chip->flags.z = in[11] >> 6;
+    chip->flags.ac = in[11] >> 4;
+    chip->flags.p = in[11] >> 2;
+    chip->flags.cy = in[11];
+    chip->irq_enable = in[12] & 1;
+    chip->halted = (in[12] >> 1) & 1;
+    chip->cycles = get_u64(in + 13);
+    invaders->shift_register = get_u16(in + 21);
+    invaders->shift_amount = in[23] & 0x07;
+    invaders->frames = get_u64(in + 24);
+
+    in += INVADERS_STATE_HEADER_SIZE;
+    memcpy(chip->in_ports, in, 256);
+    memcpy(chip->out_ports, in + 256, 256);
+    memcpy(chip->memory, in + 512, MAX_MEMORY);
+    memset(chip->dirty, 0xff, DIRTY_BYTES);
+
+    u_int64_t frame_start = invaders->frames * CYCLES_PER_FRAME;
+    RunUntil run_until = invaders->scheduler.run_until;
+    init_scheduler(&invaders->scheduler);
+    invaders->scheduler.run_until = run_until;
+    schedule_event(&invaders->scheduler, frame_start + CYCLES_PER_FRAME / 2, CYCLES_PER_FRAME, mid_screen, invaders);
+    schedule_event(&invaders->scheduler, frame_start + CYCLES_PER_FRAME, CYCLES_PER_FRAME, vblank, invaders);
+}
+
+u_int64_t hash_invaders_state(const Invaders *invaders) {
+    /* FNV-1a of the snapshot header and the RAM. The ROM can't change
+     * and the port latches only matter once read into a register, so
+     * this is enough to catch a diverging replay within a frame or two
+     * at 8KB per frame */
+    u_int8_t header[INVADERS_STATE_HEADER_SIZE];
+    const u_int8_t *ram = &invaders->chip->memory[INVADERS_RAM];
+    u_int64_t hash = FNV_OFFSET_BASIS;
+
+    save_state_header(invaders, header);
+    for (int i = 0; i < INVADERS_STATE_HEADER_SIZE; i++)
+        hash = (hash ^ header[i]) * FNV_PRIME;
+    for (int i = 0; i < INVADERS_RAM_SIZE; i++)
+        hash = (hash ^ ram[i]) * FNV_PRIME;
+    return hash;
+}
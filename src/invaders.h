@@ -0,0 +1,77 @@
+#ifndef INVADERS_H
+#define INVADERS_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "scheduler.h"
+#include "sound.h"
+
+/* Space Invaders (Midway 8080) board: 8KB ROM at 0x0000, 1KB work RAM
+ * at 0x2000 and the 7KB video RAM at 0x2400 */
+#define INVADERS_ROM_SIZE 0x2000
+
+#define CPU_CLOCK_HZ 2000000
+#define FRAMES_PER_SECOND 60
+#define CYCLES_PER_FRAME (CPU_CLOCK_HZ / FRAMES_PER_SECOND)
+
+/* Ports read by IN */
+#define INVADERS_PORT_INPUTS_0 0
+#define INVADERS_PORT_INPUTS_1 1
+#define INVADERS_PORT_INPUTS_2 2
+#define INVADERS_PORT_SHIFT_RESULT 3
+
+/* Ports written by OUT */
+#define INVADERS_PORT_SHIFT_AMOUNT 2
+#define INVADERS_PORT_SOUND_1 3
+#define INVADERS_PORT_SHIFT_DATA 4
+#define INVADERS_PORT_SOUND_2 5
+#define INVADERS_PORT_WATCHDOG 6
+
+/* Port 1 bits */
+#define INVADERS_COIN 0x01
+#define INVADERS_P2_START 0x02
+#define INVADERS_P1_START 0x04
+#define INVADERS_P1_SHOT 0x10
+#define INVADERS_P1_LEFT 0x20
+#define INVADERS_P1_RIGHT 0x40
+
+/* Port 2 bits */
+#define INVADERS_TILT 0x04
+#define INVADERS_P2_SHOT 0x10
+#define INVADERS_P2_LEFT 0x20
+#define INVADERS_P2_RIGHT 0x40
+
+/* Machine state saved at a frame boundary: registers, flags, cycles,
+ * shift register and frame count, then the port latches and memory */
+#define INVADERS_STATE_HEADER_SIZE 32
+#define INVADERS_SNAPSHOT_SIZE (INVADERS_STATE_HEADER_SIZE + 2 * 256 + MAX_MEMORY)
+
+/* Work and video RAM, the memory hash_invaders_state() covers */
+#define INVADERS_RAM 0x2000
+#define INVADERS_RAM_SIZE 0x2000
+
+struct Movie;
+
+typedef struct Invaders {
+    Chip8080 *chip;
+    u_int16_t shift_register;   // Last two bytes written to port 4
+    u_int8_t shift_amount;      // Port 2, 0-7
+    Scheduler scheduler;        // RST 1 mid-screen and RST 2 at vblank
+    u_int64_t frames;           // Frames completed since reset
+    SoundLog *sound;            // Where OUT 3 and OUT 5 are logged, NULL for nowhere
+    struct Movie *movie;        // Where input changes are recorded, NULL for nowhere
+} Invaders;
+
+Invaders* make_invaders();
+void destroy_invaders(Invaders*);
+void reset_invaders(Invaders*);
+int load_invaders_rom(Invaders*, const unsigned char*, size_t);
+RunStatus invaders_run_frame(Invaders*);
+void invaders_key_down(Invaders*, u_int8_t, u_int8_t);
+void invaders_key_up(Invaders*, u_int8_t, u_int8_t);
+void save_invaders_state(const Invaders*, u_int8_t*);
+void restore_invaders_state(Invaders*, const u_int8_t*);
+u_int64_t hash_invaders_state(const Invaders*);
+
+#endif
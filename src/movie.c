@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "tools.h"
+#include "invaders.h"
+#include "movie.h"
+
+/*
+ *  Recording
+ *
+ *  Inputs are the latches of ports 1 and 2, so a movie only needs the
+ *  latch writes and when they happened; the rest of the run follows
+ *  from the snapshot because the machine is deterministic.
+ */
+
+Movie* make_movie() {
+    Movie *movie = calloc(1, sizeof(Movie));
+    movie->snapshot = malloc(INVADERS_SNAPSHOT_SIZE);
+    return movie;
+}
+
+void destroy_movie(Movie *movie) {
+    free(movie->snapshot);
+    free(movie->events);
+    free(movie->hashes);
+    free(movie);
+}
+
+void begin_movie(Movie *movie, const Invaders *invaders) {
+    /* Starts a new recording from the state of invaders, which must be
+     * between frames */
+    save_invaders_state(invaders, movie->snapshot);
+    movie->n_events = 0;
+    movie->n_frames = 0;
+}
+
+void movie_set_input(Movie *movie, Invaders *invaders, u_int8_t port, u_int8_t value) {
+    /* Sets an input latch of invaders and records it for the next frame */
+    if (movie->n_events == movie->events_capacity) {
+        movie->events_capacity = movie->events_capacity ? movie->events_capacity * 2 : 256;
+        movie->events = realloc(movie->events, movie->events_capacity * sizeof(MovieEvent));
+    }
+    movie->events[movie->n_events++] = (MovieEvent) {movie->n_frames, port, value};
+    invaders->chip->in_ports[port] = value;
+}
+
+void movie_end_frame(Movie *movie, const Invaders *invaders) {
+    /* Records the state hash once a frame has run */
+    if (movie->n_frames == movie->frames_capacity) {
+        movie->frames_capacity = movie->frames_capacity ? movie->frames_capacity * 2 : 3600;
+        movie->hashes = realloc(movie->hashes, movie->frames_capacity * sizeof(u_int64_t));
+    }
+    movie->hashes[movie->n_frames++] = hash_invaders_state(invaders);
+}
+
+/*
+ *  Files
+ */
+
+int save_movie(const Movie *movie, const char *path) {
+    /* return 0, or -1 if path can't be written */
+    u_int8_t header[MOVIE_HEADER_SIZE];
+    u_int8_t record[8];
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return -1;
+
+    memcpy(header, "I8MV", 4);
+    put_u16(header + 4, MOVIE_VERSION);
+    put_u16(header + 6, 0);
+    put_u32(header + 8, movie->n_events);
+    put_u32(header + 12, movie->n_frames);
+    fwrite(header, 1, sizeof(header), file);
+    fwrite(movie->snapshot, 1, INVADERS_SNAPSHOT_SIZE, file);
+    for (u_int32_t i = 0; i < movie->n_events; i++) {
+        put_u32(record, movie->events[i].frame);
+        record[4] = movie->events[i].port;
+        record[5] = movie->events[i].value;
+        fwrite(record, 1, MOVIE_EVENT_SIZE, file);
+    }
+    for (u_int32_t i = 0; i < movie->n_frames; i++) {
+        put_u64(record, movie->hashes[i]);
+        fwrite(record, 1, sizeof(u_int64_t), file);
+    }
+
+    int failed = ferror(file);
+    return (fclose(file) == 0 && !failed) ? 0 : -1;
+}
+
+Movie* load_movie(const char *path) {
+    /* return the movie, or NULL if path isn't a complete movie. The
+     * counts in the header must account for the whole file before
+     * anything is allocated for them */
+    u_int8_t header[MOVIE_HEADER_SIZE];
+    u_int8_t record[8];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+    long file_size = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        file_size = ftell(file);
+    if (file_size < 0 || fseek(file, 0, SEEK_SET) != 0
+        || fread(header, 1, sizeof(header), file) != sizeof(header)
+        || memcmp(header, "I8MV", 4) != 0
+        || get_u16(header + 4) != MOVIE_VERSION) {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t n_events = get_u32(header + 8);
+    size_t n_frames = get_u32(header + 12);
+    if ((u_int64_t) file_size != MOVIE_HEADER_SIZE + INVADERS_SNAPSHOT_SIZE
+                                 + (u_int64_t) n_events * MOVIE_EVENT_SIZE
+                                 + (u_int64_t) n_frames * sizeof(u_int64_t)) {
+        fclose(file);
+        return NULL;
+    }
+
+    Movie *movie = make_movie();
+    movie->n_events = movie->events_capacity = n_events;
+    movie->n_frames = movie->frames_capacity = n_frames;
+    movie->events = malloc((n_events + 1) * sizeof(MovieEvent));
+    movie->hashes = malloc((n_frames + 1) * sizeof(u_int64_t));
+
+    int ok = movie->snapshot != NULL && movie->events != NULL && movie->hashes != NULL
+             && fread(movie->snapshot, 1, INVADERS_SNAPSHOT_SIZE, file) == INVADERS_SNAPSHOT_SIZE;
+    for (size_t i = 0; ok && i < n_events; i++) {
+        ok = fread(record, 1, MOVIE_EVENT_SIZE, file) == MOVIE_EVENT_SIZE;
+        movie->events[i] = (MovieEvent) {get_u32(record), record[4], record[5]};
+        ok = ok && (i == 0 || movie->events[i].frame >= movie->events[i - 1].frame);
+    }
+    for (size_t i = 0; ok && i < n_frames; i++) {
+        ok = fread(record, 1, sizeof(u_int64_t), file) == sizeof(u_int64_t);
+        movie->hashes[i] = get_u64(record);
+    }
+    fclose(file);
+
+    if (!ok) {
+        destroy_movie(movie);
+        return NULL;
+    }
+    return movie;
+}
+
+/*
+ *  Replay
+ */
+
+long replay_movie(const Movie *movie, Invaders *invaders, u_int64_t *hashes, RunStatus *status) {
+    /* Restores the snapshot into invaders and runs every frame of the
+     * movie as fast as possible, feeding the recorded inputs through
+     * the port latches. hashes, when not NULL, gets the state hash of
+     * each frame. A frame that stops short of its end, at an opcode the
+     * core lacks for one, ends the replay; status, when not NULL, gets
+     * RUN_BUDGET or why it stopped
+     * return the first frame whose hash differs from the recording or
+     * that stopped short, or -1 if the replay matches */
+    u_int32_t event = 0;
+    long diverged = -1;
+    RunStatus frame_status = RUN_BUDGET;
+
+    restore_invaders_state(invaders, movie->snapshot);
+    for (u_int32_t frame = 0; frame < movie->n_frames; frame++) {
+        for (; event < movie->n_events && movie->events[event].frame == frame; event++)
+            invaders->chip->in_ports[movie->events[event].port] = movie->events[event].value;
+
+        frame_status = invaders_run_frame(invaders);
+
+        u_int64_t hash = hash_invaders_state(invaders);
+        if (hashes != NULL)
+            hashes[frame] = hash;
+        if (diverged < 0 && hash != movie->hashes[frame])
+            diverged = frame;
+        if (frame_status != RUN_BUDGET) {
+            if (diverged < 0)
+                diverged = frame;
+            break;
+        }
+    }
+    if (status != NULL)
+        *status = frame_status;
+    return diverged;
+}
@@ -0,0 +1,48 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "invaders.h"
+
+/*
+ *  Movie file (.i8mv), all integers little endian:
+ *
+ *  header    "I8MV", u16 version, u16 reserved, u32 events, u32 frames
+ *  snapshot  INVADERS_SNAPSHOT_SIZE bytes of starting state
+ *  events    u32 frame, u8 port, u8 value
+ *  hashes    u64 state hash after each frame
+ *
+ *  An event of frame f sets the input latch before frame f runs,
+ *  counting frames from the snapshot.
+ */
+#define MOVIE_VERSION 1
+#define MOVIE_HEADER_SIZE 16
+#define MOVIE_EVENT_SIZE 6
+
+typedef struct MovieEvent {
+    u_int32_t frame;
+    u_int8_t port;
+    u_int8_t value;
+} MovieEvent;
+
+typedef struct Movie {
+    u_int8_t *snapshot;
+    MovieEvent *events;
+    u_int32_t n_events;
+    u_int32_t events_capacity;
+    u_int64_t *hashes;
+    u_int32_t n_frames;
+    u_int32_t frames_capacity;
+} Movie;
+
+Movie* make_movie();
+void destroy_movie(Movie*);
+void begin_movie(Movie*, const Invaders*);
+void movie_set_input(Movie*, Invaders*, u_int8_t, u_int8_t);
+void movie_end_frame(Movie*, const Invaders*);
+int save_movie(const Movie*, const char*);
+Movie* load_movie(const char*);
+long replay_movie(const Movie*, Invaders*, u_int64_t*, RunStatus*);
+
+#endif
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/types.h>
+#include "pacing.h"
+
+static int64_t timespec_ns(const struct timespec *ts) {
+    return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static struct timespec deadline_of(const Pacer *pacer, u_int64_t frame) {
+    int64_t ns = timespec_ns(&pacer->start) + frame * NSEC_PER_SEC / pacer->frames_per_second;
+    return (struct timespec) {ns / NSEC_PER_SEC, ns % NSEC_PER_SEC};
+}
+
+void init_pacer(Pacer *pacer, u_int32_t frames_per_second, u_int32_t max_catch_up) {
+    /* Starts the timeline now, so the first frame is due one period
+     * from the call */
+    memset(pacer, 0, sizeof(Pacer));
+    pacer->frames_per_second = frames_per_second;
+    pacer->max_catch_up = max_catch_up;
+    clock_gettime(CLOCK_MONOTONIC, &pacer->start);
+}
+
+u_int64_t pace_frame(Pacer *pacer) {
+    /* Called once a frame has been emulated: sleeps until its deadline,
+     * or returns at once if it's late
+     * return the number of deadlines skipped to resync, normally 0 */
+    struct timespec deadline = deadline_of(pacer, ++pacer->frame);
+    struct timespec now;
+    u_int64_t skipped = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (timespec_ns(&now) < timespec_ns(&deadline)) {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+            ;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } else {
+        pacer->late++;
+    }
+
+    int64_t jitter = timespec_ns(&now) - timespec_ns(&deadline);
+    int64_t period = NSEC_PER_SEC / pacer->frames_per_second;
+    if (jitter > (int64_t) pacer->max_catch_up * period) {
+        skipped = jitter / period;
+        pacer->skipped += skipped;
+        pacer->start = now;
+        pacer->frame = 0;
+    }
+
+    pacer->jitter[pacer->frames % PACING_HISTORY] = jitter;
+    if (pacer->n_jitter < PACING_HISTORY)
+        pacer->n_jitter++;
+    pacer->frames++;
+    return skipped;
+}
+
+static int compare_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t*) a;
+    int64_t y = *(const int64_t*) b;
+    return (x > y) - (x < y);
+}
+
+void get_pacing_stats(const Pacer *pacer, PacingStats *stats) {
+    /* Percentiles are over the last PACING_HISTORY frames */
+    int64_t sorted[PACING_HISTORY];
+    u_int32_t n = pacer->n_jitter;
+
+    stats->frames = pacer->frames;
+    stats->late = pacer->late;
+    stats->skipped = pacer->skipped;
+    stats->p50_ns = stats->p99_ns = stats->max_ns = 0;
+    if (n == 0)
+        return;
+
+    memcpy(sorted, pacer->jitter, n * sizeof(int64_t));
+    qsort(sorted, n, sizeof(int64_t), compare_int64);
+    stats->p50_ns = sorted[(n - 1) * 50 / 100];
+    stats->p99_ns = sorted[(n - 1) * 99 / 100];
+    stats->max_ns = sorted[n - 1];
+}
@@ -0,0 +1,49 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdlib.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define NSEC_PER_SEC 1000000000LL
+/* Jitter samples kept for the percentiles, the last ~17s at 60Hz */
+#define PACING_HISTORY 1024
+/* Backlog, in frames, past which a late pacer resyncs (100ms at 60Hz) */
+#define DEFAULT_MAX_CATCH_UP 6
+
+/*
+ *  Frame pacing
+ *
+ *  Frame n of a run is due at start + n / frames_per_second, computed
+ *  from the frame count each time so rounding never accumulates. A
+ *  frame finished early sleeps until its deadline; a late one is
+ *  followed straight away by the next (catch up) until the backlog is
+ *  more than max_catch_up frames, then the pacer gives up on those
+ *  frames and restarts the timeline from now (skip).
+ */
+typedef struct Pacer {
+    struct timespec start;      // Deadline of frame 0 of the timeline
+    u_int64_t frame;            // Frames paced since start
+    u_int32_t frames_per_second;
+    u_int32_t max_catch_up;
+    u_int64_t frames;           // Frames paced in total
+    u_int64_t late;             // Frames emulated past their deadline
+    u_int64_t skipped;          // Deadlines given up by resyncing
+    int64_t jitter[PACING_HISTORY];     // ns past the deadline of recent frames
+    u_int32_t n_jitter;
+} Pacer;
+
+typedef struct PacingStats {
+    u_int64_t frames;
+    u_int64_t late;
+    u_int64_t skipped;
+    int64_t p50_ns;
+    int64_t p99_ns;
+    int64_t max_ns;
+} PacingStats;
+
+void init_pacer(Pacer*, u_int32_t, u_int32_t);
+u_int64_t pace_frame(Pacer*);
+void get_pacing_stats(const Pacer*, PacingStats*);
+
+#endif
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "tools.h"
+#include "flow.h"
+#include "recompile.h"
+#include "recompiled.h"
+
+/*
+ *  Static recompiler
+ *
+ *  The flow analysis finds the code reachable from reset and the RST
+ *  vectors. Basic blocks start at its labels, at the entry points and
+ *  after every instruction that ends a block; each becomes a C function
+ *  over the macros of recompiled.h. Only opcodes the interpreter has are
+ *  translated, anything else ends the block so that run8080() handles it
+ *  the way it always would.
+ */
+
+enum emitted { EMIT_NONE = -1, EMIT_NEXT, EMIT_END };
+
+static const char *reg_name[8] = {"b", "c", "d", "e", "h", "l", NULL, "a"};
+static const char *pair_hi[3] = {"b", "d", "h"};
+static const char *pair_lo[3] = {"c", "e", "l"};
+static const char *condition[8] = {"!z", "z", "!cy", "cy", "!p", "p", "!s", "s"};
+
+static void read_reg(int r, char *expr) {
+    if (r == 6)
+        strcpy(expr, "mem[PAIR(h, l)]");
+    else
+        strcpy(expr, reg_name[r]);
+}
+
+static void read_pair(int rp, char *expr) {
+    if (rp == 3)
+        strcpy(expr, "sp");
+    else
+        sprintf(expr, "PAIR(%s, %s)", pair_hi[rp], pair_lo[rp]);
+}
+
+static void jump_to(char *out, u_int16_t target, const u_int16_t *body, int n) {
+    /* Jumps to an instruction of the block stay in it; anywhere else,
+     * the middle of one included, leaves it */
+    for (int i = 0; i < n; i++) {
+        if (body[i] == target) {
+            sprintf(out, "BLOCK_GOTO(0x%04x, i_%04x);", target, target);
+            return;
+        }
+    }
+    sprintf(out, "BLOCK_EXIT(0x%04x);", target);
+}
+
+static enum emitted emit_instruction(const unsigned char *rom, int pc, int size,
+                                     const u_int16_t *body, int n, char *line) {
+    /* Writes the C for the instruction at pc, in the block of the n
+     * instructions at body (NULL while the blocks are found), to line (at most
+     * RECOMPILE_LINE_MAX chars), ending with its cycles and the exits
+     * return whether it goes on to the next instruction, ends the block
+     * or can't be translated (line is then unused) */
+    u_int8_t op = rom[pc];
+    int len = opcode_table[op].size;
+    if (!implemented_opcodes[op] || pc + len > size)
+        return EMIT_NONE;
+
+    u_int8_t byte2 = len > 1 ? rom[pc + 1] : 0;
+    u_int16_t addr = len > 2 ? rom[pc + 2] << 8 | byte2 : 0;
+    u_int16_t next = pc + len;
+    int r = (op >> 3) & 7;
+    int rp = (op >> 4) & 3;
+    int cycles = opcode_cycles[op];
+    char src[32], pair[32], jump[64];
+    char *out = line;
+
+    if ((op & 0xc7) == 0x00) {                          // NOP and its copies
+    } else if ((op & 0xcf) == 0x01) {                   // LXI rp,d16
+        if (rp == 3)
+            out += sprintf(out, "sp = 0x%04x; ", addr);
+        else
+            out += sprintf(out, "%s = 0x%02x; %s = 0x%02x; ", pair_hi[rp], addr >> 8, pair_lo[rp], addr & 0xff);
+    } else if (op == 0x02 || op == 0x12) {              // STAX B, STAX D
+        read_pair(rp, pair);
+        out += sprintf(out, "write_memory(chip, %s, a); ", pair);
+    } else if (op == 0x0a || op == 0x1a) {              // LDAX B, LDAX D
+        read_pair(rp, pair);
+        out += sprintf(out, "a = mem[%s]; ", pair);
+    } else if ((op & 0xcf) == 0x03) {                   // INX rp
+        if (rp == 3)
+            out += sprintf(out, "sp++; ");
+        else
+            out += sprintf(out, "if (++%s == 0) %s++; ", pair_lo[rp], pair_hi[rp]);
+    } else if ((op & 0xcf) == 0x0b) {                   // DCX rp
+        if (rp == 3)
+            out += sprintf(out, "sp--; ");
+        else
+            out += sprintf(out, "if (%s-- == 0) %s--; ", pair_lo[rp], pair_hi[rp]);
+    } else if ((op & 0xc7) == 0x04 || (op & 0xc7) == 0x05) {   // INR r, DCR r
+        int inr = (op & 0xc7) == 0x04;
+        const char *ac = inr ? "(v & 0x0f) == 0x00" : "(v & 0x0f) != 0x0f";
+        read_reg(r, src);
+        if (r == 6)
+            out += sprintf(out, "{ u_int8_t v = %s %c 1; write_memory(chip, PAIR(h, l), v); ", src, inr ? '+' : '-');
+        else
+            out += sprintf(out, "{ u_int8_t v = %s%s; ", inr ? "++" : "--", src);
+        out += sprintf(out, "SET_ZSP(v); ac = %s; } ", ac);
+    } else if ((op & 0xc7) == 0x06) {                   // MVI r,d8
+        if (r == 6)
+            out += sprintf(out, "write_memory(chip, PAIR(h, l), 0x%02x); ", byte2);
+        else
+            out += sprintf(out, "%s = 0x%02x; ", reg_name[r], byte2);
+    } else if ((op & 0xcf) == 0x09) {                   // DAD rp
+        read_pair(rp, pair);
+        out += sprintf(out, "{ u_int32_t v = PAIR(h, l) + %s; h = v >> 8; l = v; cy = v > 0xffff; } ", pair);
+    } else if (op == 0x22) {                            // SHLD addr
+        out += sprintf(out, "write_memory(chip, 0x%04x, l); write_memory(chip, 0x%04x, h); ",
+                       addr, (u_int16_t) (addr + 1));
+    } else if (op == 0x2a) {                            // LHLD addr
+        out += sprintf(out, "l = mem[0x%04x]; h = mem[0x%04x]; ", addr, (u_int16_t) (addr + 1));
+    } else if (op == 0x2f) {                            // CMA
+        out += sprintf(out, "a = ~a; ");
+    } else if (op == 0x32) {                            // STA addr
+        out += sprintf(out, "write_memory(chip, 0x%04x, a); ", addr);
+    } else if (op == 0x3a) {                            // LDA addr
+        out += sprintf(out, "a = mem[0x%04x]; ", addr);
+    } else if (op == 0x37) {                            // STC
+        out += sprintf(out, "cy = 1; ");
+    } else if (op == 0x3f) {                            // CMC
+        out += sprintf(out, "cy = !cy; ");
+    } else if (op == 0x76) {                            // HLT
+        sprintf(out, "chip->halted = 1; cycles += %d; BLOCK_EXIT(0x%04x);", cycles, next);
+        return EMIT_END;
+    } else if ((op & 0xf8) == 0xa0) {                   // ANA r
+        read_reg(op & 7, src);
+        out += sprintf(out, "{ u_int8_t v = %s; ac = ((a | v) >> 3) & 1; a &= v; SET_ZSP(a); cy = 0; } ", src);
+    } else if ((op & 0xc7) == 0xc2) {                   // Jcc addr
+        jump_to(jump, addr, body, n);
+        sprintf(out, "cycles += %d; if (%s) %s BLOCK_EXIT(0x%04x);", cycles, condition[r], jump, next);
+        return EMIT_END;
+    } else if (op == 0xc3 || op == 0xcb) {              // JMP addr
+        jump_to(jump, addr, body, n);
+        sprintf(out, "cycles += %d; %s", cycles, jump);
+        return EMIT_END;
+    } else if (op == 0xd3) {                            // OUT d8, handlers see the machine as is
+        out += sprintf(out, "SPILL(chip, 0x%04x); write_port(chip, 0x%02x, a); RELOAD(chip); ", pc, byte2);
+    } else if (op == 0xdb) {                            // IN d8
+        out += sprintf(out, "SPILL(chip, 0x%04x); chip->reg_a = read_port(chip, 0x%02x); RELOAD(chip); ", pc, byte2);
+    } else if (op == 0xf3) {                            // DI
+        out += sprintf(out, "chip->irq_enable = 0; ");
+    } else if (op == 0xfb) {                            // EI
+        out += sprintf(out, "chip->irq_enable = 1; ");
+    } else if (op == 0xfe) {                            // CPI d8, AC from A + ~d8 + 1
+        out += sprintf(out, "{ u_int8_t v = a - 0x%02x; SET_ZSP(v); cy = a < 0x%02x; ac = (a & 0x0f) + %d > 0x0f; } ",
+                       byte2, byte2, (~byte2 & 0x0f) + 1);
+    } else {
+        return EMIT_NONE;
+    }
+    sprintf(out, "STEP(%d, 0x%04x);", cycles, next);
+    return EMIT_NEXT;
+}
+
+static void find_leaders(const unsigned char *rom, int size, const FlowMap *map, u_int8_t *leader) {
+    /* Marks where blocks start: labels, entry points and whatever follows
+     * an instruction that ends a block or is left to the interpreter */
+    char line[RECOMPILE_LINE_MAX];
+
+    memset(leader, 0, BITMAP_BYTES);
+    for (int i = 0; i < 9; i++)
+        bitmap_set(leader, default_entry_points[i]);
+    for (int pc = 0; pc < size; pc++) {
+        if (!bitmap_test(map->start, pc))
+            continue;
+        if (bitmap_test(map->label, pc))
+            bitmap_set(leader, pc);
+        if (emit_instruction(rom, pc, size, NULL, 0, line) != EMIT_NEXT && pc + opcode_table[rom[pc]].size < size)
+            bitmap_set(leader, pc + opcode_table[rom[pc]].size);
+    }
+}
+
+static void write_name(const char *name, FILE *out) {
+    /* The file name alone, safe inside a C string */
+    const char *base = strrchr(name, '/');
+    for (base = base != NULL ? base + 1 : name; *base != '\0'; base++)
+        fputc(*base == '"' || *base == '\\' || *base < ' ' ? '_' : *base, out);
+}
+
+static int block_body(const unsigned char *rom, int size, const FlowMap *map,
+                      const u_int8_t *leader, int start, u_int16_t *body) {
+    /* Fills body with the addresses of the translatable instructions of
+     * the block at start
+     * return how many there are */
+    char line[RECOMPILE_LINE_MAX];
+    int n = 0;
+
+    for (int pc = start; pc < size && bitmap_test(map->start, pc) && (pc == start || !bitmap_test(leader, pc));
+         pc += opcode_table[rom[pc]].size) {
+        enum emitted emitted = emit_instruction(rom, pc, size, NULL, 0, line);
+        if (emitted == EMIT_NONE)
+            break;
+        body[n++] = pc;
+        if (emitted == EMIT_END)
+            break;
+    }
+    return n;
+}
+
+int recompile_rom(const unsigned char *rom, int size, const char *name, FILE *out) {
+    /* Writes the C translation of rom (at most 64KB, loaded at 0x0000)
+     * to out; it defines recompiled_rom for recompiled.c. A block can be
+     * entered at any of its instructions, so runs stopped at a deadline
+     * resume in it rather than in the interpreter
+     * return the number of blocks, or -1 if out couldn't be written */
+    FlowMap *map = malloc(sizeof(FlowMap));
+    u_int8_t *leader = malloc(BITMAP_BYTES);
+    u_int16_t *body = malloc(ADDRESS_SPACE * sizeof(u_int16_t));
+    u_int16_t *block_of = malloc(ADDRESS_SPACE * sizeof(u_int16_t));
+    u_int8_t *entry = calloc(BITMAP_BYTES, 1);
+    char line[RECOMPILE_LINE_MAX];
+    char disasm[DISASM_LINE_MAX];
+    int n_blocks = 0;
+    int n_entries = 0;
+    int len;
+
+    if (size > ADDRESS_SPACE)
+        size = ADDRESS_SPACE;
+    analyze_flow(rom, size, default_entry_points, 9, map);
+    find_leaders(rom, size, map, leader);
+
+    fprintf(out, "/* Generated by `emulator recompile` from ");
+    write_name(name, out);
+    fprintf(out, "; do not edit */\n#include \"recompiled.h\"\n");
+
+    for (int start = 0; start < size; start++) {
+        if (!bitmap_test(leader, start) || !bitmap_test(map->start, start))
+            continue;
+        int n = block_body(rom, size, map, leader, start, body);
+        if (n == 0)
+            continue;
+
+        n_blocks++;
+        fprintf(out, "\nstatic void block_%04x(Chip8080 *chip, u_int64_t deadline) {\n", start);
+        fprintf(out, "    BLOCK_ENTER(chip);\n");
+        if (n > 1) {
+            fprintf(out, "    switch (chip->reg_pc) {\n");
+            for (int i = 1; i < n; i++)
+                fprintf(out, "        case 0x%04x: goto i_%04x;\n", body[i], body[i]);
+            fprintf(out, "    }\n");
+        }
+        for (int i = 0; i < n; i++) {
+            enum emitted emitted = emit_instruction(rom, body[i], size, body, n, line);
+            format_instruction(rom, body[i], size, disasm, &len);
+            disasm[len - 1] = '\0';
+            fprintf(out, "i_%04x: /* %s */\n    %s\n", body[i], disasm, line);
+            if (emitted == EMIT_NEXT && i == n - 1)
+                fprintf(out, "    BLOCK_EXIT(0x%04x);\n", (body[i] + opcode_table[rom[body[i]]].size) & 0xffff);
+            // Overlapping decodes can put an address in two blocks; either
+            // runs it, and the first one found is listed
+            if (!bitmap_test(entry, body[i])) {
+                bitmap_set(entry, body[i]);
+                block_of[body[i]] = start;
+                n_entries++;
+            }
+        }
+        fprintf(out, "    BLOCK_LEAVE(chip);\n}\n");
+    }
+
+    fprintf(out, "\nstatic const RecompiledEntry entries[] = {\n");
+    for (int pc = 0; pc < size; pc++)
+        if (bitmap_test(entry, pc))
+            fprintf(out, "    {0x%04x, block_%04x},\n", pc, block_of[pc]);
+    if (n_entries == 0)
+        fprintf(out, "    {0x0000, NULL},\n");
+    fprintf(out, "};\n\nconst RecompiledRom recompiled_rom = {\"");
+    write_name(name, out);
+    fprintf(out, "\", %d, 0x%016llxULL, entries, %d, %d};\n",
+            size, (unsigned long long) hash_rom(rom, size), n_entries, n_blocks);
+
+    free(entry);
+    free(block_of);
+    free(body);
+    free(leader);
+    free(map);
+    return ferror(out) ? -1 : n_blocks;
+}
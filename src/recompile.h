@@ -0,0 +1,13 @@
+#ifndef RECOMPILE_H
+#define RECOMPILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+/* Longest C statement emitted for one instruction */
+#define RECOMPILE_LINE_MAX 256
+
+int recompile_rom(const unsigned char*, int, const char*, FILE*);
+
+#endif
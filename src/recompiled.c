@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "recompiled.h"
+
+RecompiledStats recompiled_stats;
+
+/* Block function of every address, filled in by install_recompiled() */
+static BlockFunction block_at[MAX_MEMORY];
+
+u_int64_t hash_rom(const u_int8_t *rom, int size) {
+    /* FNV-1a, to tell whether memory holds the ROM a file was made from */
+    u_int64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < size; i++)
+        hash = (hash ^ rom[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+int install_recompiled(const RecompiledRom *rom, const Chip8080 *chip) {
+    /* Makes run_recompiled_until() use the blocks of rom
+     * return 0, or -1 if chip's memory doesn't start with that ROM */
+    if (rom->size > MAX_MEMORY || hash_rom(chip->memory, rom->size) != rom->hash)
+        return -1;
+    memset(block_at, 0, sizeof(block_at));
+    for (int i = 0; i < rom->n_entries; i++)
+        block_at[rom->entries[i].address] = rom->entries[i].run;
+    memset(&recompiled_stats, 0, sizeof(recompiled_stats));
+    return 0;
+}
+
+RunStatus run_recompiled_until(Chip8080 *chip, u_int64_t deadline) {
+    /* Drop-in for run8080_until(): runs the installed blocks, and the
+     * interpreter where there are none, until the cycle counter reaches
+     * deadline. Blocks assume the ROM is never written to.
+     * return the same status run8080_until() would. Blocks don't check
+     * breakpoints, so a chip with a debugger is only interpreted */
+    if (chip->debug != NULL)
+        return run8080_until(chip, deadline);
+    while (chip->cycles < deadline) {
+        if (chip->halted) {
+            chip->cycles = deadline;
+            break;
+        }
+        BlockFunction block = block_at[chip->reg_pc];
+        if (block != NULL) {
+            block(chip, deadline);
+            recompiled_stats.blocks++;
+        } else {
+            if (run8080(chip) == RUN_UNIMPLEMENTED)
+                return RUN_UNIMPLEMENTED;
+            recompiled_stats.fallbacks++;
+        }
+    }
+    return is_parked(chip) ? RUN_HALTED : RUN_BUDGET;
+}
@@ -0,0 +1,98 @@
+#ifndef RECOMPILED_H
+#define RECOMPILED_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+
+/*
+ *  Runtime of statically recompiled ROMs
+ *
+ *  `emulator recompile` turns a ROM into C with one function per basic
+ *  block (see recompile.c), which can be entered at any of its
+ *  instructions. A block keeps the 8080 registers in locals, runs its
+ *  instructions with the same cycle counts as the interpreter and leaves
+ *  as soon as the deadline is reached, so the machine goes through
+ *  exactly the states run8080_until() would. Addresses without a block,
+ *  and instructions the translator left out, are interpreted.
+ */
+
+typedef void (*BlockFunction)(Chip8080*, u_int64_t);
+
+/* The block function running the instruction at address */
+typedef struct RecompiledEntry {
+    u_int16_t address;
+    BlockFunction run;
+} RecompiledEntry;
+
+/* What a generated file defines, as recompiled_rom */
+typedef struct RecompiledRom {
+    const char *name;               // ROM file it was generated from
+    int size;                       // bytes of the ROM, loaded at 0x0000
+    u_int64_t hash;                 // FNV-1a of those bytes
+    const RecompiledEntry *entries; // sorted by address
+    int n_entries;
+    int n_blocks;
+} RecompiledRom;
+
+typedef struct RecompiledStats {
+    u_int64_t blocks;               // block functions run
+    u_int64_t fallbacks;            // instructions interpreted instead
+} RecompiledStats;
+
+extern const RecompiledRom recompiled_rom;
+extern RecompiledStats recompiled_stats;
+
+u_int64_t hash_rom(const u_int8_t*, int);
+int install_recompiled(const RecompiledRom*, const Chip8080*);
+RunStatus run_recompiled_until(Chip8080*, u_int64_t);
+
+/*
+ *  Used by the generated blocks
+ */
+
+static inline u_int8_t parity8(u_int8_t x) {
+    x ^= x >> 4;
+    x ^= x >> 2;
+    x ^= x >> 1;
+    return !(x & 1);
+}
+
+#define PAIR(x, y) ((u_int16_t) (((x) << 8) | (y)))
+#define SET_ZSP(v) (z = (v) == 0, s = (v) >> 7, p = parity8(v))
+
+#define BLOCK_ENTER(chip) \
+    u_int8_t *mem = (chip)->memory; \
+    u_int8_t a = (chip)->reg_a, b = (chip)->reg_b, c = (chip)->reg_c, d = (chip)->reg_d; \
+    u_int8_t e = (chip)->reg_e, h = (chip)->reg_h, l = (chip)->reg_l; \
+    u_int16_t sp = (chip)->reg_sp, next_pc; \
+    u_int8_t s = (chip)->flags.s, z = (chip)->flags.z, ac = (chip)->flags.ac; \
+    u_int8_t p = (chip)->flags.p, cy = (chip)->flags.cy; \
+    u_int64_t cycles = (chip)->cycles
+
+/* Writes the locals back, for the exit and around port handlers */
+#define SPILL(chip, pc) do { \
+    (chip)->reg_a = a; (chip)->reg_b = b; (chip)->reg_c = c; (chip)->reg_d = d; \
+    (chip)->reg_e = e; (chip)->reg_h = h; (chip)->reg_l = l; (chip)->reg_sp = sp; \
+    (chip)->flags.s = s; (chip)->flags.z = z; (chip)->flags.ac = ac; \
+    (chip)->flags.p = p; (chip)->flags.cy = cy; \
+    (chip)->cycles = cycles; (chip)->reg_pc = (pc); \
+} while (0)
+
+#define RELOAD(chip) do { \
+    a = (chip)->reg_a; b = (chip)->reg_b; c = (chip)->reg_c; d = (chip)->reg_d; \
+    e = (chip)->reg_e; h = (chip)->reg_h; l = (chip)->reg_l; sp = (chip)->reg_sp; \
+    s = (chip)->flags.s; z = (chip)->flags.z; ac = (chip)->flags.ac; \
+    p = (chip)->flags.p; cy = (chip)->flags.cy; cycles = (chip)->cycles; \
+} while (0)
+
+#define BLOCK_EXIT(pc) do { next_pc = (pc); goto exit; } while (0)
+#define BLOCK_LEAVE(chip) exit: SPILL(chip, next_pc)
+
+/* A jump back into the same block, unless the deadline came first */
+#define BLOCK_GOTO(pc, label) do { if (cycles >= deadline) BLOCK_EXIT(pc); goto label; } while (0)
+
+/* Accounts an instruction and stops where run8080_until() would */
+#define STEP(n, next) do { cycles += (n); if (cycles >= deadline) BLOCK_EXIT(next); } while (0)
+
+#endif
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "tools.h"
+#include "video.h"
+#include "recorder.h"
+
+#define FILE_BUFFER_SIZE (1 << 20)
+
+/*
+ *  Encoder
+ */
+
+Recorder* open_recorder(const char *path, int keyframe_interval) {
+    /* Creates path and writes the header
+     * return the recorder, or NULL if path can't be created */
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return NULL;
+    setvbuf(file, NULL, _IOFBF, FILE_BUFFER_SIZE);
+
+    Recorder *recorder = malloc(sizeof(Recorder));
+    recorder->file = file;
+    recorder->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : DEFAULT_KEYFRAME_INTERVAL;
+    recorder->keyframe_offsets = NULL;
+    recorder->n_keyframes = 0;
+    recorder->n_frames = 0;
+    memset(recorder->previous, 0, sizeof(recorder->previous));
+
+    u_int8_t header[RECORDER_HEADER_SIZE];
+    memcpy(header, "I8VR", 4);
+    put_u16(header + 4, RECORDER_VERSION);
+    put_u16(header + 6, VIDEO_WIDTH);
+    put_u16(header + 8, VIDEO_HEIGHT);
+    put_u16(header + 10, recorder->keyframe_interval);
+    fwrite(header, 1, sizeof(header), file);
+    recorder->offset = sizeof(header);
+    return recorder;
+}
+
+static size_t encode_delta(const u_int8_t *vram, u_int8_t *previous,
+                           const u_int8_t *lines, u_int8_t *out) {
+    /* XORs vram against previous (which becomes vram) and run length
+     * encodes the result into out. Lines not set in lines are taken
+     * as unchanged without looking at them.
+     * return the payload length */
+    size_t len = 0;
+    size_t literal = 0;     // position of the open literal token, 0 if none
+    int zeros = 0;
+
+    for (int x = 0; x < VIDEO_WIDTH; x++) {
+        if (lines != NULL && !((lines[x >> 3] >> (x & 7)) & 1)) {
+            zeros += VIDEO_LINE_BYTES;
+            continue;
+        }
+        for (int i = x * VIDEO_LINE_BYTES; i < (x + 1) * VIDEO_LINE_BYTES; i++) {
+            u_int8_t delta = vram[i] ^ previous[i];
+            previous[i] = vram[i];
+            if (delta == 0) {
+                zeros++;
+                continue;
+            }
+            for (; zeros > 0; zeros -= 128) {
+                out[len++] = (zeros > 128 ? 128 : zeros) - 1;
+                literal = 0;
+            }
+            zeros = 0;
+            if (literal == 0 || out[literal - 1] == 0xff) {
+                out[len++] = 0x80;
+                literal = len;
+            } else {
+                out[literal - 1]++;
+            }
+            out[len++] = delta;
+        }
+    }
+    return len;
+}
+
+int record_frame(Recorder *recorder, const u_int8_t *memory, const u_int8_t *lines) {
+    /* Appends the video RAM in memory as the next frame; lines are the
+     * dirty video lines since the previous frame (NULL for all)
+     * return 0, or -1 on a write error */
+    int keyframe = recorder->n_frames % recorder->keyframe_interval == 0;
+
+    if (keyframe) {
+        recorder->keyframe_offsets = realloc(recorder->keyframe_offsets,
+                                             (recorder->n_keyframes + 1) * sizeof(u_int64_t));
+        recorder->keyframe_offsets[recorder->n_keyframes++] = recorder->offset;
+        memset(recorder->previous, 0, sizeof(recorder->previous));
+        lines = NULL;
+    }
+
+    u_int8_t *payload = recorder->payload + RECORDER_FRAME_HEADER_SIZE;
+    size_t len = encode_delta(memory + VIDEO_RAM, recorder->previous, lines, payload);
+    recorder->payload[0] = keyframe;
+    put_u32(recorder->payload + 1, len);
+
+    len += RECORDER_FRAME_HEADER_SIZE;
+    if (fwrite(recorder->payload, 1, len, recorder->file) != len)
+        return -1;
+    recorder->offset += len;
+    recorder->n_frames++;
+    return 0;
+}
+
+int close_recorder(Recorder *recorder) {
+    /* Writes the keyframe index and closes the file
+     * return 0, or -1 on a write error */
+    int status = 0;
+    u_int8_t entry[8];
+
+    for (u_int32_t i = 0; i < recorder->n_keyframes; i++) {
+        put_u64(entry, recorder->keyframe_offsets[i]);
+        if (fwrite(entry, 1, sizeof(entry), recorder->file) != sizeof(entry))
+            status = -1;
+    }
+    u_int8_t trailer[RECORDER_TRAILER_SIZE];
+    put_u32(trailer, recorder->n_keyframes);
+    put_u32(trailer + 4, recorder->n_frames);
+    memcpy(trailer + 8, "I8IX", 4);
+    if (fwrite(trailer, 1, sizeof(trailer), recorder->file) != sizeof(trailer))
+        status = -1;
+    if (fclose(recorder->file) != 0)
+        status = -1;
+
+    free(recorder->keyframe_offsets);
+    free(recorder);
+    return status;
+}
+
+/*
+ *  Decoder
+ */
+
+Playback* open_playback(const char *path) {
+    /* Opens a capture file and loads its index
+     * return the playback, or NULL if it isn't a complete capture */
+    u_int8_t header[RECORDER_HEADER_SIZE];
+    u_int8_t trailer[RECORDER_TRAILER_SIZE];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)
+        || memcmp(header, "I8VR", 4) != 0
+        || get_u16(header + 4) != RECORDER_VERSION
+        || get_u16(header + 6) != VIDEO_WIDTH
+        || get_u16(header + 8) != VIDEO_HEIGHT
+        || get_u16(header + 10) == 0
+        || fseek(file, -RECORDER_TRAILER_SIZE, SEEK_END) != 0
+        || fread(trailer, 1, sizeof(trailer), file) != sizeof(trailer)
+        || memcmp(trailer + 8, "I8IX", 4) != 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    Playback *playback = malloc(sizeof(Playback));
+    playback->file = file;
+    playback->keyframe_interval = get_u16(header + 10);
+    playback->n_keyframes = get_u32(trailer);
+    playback->n_frames = get_u32(trailer + 4);
+    playback->next_frame = 0;
+    playback->memory = calloc(MAX_MEMORY, 1);
+    playback->keyframe_offsets = malloc((playback->n_keyframes + 1) * sizeof(u_int64_t));
+
+    long index_size = playback->n_keyframes * 8L + RECORDER_TRAILER_SIZE;
+    int ok = fseek(file, -index_size, SEEK_END) == 0;
+    for (u_int32_t i = 0; ok && i < playback->n_keyframes; i++) {
+        u_int8_t entry[8];
+        ok = fread(entry, 1, sizeof(entry), file) == sizeof(entry);
+        playback->keyframe_offsets[i] = get_u64(entry);
+    }
+    if (!ok || fseek(file, RECORDER_HEADER_SIZE, SEEK_SET) != 0) {
+        close_playback(playback);
+        return NULL;
+    }
+    return playback;
+}
+
+int read_frame(Playback *playback) {
+    /* Decodes the next frame into playback->memory
+     * return 0, or -1 past the last frame or on a corrupt file */
+    u_int8_t header[RECORDER_FRAME_HEADER_SIZE];
+    u_int8_t *vram = playback->memory + VIDEO_RAM;
+
+    if (playback->next_frame >= playback->n_frames
+        || fread(header, 1, sizeof(header), playback->file) != sizeof(header))
+        return -1;
+    u_int32_t len = get_u32(header + 1);
+    if (len > MAX_PAYLOAD_SIZE || fread(playback->payload, 1, len, playback->file) != len)
+        return -1;
+
+    if (header[0] & 1)
+        memset(vram, 0, VIDEO_RAM_SIZE);
+    for (u_int32_t i = 0, pos = 0; i < len;) {
+        u_int8_t token = playback->payload[i++];
+        if (token < 0x80) {
+            pos += token + 1;
+            continue;
+        }
+        for (int n = token - 0x7f; n > 0 && i < len && pos < VIDEO_RAM_SIZE; n--)
+            vram[pos++] ^= playback->payload[i++];
+    }
+    playback->next_frame++;
+    return 0;
+}
+
+int seek_frame(Playback *playback, u_int32_t frame) {
+    /* Positions playback so the next read_frame() decodes frame,
+     * starting from the keyframe at or before it
+     * return 0, or -1 if frame is out of range */
+    if (frame >= playback->n_frames)
+        return -1;
+    u_int32_t keyframe = frame / playback->keyframe_interval;
+    if (keyframe >= playback->n_keyframes
+        || fseek(playback->file, playback->keyframe_offsets[keyframe], SEEK_SET) != 0)
+        return -1;
+
+    playback->next_frame = keyframe * playback->keyframe_interval;
+    while (playback->next_frame < frame)
+        if (read_frame(playback) < 0)
+            return -1;
+    return 0;
+}
+
+void close_playback(Playback *playback) {
+    fclose(playback->file);
+    free(playback->keyframe_offsets);
+    free(playback->memory);
+    free(playback);
+}
+
+int write_pgm(const char *path, const u_int8_t *frame) {
+    /* Writes a gray VIDEO_WIDTH x VIDEO_HEIGHT frame as a binary PGM
+     * return 0, or -1 on error */
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return -1;
+    fprintf(file, "P5\n%d %d\n255\n", VIDEO_WIDTH, VIDEO_HEIGHT);
+    size_t written = fwrite(frame, 1, VIDEO_WIDTH * VIDEO_HEIGHT, file);
+    return (fclose(file) == 0 && written == VIDEO_WIDTH * VIDEO_HEIGHT) ? 0 : -1;
+}
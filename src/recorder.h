@@ -0,0 +1,62 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include "video.h"
+
+/*
+ *  Frame capture file (.i8vr), all integers little endian:
+ *
+ *  header    "I8VR", u16 version, u16 width, u16 height, u16 keyframe interval
+ *  frames    u8 flags (1 = keyframe), u32 payload length, payload
+ *  index     u64 file offset of every keyframe
+ *  trailer   u32 keyframes, u32 frames, "I8IX"
+ *
+ *  A payload is the video RAM XORed with the previous frame (with zeros
+ *  for a keyframe), run length encoded: a token t < 0x80 skips t+1
+ *  unchanged bytes, t >= 0x80 is followed by t-0x7f literal XOR bytes.
+ *  Trailing unchanged bytes are left out, so an idle frame is empty.
+ */
+#define RECORDER_VERSION 1
+#define RECORDER_HEADER_SIZE 12
+#define RECORDER_TRAILER_SIZE 12
+#define RECORDER_FRAME_HEADER_SIZE 5
+#define DEFAULT_KEYFRAME_INTERVAL 600
+/* Worst case of the encoding: changed and unchanged bytes alternating,
+ * each changed byte costing a skip token, a literal token and itself */
+#define MAX_PAYLOAD_SIZE (VIDEO_RAM_SIZE * 3 / 2)
+
+typedef struct Recorder {
+    FILE *file;
+    u_int8_t previous[VIDEO_RAM_SIZE];
+    u_int8_t payload[RECORDER_FRAME_HEADER_SIZE + MAX_PAYLOAD_SIZE];
+    u_int64_t offset;
+    u_int64_t *keyframe_offsets;
+    u_int32_t n_keyframes;
+    u_int32_t n_frames;
+    int keyframe_interval;
+} Recorder;
+
+typedef struct Playback {
+    FILE *file;
+    u_int8_t *memory;           // MAX_MEMORY bytes, the frame is at VIDEO_RAM
+    u_int8_t payload[MAX_PAYLOAD_SIZE];
+    u_int64_t *keyframe_offsets;
+    u_int32_t n_keyframes;
+    u_int32_t n_frames;
+    u_int32_t next_frame;
+    int keyframe_interval;
+} Playback;
+
+Recorder* open_recorder(const char*, int);
+int record_frame(Recorder*, const u_int8_t*, const u_int8_t*);
+int close_recorder(Recorder*);
+Playback* open_playback(const char*);
+int read_frame(Playback*);
+int seek_frame(Playback*, u_int32_t);
+void close_playback(Playback*);
+int write_pgm(const char*, const u_int8_t*);
+
+#endif
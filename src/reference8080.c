@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "reference8080.h"
+
+void sync_reference(RefState *ref, const Chip8080 *chip) {
+    /* Copies the whole machine state of chip into ref */
+    ref->reg[REF_B] = chip->reg_b;
+    ref->reg[REF_C] = chip->reg_c;
+    ref->reg[REF_D] = chip->reg_d;
+    ref->reg[REF_E] = chip->reg_e;
+    ref->reg[REF_H] = chip->reg_h;
+    ref->reg[REF_L] = chip->reg_l;
+    ref->reg[REF_M] = 0;
+    ref->reg[REF_A] = chip->reg_a;
+    ref->sp = chip->reg_sp;
+    ref->pc = chip->reg_pc;
+    ref->s = chip->flags.s;
+    ref->z = chip->flags.z;
+    ref->ac = chip->flags.ac;
+    ref->p = chip->flags.p;
+    ref->cy = chip->flags.cy;
+    ref->irq_enable = chip->irq_enable;
+    ref->halted = chip->halted;
+    ref->cycles = chip->cycles;
+    memcpy(ref->memory, chip->memory, MAX_MEMORY);
+    memcpy(ref->in_ports, chip->in_ports, 256);
+    memcpy(ref->out_ports, chip->out_ports, 256);
+}
+
+static u_int16_t get_hl(const RefState *ref) {
+    return ref->reg[REF_H] * 256 + ref->reg[REF_L];
+}
+
+static u_int8_t get_reg(const RefState *ref, int r) {
+    return r == REF_M ? ref->memory[get_hl(ref)] : ref->reg[r];
+}
+
+static void set_reg(RefState *ref, int r, u_int8_t value) {
+    if (r == REF_M)
+        ref->memory[get_hl(ref)] = value;
+    else
+        ref->reg[r] = value;
+}
+
+static u_int16_t get_pair(const RefState *ref, int rp) {
+    /* rp is the 2 bit pair code: BC, DE, HL, SP */
+    if (rp == 3)
+        return ref->sp;
+    return ref->reg[2 * rp] * 256 + ref->reg[2 * rp + 1];
+}
+
+static void set_pair(RefState *ref, int rp, u_int16_t value) {
+    if (rp == 3) {
+        ref->sp = value;
+        return;
+    }
+    ref->reg[2 * rp] = value / 256;
+    ref->reg[2 * rp + 1] = value % 256;
+}
+
+static void set_szp(RefState *ref, u_int8_t value) {
+    int ones = 0;
+    for (int b = 0; b < 8; b++)
+        ones += (value >> b) & 1;
+    ref->s = value >= 0x80;
+    ref->z = value == 0;
+    ref->p = ones % 2 == 0;
+}
+
+static int condition(const RefState *ref, int cc) {
+    /* cc is the 3 bit condition code: NZ, Z, NC, C, PO, PE, P, M */
+    int flag[4] = {ref->z, ref->cy, ref->p, ref->s};
+    return flag[cc >> 1] == (cc & 1);
+}
+
+int reference_step(RefState *ref) {
+    /* Executes the instruction at pc
+     * return 0, or -1 if the opcode isn't modelled (pc is left alone) */
+    u_int8_t op = ref->memory[ref->pc];
+    u_int8_t byte2 = ref->memory[(u_int16_t) (ref->pc + 1)];
+    u_int8_t byte3 = ref->memory[(u_int16_t) (ref->pc + 2)];
+    u_int16_t addr = byte3 * 256 + byte2;
+    int r = (op >> 3) & 7;      // destination register field
+    int rp = (op >> 4) & 3;     // register pair field
+    int size = 1;
+    int cycles;
+
+    if (ref->halted) {                          // idles a machine cycle at a time
+        ref->cycles += 4;
+        return 0;
+    }
+    if ((op & 0xc7) == 0x00) {                  // NOP and its undocumented copies
+        cycles = 4;
+    } else if ((op & 0xcf) == 0x01) {           // LXI rp,d16
+        set_pair(ref, rp, addr);
+        size = 3;
+        cycles = 10;
+    } else if (op == 0x02 || op == 0x12) {      // STAX B, STAX D
+        ref->memory[get_pair(ref, rp)] = ref->reg[REF_A];
+        cycles = 7;
+    } else if (op == 0x0a || op == 0x1a) {      // LDAX B, LDAX D
+        ref->reg[REF_A] = ref->memory[get_pair(ref, rp)];
+        cycles = 7;
+    } else if ((op & 0xcf) == 0x03) {           // INX rp
+        set_pair(ref, rp, get_pair(ref, rp) + 1);
+        cycles = 5;
+    } else if ((op & 0xcf) == 0x0b) {           // DCX rp
+        set_pair(ref, rp, get_pair(ref, rp) - 1);
+        cycles = 5;
+    } else if ((op & 0xc7) == 0x04) {           // INR r
+        u_int8_t before = get_reg(ref, r);
+        u_int8_t value = before + 1;
+        set_reg(ref, r, value);
+        set_szp(ref, value);
+        ref->ac = (before & 0x0f) + 1 > 0x0f;
+        cycles = r == REF_M ? 10 : 5;
+    } else if ((op & 0xc7) == 0x05) {           // DCR r, done as r + 0xff
+        u_int8_t before = get_reg(ref, r);
+        u_int8_t value = before - 1;
+        set_reg(ref, r, value);
+        set_szp(ref, value);
+        ref->ac = (before & 0x0f) + 0x0f > 0x0f;
+        cycles = r == REF_M ? 10 : 5;
+    } else if ((op & 0xc7) == 0x06) {           // MVI r,d8
+        set_reg(ref, r, byte2);
+        size = 2;
+        cycles = r == REF_M ? 10 : 7;
+    } else if ((op & 0xcf) == 0x09) {           // DAD rp
+        u_int32_t sum = get_hl(ref) + get_pair(ref, rp);
+        set_pair(ref, 2, sum);
+        ref->cy = sum > 0xffff;
+        cycles = 10;
+    } else if (op == 0x07) {                    // RLC
+        u_int8_t a = ref->reg[REF_A];
+        ref->cy = a >> 7;
+        ref->reg[REF_A] = (a << 1) | ref->cy;
+        cycles = 4;
+    } else if (op == 0x0f) {                    // RRC
+        u_int8_t a = ref->reg[REF_A];
+        ref->cy = a & 1;
+        ref->reg[REF_A] = (a >> 1) | (ref->cy << 7);
+        cycles = 4;
+    } else if (op == 0x17) {                    // RAL
+        u_int8_t a = ref->reg[REF_A];
+        ref->reg[REF_A] = (a << 1) | ref->cy;
+        ref->cy = a >> 7;
+        cycles = 4;
+    } else if (op == 0x1f) {                    // RAR
+        u_int8_t a = ref->reg[REF_A];
+        ref->reg[REF_A] = (a >> 1) | (ref->cy << 7);
+        ref->cy = a & 1;
+        cycles = 4;
+    } else if (op == 0x22) {                    // SHLD addr
+        ref->memory[addr] = ref->reg[REF_L];
+        ref->memory[(u_int16_t) (addr + 1)] = ref->reg[REF_H];
+        size = 3;
+        cycles = 16;
+    } else if (op == 0x2a) {                    // LHLD addr
+        ref->reg[REF_L] = ref->memory[addr];
+        ref->reg[REF_H] = ref->memory[(u_int16_t) (addr + 1)];
+        size = 3;
+        cycles = 16;
+    } else if (op == 0x2f) {                    // CMA
+        ref->reg[REF_A] = ~ref->reg[REF_A];
+        cycles = 4;
+    } else if (op == 0x32) {                    // STA addr
+        ref->memory[addr] = ref->reg[REF_A];
+        size = 3;
+        cycles = 13;
+    } else if (op == 0x3a) {                    // LDA addr
+        ref->reg[REF_A] = ref->memory[addr];
+        size = 3;
+        cycles = 13;
+    } else if (op == 0x37) {                    // STC
+        ref->cy = 1;
+        cycles = 4;
+    } else if (op == 0x3f) {                    // CMC
+        ref->cy = !ref->cy;
+        cycles = 4;
+    } else if (op == 0x76) {                    // HLT
+        ref->halted = 1;
+        cycles = 7;
+    } else if ((op & 0xf8) == 0xa0) {           // ANA r
+        u_int8_t value = get_reg(ref, op & 7);
+        ref->ac = ((ref->reg[REF_A] | value) >> 3) & 1;
+        ref->reg[REF_A] &= value;
+        set_szp(ref, ref->reg[REF_A]);
+        ref->cy = 0;
+        cycles = (op & 7) == REF_M ? 7 : 4;
+    } else if ((op & 0xc7) == 0xc2) {           // Jcc addr
+        size = condition(ref, r) ? 0 : 3;
+        if (size == 0)
+            ref->pc = addr;
+        cycles = 10;
+    } else if (op == 0xc3 || op == 0xcb) {      // JMP addr and its undocumented copy
+        ref->pc = addr;
+        size = 0;
+        cycles = 10;
+    } else if (op == 0xfe) {                    // CPI d8, done as A + ~d8 + 1
+        u_int16_t diff = ref->reg[REF_A] + (u_int8_t) ~byte2 + 1;
+        set_szp(ref, diff);
+        ref->cy = diff <= 0xff;
+        ref->ac = (ref->reg[REF_A] & 0x0f) + (~byte2 & 0x0f) + 1 > 0x0f;
+        size = 2;
+        cycles = 7;
+    } else if (op == 0xd3) {                    // OUT d8
+        ref->out_ports[byte2] = ref->reg[REF_A];
+        size = 2;
+        cycles = 10;
+    } else if (op == 0xdb) {                    // IN d8
+        ref->reg[REF_A] = ref->in_ports[byte2];
+        size = 2;
+        cycles = 10;
+    } else if (op == 0xf3) {                    // DI
+        ref->irq_enable = 0;
+        cycles = 4;
+    } else if (op == 0xfb) {                    // EI
+        ref->irq_enable = 1;
+        cycles = 4;
+    } else {
+        return -1;
+    }
+
+    ref->pc += size;
+    ref->cycles += cycles;
+    return 0;
+}
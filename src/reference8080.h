@@ -0,0 +1,44 @@
+#ifndef REFERENCE8080_H
+#define REFERENCE8080_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+
+/*
+ *  Reference 8080
+ *
+ *  A deliberately plain model of the 8080 the core is checked against.
+ *  Instructions are decoded from their bit fields, registers live in an
+ *  array indexed by the 3 bit register code and every flag is computed
+ *  from its definition in the 8080 manual. It shares no code with
+ *  chip8080.c and is never meant to be fast.
+ */
+
+/* Register codes of the opcode fields; 6 is M, the byte at (HL) */
+#define REF_B 0
+#define REF_C 1
+#define REF_D 2
+#define REF_E 3
+#define REF_H 4
+#define REF_L 5
+#define REF_M 6
+#define REF_A 7
+
+typedef struct RefState {
+    u_int8_t reg[8];            // reg[REF_M] is unused
+    u_int16_t sp;
+    u_int16_t pc;
+    u_int8_t s, z, ac, p, cy;
+    u_int8_t irq_enable;
+    u_int8_t halted;
+    u_int64_t cycles;
+    u_int8_t memory[MAX_MEMORY];
+    u_int8_t in_ports[256];
+    u_int8_t out_ports[256];
+} RefState;
+
+void sync_reference(RefState*, const Chip8080*);
+int reference_step(RefState*);
+
+#endif
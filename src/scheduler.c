@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "scheduler.h"
+
+void init_scheduler(Scheduler *scheduler) {
+    scheduler->n_events = 0;
+    scheduler->run_until = run8080_until;
+}
+
+static void swap_events(Event *a, Event *b) {
+    Event tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void sift_up(Scheduler *scheduler, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (scheduler->events[parent].deadline <= scheduler->events[i].deadline)
+            break;
+        swap_events(&scheduler->events[parent], &scheduler->events[i]);
+        i = parent;
+    }
+}
+
+static void sift_down(Scheduler *scheduler, int i) {
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < scheduler->n_events && scheduler->events[left].deadline < scheduler->events[smallest].deadline)
+            smallest = left;
+        if (right < scheduler->n_events && scheduler->events[right].deadline < scheduler->events[smallest].deadline)
+            smallest = right;
+        if (smallest == i)
+            return;
+        swap_events(&scheduler->events[smallest], &scheduler->events[i]);
+        i = smallest;
+    }
+}
+
+int schedule_event(Scheduler *scheduler, u_int64_t deadline, u_int64_t period,
+                   EventCallback callback, void *context) {
+    /* Adds an event firing at cycle deadline, and then every period
+     * cycles if period isn't 0
+     * return 0, or -1 if the scheduler is full */
+    if (scheduler->n_events == MAX_EVENTS)
+        return -1;
+
+    Event *event = &scheduler->events[scheduler->n_events];
+    event->deadline = deadline;
+    event->period = period;
+    event->callback = callback;
+    event->context = context;
+    sift_up(scheduler, scheduler->n_events++);
+    return 0;
+}
+
+RunStatus run_scheduled(Scheduler *scheduler, Chip8080 *chip, u_int64_t until) {
+    /* Runs chip until its cycle counter reaches until, firing events on
+     * the way. The batched loop only ever runs up to the next deadline,
+     * so events are checked once per block instead of per instruction.
+     * return RUN_BUDGET, or why the chip stopped early: events due
+     * still fire for a chip that halted with interrupts off, but not
+     * for one stopped at an unimplemented opcode or by the debugger */
+    while (chip->cycles < until) {
+        u_int64_t deadline = next_deadline(scheduler);
+        RunStatus status = scheduler->run_until(chip, deadline < until ? deadline : until);
+        if (status == RUN_UNIMPLEMENTED || status == RUN_BREAKPOINT || status == RUN_WATCHPOINT)
+            return status;
+
+        while (scheduler->n_events > 0 && scheduler->events[0].deadline <= chip->cycles) {
+            Event event = scheduler->events[0];
+            if (event.period > 0) {
+                scheduler->events[0].deadline += event.period;
+            } else {
+                scheduler->events[0] = scheduler->events[--scheduler->n_events];
+            }
+            sift_down(scheduler, 0);
+            event.callback(chip, event.context);
+        }
+        if (status == RUN_HALTED && is_parked(chip))
+            return RUN_HALTED;
+    }
+    return RUN_BUDGET;
+}
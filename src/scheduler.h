@@ -0,0 +1,36 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+
+#define MAX_EVENTS 16
+#define NO_DEADLINE ((u_int64_t) -1)
+
+typedef void (*EventCallback)(Chip8080*, void*);
+typedef RunStatus (*RunUntil)(Chip8080*, u_int64_t);
+
+typedef struct Event {
+    u_int64_t deadline;     // Cycle count the event fires at
+    u_int64_t period;       // Rescheduled period cycles later, 0 fires once
+    EventCallback callback;
+    void *context;
+} Event;
+
+/* Min-heap of events ordered by deadline */
+typedef struct Scheduler {
+    Event events[MAX_EVENTS];
+    int n_events;
+    RunUntil run_until;     // Runs the chip between events, run8080_until() by default
+} Scheduler;
+
+static inline u_int64_t next_deadline(const Scheduler *scheduler) {
+    return scheduler->n_events > 0 ? scheduler->events[0].deadline : NO_DEADLINE;
+}
+
+void init_scheduler(Scheduler*);
+int schedule_event(Scheduler*, u_int64_t, u_int64_t, EventCallback, void*);
+RunStatus run_scheduled(Scheduler*, Chip8080*, u_int64_t);
+
+#endif
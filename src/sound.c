@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "tools.h"
+#include "sound.h"
+
+static const char *sound_names[2][8] = {
+    {"ufo", "shot", "player_die", "invader_die", "extra_life", "amp_enable", NULL, NULL},
+    {"fleet_1", "fleet_2", "fleet_3", "fleet_4", "ufo_hit", NULL, NULL, NULL},
+};
+
+void init_sound_log(SoundLog *log, SoundEvent *buffer, u_int32_t capacity) {
+    /* buffer holds capacity events and belongs to the caller */
+    log->events = buffer;
+    log->capacity = capacity;
+    log->n_events = 0;
+    log->dropped = 0;
+    log->latch[0] = 0;
+    log->latch[1] = 0;
+}
+
+void log_sound(SoundLog *log, u_int64_t cycle, u_int8_t port, u_int8_t value) {
+    /* Appends an event if the write to OUT 3 or 5 toggles a bit */
+    int index = port == SOUND_PORT_2;
+    u_int8_t changed = log->latch[index] ^ value;
+    log->latch[index] = value;
+    if (changed == 0)
+        return;
+    if (log->n_events == log->capacity) {
+        log->dropped++;
+        return;
+    }
+    log->events[log->n_events++] = (SoundEvent) {cycle, port, value, changed};
+}
+
+static int append_names(char *out, u_int8_t port, u_int8_t bits) {
+    int len = 0;
+    for (int b = 0; b < 8; b++) {
+        if (!((bits >> b) & 1))
+            continue;
+        const char *name = sound_names[port == SOUND_PORT_2][b];
+        len += sprintf(out + len, "%s\"%s\"", len ? "," : "", name ? name : "unused");
+    }
+    return len;
+}
+
+int format_sound_event(const SoundEvent *event, char *line) {
+    /* Writes event as a JSON line with the sounds it starts and stops
+     * return the line length */
+    int len = sprintf(line, "{\"cycle\":%llu,\"port\":%d,\"value\":%d,\"on\":[",
+                      (unsigned long long) event->cycle, event->port, event->value);
+    len += append_names(line + len, event->port, event->changed & event->value);
+    len += sprintf(line + len, "],\"off\":[");
+    len += append_names(line + len, event->port, event->changed & ~event->value);
+    len += sprintf(line + len, "]}\n");
+    return len;
+}
+
+void pack_sound_event(const SoundEvent *event, u_int8_t *out) {
+    /* Writes the SOUND_EVENT_SIZE byte little endian record */
+    put_u64(out, event->cycle);
+    out[8] = event->port;
+    out[9] = event->value;
+    out[10] = event->changed;
+    out[11] = 0;
+}
@@ -0,0 +1,56 @@
+#ifndef SOUND_H
+#define SOUND_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+/* Sound triggers of the Invaders board: each bit of OUT 3 and OUT 5
+ * drives one analog sound circuit */
+#define SOUND_PORT_1 3
+#define SOUND_PORT_2 5
+
+/* OUT 3 bits */
+#define SOUND_UFO 0x01
+#define SOUND_SHOT 0x02
+#define SOUND_PLAYER_DIE 0x04
+#define SOUND_INVADER_DIE 0x08
+#define SOUND_EXTRA_LIFE 0x10
+#define SOUND_AMP_ENABLE 0x20
+
+/* OUT 5 bits */
+#define SOUND_FLEET_1 0x01
+#define SOUND_FLEET_2 0x02
+#define SOUND_FLEET_3 0x04
+#define SOUND_FLEET_4 0x08
+#define SOUND_UFO_HIT 0x10
+
+/* Events kept between drains, more than a frame ever writes */
+#define SOUND_LOG_CAPACITY 1024
+/* Binary record: u64 cycle, u8 port, u8 value, u8 changed, u8 0 */
+#define SOUND_EVENT_SIZE 12
+/* Longest line format_sound_event() can produce */
+#define SOUND_EVENT_LINE_MAX 256
+
+typedef struct SoundEvent {
+    u_int64_t cycle;        // Cycle count at the OUT
+    u_int8_t port;
+    u_int8_t value;         // Bits after the write
+    u_int8_t changed;       // Bits the write toggled
+} SoundEvent;
+
+/* Fixed buffer filled from the OUT handlers; the owner drains it, and
+ * events past capacity are counted rather than stored */
+typedef struct SoundLog {
+    SoundEvent *events;
+    u_int32_t capacity;
+    u_int32_t n_events;
+    u_int64_t dropped;
+    u_int8_t latch[2];      // Last value of OUT 3 and OUT 5
+} SoundLog;
+
+void init_sound_log(SoundLog*, SoundEvent*, u_int32_t);
+void log_sound(SoundLog*, u_int64_t, u_int8_t, u_int8_t);
+int format_sound_event(const SoundEvent*, char*);
+void pack_sound_event(const SoundEvent*, u_int8_t*);
+
+#endif
@@ -1,278 +1,463 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "chip8080.h"
 #include "tools.h"
 
-int disassemble_machine_code(unsigned char *codebuffer, int pc) {
-    /* disassembles a binary file
+#define OP(text, size) { text, sizeof(text) - 1, size }
+
+const Opcode opcode_table[256] = {
+    /* 0x00 */ OP("NOP", 1),
+    /* 0x01 */ OP("LXI    B,#$", 3),
+    /* 0x02 */ OP("STAX   B", 1),
+    /* 0x03 */ OP("INX    B", 1),
+    /* 0x04 */ OP("INR    B", 1),
+    /* 0x05 */ OP("DCR    B", 1),
+    /* 0x06 */ OP("MVI    B,#$", 2),
+    /* 0x07 */ OP("RLC", 1),
+    /* 0x08 */ OP("NOP", 1),
+    /* 0x09 */ OP("DAD    B", 1),
+    /* 0x0a */ OP("LDAX   B", 1),
+    /* 0x0b */ OP("DCX    B", 1),
+    /* 0x0c */ OP("INR    C", 1),
+    /* 0x0d */ OP("DCR    C", 1),
+    /* 0x0e */ OP("MVI    C,#$", 2),
+    /* 0x0f */ OP("RRC", 1),
+    /* 0x10 */ OP("NOP", 1),
+    /* 0x11 */ OP("LXI    D,#$", 3),
+    /* 0x12 */ OP("STAX   D", 1),
+    /* 0x13 */ OP("INX    D", 1),
+    /* 0x14 */ OP("INR    D", 1),
+    /* 0x15 */ OP("DCR    D", 1),
+    /* 0x16 */ OP("MVI    D,#$", 2),
+    /* 0x17 */ OP("RAL", 1),
+    /* 0x18 */ OP("NOP", 1),
+    /* 0x19 */ OP("DAD    D", 1),
+    /* 0x1a */ OP("LDAX   D", 1),
+    /* 0x1b */ OP("DCX    D", 1),
+    /* 0x1c */ OP("INR    E", 1),
+    /* 0x1d */ OP("DCR    E", 1),
+    /* 0x1e */ OP("MVI    E,#$", 2),
+    /* 0x1f */ OP("RAR", 1),
+    /* 0x20 */ OP("NOP", 1),
+    /* 0x21 */ OP("LXI    H,#$", 3),
+    /* 0x22 */ OP("SHLD   $", 3),
+    /* 0x23 */ OP("INX    H", 1),
+    /* 0x24 */ OP("INR    H", 1),
+    /* 0x25 */ OP("DCR    H", 1),
+    /* 0x26 */ OP("MVI    H,#$", 2),
+    /* 0x27 */ OP("DAA", 1),
+    /* 0x28 */ OP("NOP", 1),
+    /* 0x29 */ OP("DAD    H", 1),
+    /* 0x2a */ OP("LHLD   $", 3),
+    /* 0x2b */ OP("DCX    H", 1),
+    /* 0x2c */ OP("INR    L", 1),
+    /* 0x2d */ OP("DCR    L", 1),
+    /* 0x2e */ OP("MVI    L,#$", 2),
+    /* 0x2f */ OP("CMA", 1),
+    /* 0x30 */ OP("NOP", 1),
+    /* 0x31 */ OP("LXI    SP,#$", 3),
+    /* 0x32 */ OP("STA    $", 3),
+    /* 0x33 */ OP("INX    SP", 1),
+    /* 0x34 */ OP("INR    M", 1),
+    /* 0x35 */ OP("DCR    M", 1),
+    /* 0x36 */ OP("MVI    M,#$", 2),
+    /* 0x37 */ OP("STC", 1),
+    /* 0x38 */ OP("NOP", 1),
+    /* 0x39 */ OP("DAD    SP", 1),
+    /* 0x3a */ OP("LDA    $", 3),
+    /* 0x3b */ OP("DCX    SP", 1),
+    /* 0x3c */ OP("INR    A", 1),
+    /* 0x3d */ OP("DCR    A", 1),
+    /* 0x3e */ OP("MVI    A,#$", 2),
+    /* 0x3f */ OP("CMC", 1),
+    /* 0x40 */ OP("MOV    B,B", 1),
+    /* 0x41 */ OP("MOV    B,C", 1),
+    /* 0x42 */ OP("MOV    B,D", 1),
+    /* 0x43 */ OP("MOV    B,E", 1),
+    /* 0x44 */ OP("MOV    B,H", 1),
+    /* 0x45 */ OP("MOV    B,L", 1),
+    /* 0x46 */ OP("MOV    B,M", 1),
+    /* 0x47 */ OP("MOV    B,A", 1),
+    /* 0x48 */ OP("MOV    C,B", 1),
+    /* 0x49 */ OP("MOV    C,C", 1),
+    /* 0x4a */ OP("MOV    C,D", 1),
+    /* 0x4b */ OP("MOV    C,E", 1),
+    /* 0x4c */ OP("MOV    C,H", 1),
+    /* 0x4d */ OP("MOV    C,L", 1),
+    /* 0x4e */ OP("MOV    C,M", 1),
+    /* 0x4f */ OP("MOV    C,A", 1),
+    /* 0x50 */ OP("MOV    D,B", 1),
+    /* 0x51 */ OP("MOV    D,C", 1),
+    /* 0x52 */ OP("MOV    D,D", 1),
+    /* 0x53 */ OP("MOV    D,E", 1),
+    /* 0x54 */ OP("MOV    D,H", 1),
+    /* 0x55 */ OP("MOV    D,L", 1),
+    /* 0x56 */ OP("MOV    D,M", 1),
+    /* 0x57 */ OP("MOV    D,A", 1),
+    /* 0x58 */ OP("MOV    E,B", 1),
+    /* 0x59 */ OP("MOV    E,C", 1),
+    /* 0x5a */ OP("MOV    E,D", 1),
+    /* 0x5b */ OP("MOV    E,E", 1),
+    /* 0x5c */ OP("MOV    E,H", 1),
+    /* 0x5d */ OP("MOV    E,L", 1),
+    /* 0x5e */ OP("MOV    E,M", 1),
+    /* 0x5f */ OP("MOV    E,A", 1),
+    /* 0x60 */ OP("MOV    H,B", 1),
+    /* 0x61 */ OP("MOV    H,C", 1),
+    /* 0x62 */ OP("MOV    H,D", 1),
+    /* 0x63 */ OP("MOV    H,E", 1),
+    /* 0x64 */ OP("MOV    H,H", 1),
+    /* 0x65 */ OP("MOV    H,L", 1),
+    /* 0x66 */ OP("MOV    H,M", 1),
+    /* 0x67 */ OP("MOV    H,A", 1),
+    /* 0x68 */ OP("MOV    L,B", 1),
+    /* 0x69 */ OP("MOV    L,C", 1),
+    /* 0x6a */ OP("MOV    L,D", 1),
+    /* 0x6b */ OP("MOV    L,E", 1),
+    /* 0x6c */ OP("MOV    L,H", 1),
+    /* 0x6d */ OP("MOV    L,L", 1),
+    /* 0x6e */ OP("MOV    L,M", 1),
+    /* 0x6f */ OP("MOV    L,A", 1),
+    /* 0x70 */ OP("MOV    M,B", 1),
+    /* 0x71 */ OP("MOV    M,C", 1),
+    /* 0x72 */ OP("MOV    M,D", 1),
+    /* 0x73 */ OP("MOV    M,E", 1),
+    /* 0x74 */ OP("MOV    M,H", 1),
+    /* 0x75 */ OP("MOV    M,L", 1),
+    /* 0x76 */ OP("HLT", 1),
+    /* 0x77 */ OP("MOV    M,A", 1),
+    /* 0x78 */ OP("MOV    A,B", 1),
+    /* 0x79 */ OP("MOV    A,C", 1),
+    /* 0x7a */ OP("MOV    A,D", 1),
+    /* 0x7b */ OP("MOV    A,E", 1),
+    /* 0x7c */ OP("MOV    A,H", 1),
+    /* 0x7d */ OP("MOV    A,L", 1),
+    /* 0x7e */ OP("MOV    A,M", 1),
+    /* 0x7f */ OP("MOV    A,A", 1),
+    /* 0x80 */ OP("ADD    B", 1),
+    /* 0x81 */ OP("ADD    C", 1),
+    /* 0x82 */ OP("ADD    D", 1),
+    /* 0x83 */ OP("ADD    E", 1),
+    /* 0x84 */ OP("ADD    H", 1),
+    /* 0x85 */ OP("ADD    L", 1),
+    /* 0x86 */ OP("ADD    M", 1),
+    /* 0x87 */ OP("ADD    A", 1),
+    /* 0x88 */ OP("ADC    B", 1),
+    /* 0x89 */ OP("ADC    C", 1),
+    /* 0x8a */ OP("ADC    D", 1),
+    /* 0x8b */ OP("ADC    E", 1),
+    /* 0x8c */ OP("ADC    H", 1),
+    /* 0x8d */ OP("ADC    L", 1),
+    /* 0x8e */ OP("ADC    M", 1),
+    /* 0x8f */ OP("ADC    A", 1),
+    /* 0x90 */ OP("SUB    B", 1),
+    /* 0x91 */ OP("SUB    C", 1),
+    /* 0x92 */ OP("SUB    D", 1),
+    /* 0x93 */ OP("SUB    E", 1),
+    /* 0x94 */ OP("SUB    H", 1),
+    /* 0x95 */ OP("SUB    L", 1),
+    /* 0x96 */ OP("SUB    M", 1),
+    /* 0x97 */ OP("SUB    A", 1),
+    /* 0x98 */ OP("SBB    B", 1),
+    /* 0x99 */ OP("SBB    C", 1),
+    /* 0x9a */ OP("SBB    D", 1),
+    /* 0x9b */ OP("SBB    E", 1),
+    /* 0x9c */ OP("SBB    H", 1),
+    /* 0x9d */ OP("SBB    L", 1),
+    /* 0x9e */ OP("SBB    M", 1),
+    /* 0x9f */ OP("SBB    A", 1),
+    /* 0xa0 */ OP("ANA    B", 1),
+    /* 0xa1 */ OP("ANA    C", 1),
+    /* 0xa2 */ OP("ANA    D", 1),
+    /* 0xa3 */ OP("ANA    E", 1),
+    /* 0xa4 */ OP("ANA    H", 1),
+    /* 0xa5 */ OP("ANA    L", 1),
+    /* 0xa6 */ OP("ANA    M", 1),
+    /* 0xa7 */ OP("ANA    A", 1),
+    /* 0xa8 */ OP("XRA    B", 1),
+    /* 0xa9 */ OP("XRA    C", 1),
+    /* 0xaa */ OP("XRA    D", 1),
+    /* 0xab */ OP("XRA    E", 1),
+    /* 0xac */ OP("XRA    H", 1),
+    /* 0xad */ OP("XRA    L", 1),
+    /* 0xae */ OP("XRA    M", 1),
+    /* 0xaf */ OP("XRA    A", 1),
+    /* 0xb0 */ OP("ORA    B", 1),
+    /* 0xb1 */ OP("ORA    C", 1),
+    /* 0xb2 */ OP("ORA    D", 1),
+    /* 0xb3 */ OP("ORA    E", 1),
+    /* 0xb4 */ OP("ORA    H", 1),
+    /* 0xb5 */ OP("ORA    L", 1),
+    /* 0xb6 */ OP("ORA    M", 1),
+    /* 0xb7 */ OP("ORA    A", 1),
+    /* 0xb8 */ OP("CMP    B", 1),
+    /* 0xb9 */ OP("CMP    C", 1),
+    /* 0xba */ OP("CMP    D", 1),
+    /* 0xbb */ OP("CMP    E", 1),
+    /* 0xbc */ OP("CMP    H", 1),
+    /* 0xbd */ OP("CMP    L", 1),
+    /* 0xbe */ OP("CMP    M", 1),
+    /* 0xbf */ OP("CMP    A", 1),
+    /* 0xc0 */ OP("RNZ", 1),
+    /* 0xc1 */ OP("POP    B", 1),
+    /* 0xc2 */ OP("JNZ    $", 3),
+    /* 0xc3 */ OP("JMP    $", 3),
+    /* 0xc4 */ OP("CNZ    $", 3),
+    /* 0xc5 */ OP("PUSH   B", 1),
+    /* 0xc6 */ OP("ADI    #$", 2),
+    /* 0xc7 */ OP("RST    0", 1),
+    /* 0xc8 */ OP("RZ", 1),
+    /* 0xc9 */ OP("RET", 1),
+    /* 0xca */ OP("JZ     $", 3),
+    /* 0xcb */ OP("JMP    $", 3),
+    /* 0xcc */ OP("CZ     $", 3),
+    /* 0xcd */ OP("CALL   $", 3),
+    /* 0xce */ OP("ACI    #$", 2),
+    /* 0xcf */ OP("RST    1", 1),
+    /* 0xd0 */ OP("RNC", 1),
+    /* 0xd1 */ OP("POP    D", 1),
+    /* 0xd2 */ OP("JNC    $", 3),
+    /* 0xd3 */ OP("OUT    $", 2),
+    /* 0xd4 */ OP("CNC    $", 3),
+    /* 0xd5 */ OP("PUSH   D", 1),
+    /* 0xd6 */ OP("SUI    #$", 2),
+    /* 0xd7 */ OP("RST    2", 1),
+    /* 0xd8 */ OP("RC", 1),
+    /* 0xd9 */ OP("NOP", 1),
+    /* 0xda */ OP("JC     $", 3),
+    /* 0xdb */ OP("IN     #$", 2),
+    /* 0xdc */ OP("CC     $", 3),
+    /* 0xdd */ OP("NOP", 1),
+    /* 0xde */ OP("SBI    #$", 2),
+    /* 0xdf */ OP("RST    3", 1),
+    /* 0xe0 */ OP("RPO", 1),
+    /* 0xe1 */ OP("POP    H", 1),
+    /* 0xe2 */ OP("JPO    $", 3),
+    /* 0xe3 */ OP("XTHL", 1),
+    /* 0xe4 */ OP("CPO    $", 3),
+    /* 0xe5 */ OP("PUSH   H", 1),
+    /* 0xe6 */ OP("ANI    #$", 2),
+    /* 0xe7 */ OP("RST    4", 1),
+    /* 0xe8 */ OP("RPE", 1),
+    /* 0xe9 */ OP("PCHL", 1),
+    /* 0xea */ OP("JPE    $", 3),
+    /* 0xeb */ OP("XCHG", 1),
+    /* 0xec */ OP("CPE    $", 3),
+    /* 0xed */ OP("NOP", 1),
+    /* 0xee */ OP("XRI    #$", 2),
+    /* 0xef */ OP("RST    5", 1),
+    /* 0xf0 */ OP("RP", 1),
+    /* 0xf1 */ OP("POP    PSW", 1),
+    /* 0xf2 */ OP("JP     $", 3),
+    /* 0xf3 */ OP("DI", 1),
+    /* 0xf4 */ OP("CP     $", 3),
+    /* 0xf5 */ OP("PUSH   PSW", 1),
+    /* 0xf6 */ OP("ORI    #$", 2),
+    /* 0xf7 */ OP("RST    6", 1),
+    /* 0xf8 */ OP("RM", 1),
+    /* 0xf9 */ OP("SPHL", 1),
+    /* 0xfa */ OP("JM     $", 3),
+    /* 0xfb */ OP("EI", 1),
+    /* 0xfc */ OP("CM     $", 3),
+    /* 0xfd */ OP("NOP", 1),
+    /* 0xfe */ OP("CPI    #$", 2),
+    /* 0xff */ OP("RST    7", 1),
+};
+
+int format_instruction(const unsigned char *codebuffer, int pc, int end, char *line, int *line_len) {
+    /* formats the instruction at codebuffer[pc] into line
+     * , end is the size of codebuffer; operand bytes past it read as 0
+     * , line must hold at least DISASM_LINE_MAX chars (no NUL is written)
+     * , addresses past 64KB, in images larger than the 8080 can
+     *   address, get 6 or 8 digits
+     * , stores the length of the line in line_len
+     * return the number of bytes of the op */
+
+    const Opcode *op = &opcode_table[codebuffer[pc]];
+    u_int8_t byte_2 = (pc + 1 < end) ? codebuffer[pc + 1] : 0;
+    u_int8_t byte_3 = (pc + 2 < end) ? codebuffer[pc + 2] : 0;
+    char *out = line;
+
+    if (pc >> 24)
+        out = put_hex8(out, pc >> 24);
+    if (pc >> 16)
+        out = put_hex8(out, pc >> 16);
+    out = put_hex8(out, pc >> 8);
+    out = put_hex8(out, pc & 0xff);
+    *out++ = ' ';
+    memcpy(out, op->mnemonic, op->mnemonic_len);
+    out += op->mnemonic_len;
+    if (op->size == 3)
+        out = put_hex8(out, byte_3);
+    if (op->size >= 2)
+        out = put_hex8(out, byte_2);
+    *out++ = '\n';
+
+    *line_len = out - line;
+    return op->size;
+}
+
+size_t disassemble_range(const unsigned char *codebuffer, int *pc, int end, char *out, size_t out_size) {
+    /* disassembles codebuffer from *pc up to end into out
+     * , stops early when out can't hold another line
+     * , *pc is left at the first instruction not disassembled
+     * return the number of chars written to out */
+
+    size_t written = 0;
+    int line_len;
+
+    while (*pc < end && out_size - written >= DISASM_LINE_MAX) {
+        *pc += format_instruction(codebuffer, *pc, end, out + written, &line_len);
+        written += line_len;
+    }
+    return written;
+}
+
+int format_chip_state(const Chip8080 *chip, char *line) {
+    /* formats the registers and flags of chip into line as
+     * "A=00 BC=0000 DE=0000 HL=0000 SP=0000 PC=0000 F=zspca\n"
+     * , a clear flag is printed as '.'
+     * return the length of the line */
+
+    char *out = line;
+
+    memcpy(out, "A=", 2); out = put_hex8(out + 2, chip->reg_a);
+    memcpy(out, " BC=", 4); out = put_hex8(put_hex8(out + 4, chip->reg_b), chip->reg_c);
+    memcpy(out, " DE=", 4); out = put_hex8(put_hex8(out + 4, chip->reg_d), chip->reg_e);
+    memcpy(out, " HL=", 4); out = put_hex8(put_hex8(out + 4, chip->reg_h), chip->reg_l);
+    memcpy(out, " SP=", 4); out = put_hex8(put_hex8(out + 4, chip->reg_sp >> 8), chip->reg_sp & 0xff);
+    memcpy(out, " PC=", 4); out = put_hex8(put_hex8(out + 4, chip->reg_pc >> 8), chip->reg_pc & 0xff);
+    memcpy(out, " F=", 3); out += 3;
+    *out++ = chip->flags.z ? 'z' : '.';
+    *out++ = chip->flags.s ? 's' : '.';
+    *out++ = chip->flags.p ? 'p' : '.';
+    *out++ = chip->flags.cy ? 'c' : '.';
+    *out++ = chip->flags.ac ? 'a' : '.';
+    *out++ = '\n';
+
+    return out - line;
+}
+
+int disassemble_machine_code(unsigned char *codebuffer, int pc, int size) {
+    /* disassembles a single instruction to stdout
      * codebuffer is a pointer to 8080 assembly code 
      * , pc is the current offset into the code 
+     * , size is the length of codebuffer; operands past it read as 0
      * return the number of bytes of the op */
 
-    unsigned char *code = &codebuffer[pc];
-    int opbytes = 1;
+    char line[DISASM_LINE_MAX];
+    int line_len;
+    int opbytes = format_instruction(codebuffer, pc, size, line, &line_len);
+
+    fwrite(line, 1, line_len, stdout);
+    return opbytes;
+}
 
-    printf("%04x ", pc);
+unsigned char *map_file(const char *path, size_t *size) {
+    /* maps path read-only into memory
+     * , stores the file size in size
+     * return the mapping, or NULL if the file can't be opened */
 
-    switch (*code) {
-        case 0x00: printf("NOP"); printf("\n"); break;
-        case 0x01: printf("LXI    B,#$%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0x02: printf("STAX   B"); printf("\n"); break;
-        case 0x03: printf("INX    B"); printf("\n"); break;
-        case 0x04: printf("INR    B"); printf("\n"); break;
-        case 0x05: printf("DCR    B"); printf("\n"); break;
-        case 0x06: printf("MVI    B,#$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0x07: printf("RLC"); printf("\n"); break;
-        case 0x08: printf("NOP"); printf("\n"); break;
-        case 0x09: printf("DAD    B"); printf("\n"); break;
-        case 0x0a: printf("LDAX   B"); printf("\n"); break;
-        case 0x0b: printf("DCX    B"); printf("\n"); break;
-        case 0x0c: printf("INR    C"); printf("\n"); break;
-        case 0x0d: printf("DCR    C"); printf("\n"); break;
-        case 0x0e: printf("MVI    C,#$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0x0f: printf("RRC"); printf("\n"); break;
-        case 0x10: printf("NOP"); printf("\n"); break;
-        case 0x11: printf("LXI    D,#$%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0x12: printf("STAX   D"); printf("\n"); break;
-        case 0x13: printf("INX    D"); printf("\n"); break;
-        case 0x14: printf("INR    D"); printf("\n"); break;
-        case 0x15: printf("DCR    D"); printf("\n"); break;
-        case 0x16: printf("MVI    D,#$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0x17: printf("RAL"); printf("\n"); break;
-        case 0x18: printf("NOP"); printf("\n"); break;
-        case 0x19: printf("DAD    D"); printf("\n"); break;
-        case 0x1a: printf("LDAX   D"); printf("\n"); break;
-        case 0x1b: printf("DCX    D"); printf("\n"); break;
-        case 0x1c: printf("INR    E"); printf("\n"); break;
-        case 0x1d: printf("DCR    E"); printf("\n"); break;
-        case 0x1e: printf("MVI    E,#$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0x1f: printf("RAR"); printf("\n"); break;
-        case 0x20: printf("NOP"); printf("\n"); break;
-        case 0x21: printf("LXI    H,#$%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0x22: printf("SHLD   $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0x23: printf("INX    H"); printf("\n"); break;
-        case 0x24: printf("INR    H"); printf("\n"); break;
-        case 0x25: printf("DCR    H"); printf("\n"); break;
-        case 0x26: printf("MVI    H,#$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0x27: printf("DAA"); printf("\n"); break;
-        case 0x28: printf("NOP"); printf("\n"); break;
-        case 0x29: printf("DAD    H"); printf("\n"); break;
-        case 0x2a: printf("LDHL   $%02x%02x", code[2], code[1]); printf("\n"); break;
-        case 0x2b: printf("DCX    H"); printf("\n"); break;
-        case 0x2c: printf("INR    L"); printf("\n"); break;
-        case 0x2d: printf("DCR    L"); printf("\n"); break;
-        case 0x2e: printf("MVI    L,#$%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0x2f: printf("CMA"); printf("\n"); break;
-        case 0x30: printf("NOP"); printf("\n"); break;
-        case 0x31: printf("LXI    SP,#$%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0x32: printf("STA    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0x33: printf("INX    SP"); printf("\n"); break;
-        case 0x34: printf("INR    M"); printf("\n"); break;
-        case 0x35: printf("DCR    M"); printf("\n"); break;
-        case 0x36: printf("MVI    M,#$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0x37: printf("SCT"); printf("\n"); break;
-        case 0x38: printf("NOP"); printf("\n"); break;
-        case 0x39: printf("DAD    SP"); printf("\n"); break;
-        case 0x3a: printf("LDA    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0x3b: printf("DCX    SP"); printf("\n"); break;
-        case 0x3c: printf("INR    A"); printf("\n"); break;
-        case 0x3d: printf("DRC    A"); printf("\n"); break;
-        case 0x3e: printf("MVI    A,#$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0x3f: printf("CMC"); printf("\n"); break;
-        case 0x40: printf("MOV    B,B"); printf("\n"); break;
-        case 0x41: printf("MOV    B,C"); printf("\n"); break;
-        case 0x42: printf("MOV    B,D"); printf("\n"); break;
-        case 0x43: printf("MOV    B,E"); printf("\n"); break;
-        case 0x44: printf("MOV    B,H"); printf("\n"); break;
-        case 0x45: printf("MOV    B,L"); printf("\n"); break;
-        case 0x46: printf("MOV    B,M"); printf("\n"); break;
-        case 0x47: printf("MOV    B,A"); printf("\n"); break;
-        case 0x48: printf("MOV    C,B"); printf("\n"); break;
-        case 0x49: printf("MOV    C,C"); printf("\n"); break;
-        case 0x4a: printf("MOV    C,D"); printf("\n"); break;
-        case 0x4b: printf("MOV    C,E"); printf("\n"); break;
-        case 0x4c: printf("MOV    C,H"); printf("\n"); break;
-        case 0x4d: printf("MOV    C,L"); printf("\n"); break;
-        case 0x4e: printf("MOV    C,M"); printf("\n"); break;
-        case 0x4f: printf("MOV    C,A"); printf("\n"); break;
-        case 0x50: printf("MOV    D,B"); printf("\n"); break;
-        case 0x51: printf("MOV    D,C"); printf("\n"); break;
-        case 0x52: printf("MOV    D,D"); printf("\n"); break;
-        case 0x53: printf("MOV    D,E"); printf("\n"); break;
-        case 0x54: printf("MOV    D,H"); printf("\n"); break;
-        case 0x55: printf("MOV    D,L"); printf("\n"); break;
-        case 0x56: printf("MOV    D,M"); printf("\n"); break;
-        case 0x57: printf("MOV    D,A"); printf("\n"); break;
-        case 0x58: printf("MOV    E,B"); printf("\n"); break;
-        case 0x59: printf("MOV    E,C"); printf("\n"); break;
-        case 0x5a: printf("MOV    E,D"); printf("\n"); break;
-        case 0x5b: printf("MOV    E,E"); printf("\n"); break;
-        case 0x5c: printf("MOV    E,H"); printf("\n"); break;
-        case 0x5d: printf("MOV    E,L"); printf("\n"); break;
-        case 0x5e: printf("MOV    E,M"); printf("\n"); break;
-        case 0x5f: printf("MOV    E,A"); printf("\n"); break;
-        case 0x60: printf("MOV    H,B"); printf("\n"); break;
-        case 0x61: printf("MOV    H,C"); printf("\n"); break;
-        case 0x62: printf("MOV    H,D"); printf("\n"); break;
-        case 0x63: printf("MOV    H,E"); printf("\n"); break;
-        case 0x64: printf("MOV    H,H"); printf("\n"); break;
-        case 0x65: printf("MOV    H,L"); printf("\n"); break;
-        case 0x66: printf("MOV    H,M"); printf("\n"); break;
-        case 0x67: printf("MOV    H,A"); printf("\n"); break;
-        case 0x68: printf("MOV    L,B"); printf("\n"); break;
-        case 0x69: printf("MOV    L,C"); printf("\n"); break;
-        case 0x6a: printf("MOV    L,D"); printf("\n"); break;
-        case 0x6b: printf("MOV    L,E"); printf("\n"); break;
-        case 0x6c: printf("MOV    L,H"); printf("\n"); break;
-        case 0x6d: printf("MOV    L,L"); printf("\n"); break;
-        case 0x6e: printf("MOV    L,M"); printf("\n"); break;
-        case 0x6f: printf("MOV    L,A"); printf("\n"); break;
-        case 0x70: printf("MOV    M,B"); printf("\n"); break;
-        case 0x71: printf("MOV    M,C"); printf("\n"); break;
-        case 0x72: printf("MOV    M,D"); printf("\n"); break;
-        case 0x73: printf("MOV    M,E"); printf("\n"); break;
-        case 0x74: printf("MOV    M,H"); printf("\n"); break;
-        case 0x75: printf("MOV    M,L"); printf("\n"); break;
-        case 0x76: printf("HLT"); printf("\n"); break;
-        case 0x77: printf("MOV    M,A"); printf("\n"); break;
-        case 0x78: printf("MOV    A,B"); printf("\n"); break;
-        case 0x79: printf("MOV    A,C"); printf("\n"); break;
-        case 0x7a: printf("MOV    A,D"); printf("\n"); break;
-        case 0x7b: printf("MOV    A,E"); printf("\n"); break;
-        case 0x7c: printf("MOV    A,H"); printf("\n"); break;
-        case 0x7d: printf("MOV    A,L"); printf("\n"); break;
-        case 0x7e: printf("MOV    A,M"); printf("\n"); break;
-        case 0x7f: printf("MOV    A,A"); printf("\n"); break;
-        case 0x80: printf("ADD    B"); printf("\n"); break;
-        case 0x81: printf("ADD    C"); printf("\n"); break;
-        case 0x82: printf("ADD    D"); printf("\n"); break;
-        case 0x83: printf("ADD    E"); printf("\n"); break;
-        case 0x84: printf("ADD    H"); printf("\n"); break;
-        case 0x85: printf("ADD    L"); printf("\n"); break;
-        case 0x86: printf("ADD    M"); printf("\n"); break;
-        case 0x87: printf("ADD    A"); printf("\n"); break;
-        case 0x88: printf("ADC    B"); printf("\n"); break;
-        case 0x89: printf("ADC    C"); printf("\n"); break;
-        case 0x8a: printf("ADC    D"); printf("\n"); break;
-        case 0x8b: printf("ADC    E"); printf("\n"); break;
-        case 0x8c: printf("ADC    H"); printf("\n"); break;
-        case 0x8d: printf("ADC    L"); printf("\n"); break;
-        case 0x8e: printf("ADC    M"); printf("\n"); break;
-        case 0x8f: printf("ADC    A"); printf("\n"); break;
-        case 0x90: printf("SUB    B"); printf("\n"); break;
-        case 0x91: printf("SUB    C"); printf("\n"); break;
-        case 0x92: printf("SUB    D"); printf("\n"); break;
-        case 0x93: printf("SUB    E"); printf("\n"); break;
-        case 0x94: printf("SUB    H"); printf("\n"); break;
-        case 0x95: printf("SUB    L"); printf("\n"); break;
-        case 0x96: printf("SUB    M"); printf("\n"); break;
-        case 0x97: printf("SUB    A"); printf("\n"); break;
-        case 0x98: printf("SBB    B"); printf("\n"); break;
-        case 0x99: printf("SBB    C"); printf("\n"); break;
-        case 0x9a: printf("SBB    D"); printf("\n"); break;
-        case 0x9b: printf("SBB    E"); printf("\n"); break;
-        case 0x9c: printf("SBB    H"); printf("\n"); break;
-        case 0x9d: printf("SBB    L"); printf("\n"); break;
-        case 0x9e: printf("SBB    M"); printf("\n"); break;
-        case 0x9f: printf("SBB    A"); printf("\n"); break;
-        case 0xa0: printf("ANA    B"); printf("\n"); break;
-        case 0xa1: printf("ANA    C"); printf("\n"); break;
-        case 0xa2: printf("ANA    D"); printf("\n"); break;
-        case 0xa3: printf("ANA    E"); printf("\n"); break;
-        case 0xa4: printf("ANA    H"); printf("\n"); break;
-        case 0xa5: printf("ANA    L"); printf("\n"); break;
-        case 0xa6: printf("ANA    M"); printf("\n"); break;
-        case 0xa7: printf("ANA    A"); printf("\n"); break;
-        case 0xa8: printf("XRA    B"); printf("\n"); break;
-        case 0xa9: printf("XRA    C"); printf("\n"); break;
-        case 0xaa: printf("XRA    D"); printf("\n"); break;
-        case 0xab: printf("XRA    E"); printf("\n"); break;
-        case 0xac: printf("XRA    H"); printf("\n"); break;
-        case 0xad: printf("XRA    L"); printf("\n"); break;
-        case 0xae: printf("XRA    M"); printf("\n"); break;
-        case 0xaf: printf("XRA    A"); printf("\n"); break;
-        case 0xb0: printf("ORA    B"); printf("\n"); break;
-        case 0xb1: printf("ORA    C"); printf("\n"); break;
-        case 0xb2: printf("ORA    D"); printf("\n"); break;
-        case 0xb3: printf("ORA    E"); printf("\n"); break;
-        case 0xb4: printf("ORA    H"); printf("\n"); break;
-        case 0xb5: printf("ORA    L"); printf("\n"); break;
-        case 0xb6: printf("ORA    M"); printf("\n"); break;
-        case 0xb7: printf("ORA    A"); printf("\n"); break;
-        case 0xb8: printf("CMP    B"); printf("\n"); break;
-        case 0xb9: printf("CMP    C"); printf("\n"); break;
-        case 0xba: printf("CMP    D"); printf("\n"); break;
-        case 0xbb: printf("CMP    E"); printf("\n"); break;
-        case 0xbc: printf("CMP    H"); printf("\n"); break;
-        case 0xbd: printf("CMP    L"); printf("\n"); break;
-        case 0xbe: printf("CMP    M"); printf("\n"); break;
-        case 0xbf: printf("CMP    A"); printf("\n"); break;
-        case 0xc0: printf("RNZ"); printf("\n"); break;
-        case 0xc1: printf("POP    B"); printf("\n"); break;
-        case 0xc2: printf("JNZ    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xc3: printf("JMP    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xc4: printf("CNZ    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xc5: printf("PUSH   B"); printf("\n"); break;
-        case 0xc6: printf("ADI    #$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0xc7: printf("RST    0"); printf("\n"); break;
-        case 0xc8: printf("RZ"); printf("\n"); break;
-        case 0xc9: printf("RET"); printf("\n"); break;
-        case 0xca: printf("JZ     $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xcb: printf("NOP"); printf("\n"); break;
-        case 0xcc: printf("CZ     $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xcd: printf("CALL   $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xce: printf("ACI    #$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0xcf: printf("RST    1"); printf("\n"); break;
-        case 0xd0: printf("RNC"); printf("\n"); break;
-        case 0xd1: printf("POP    D"); printf("\n"); break;
-        case 0xd2: printf("JNC    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xd3: printf("OUT    $%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0xd4: printf("CNC    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xd5: printf("PUSH   D"); printf("\n"); break;
-        case 0xd6: printf("SUI    #$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0xd7: printf("RST    2"); printf("\n"); break;
-        case 0xd8: printf("RC"); printf("\n"); break;
-        case 0xd9: printf("NOP"); printf("\n"); break;
-        case 0xda: printf("JC     $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xdb: printf("IN     #$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0xdc: printf("CC     $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xdd: printf("NOP"); printf("\n"); break;
-        case 0xde: printf("SBI    #$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0xdf: printf("RST    3"); printf("\n"); break;
-        case 0xe0: printf("RPO"); printf("\n"); break;
-        case 0xe1: printf("POP    H"); printf("\n"); break;
-        case 0xe2: printf("JPO    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xe3: printf("XTHL"); printf("\n"); break;
-        case 0xe4: printf("CPO    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xe5: printf("PUSH   H"); printf("\n"); break;
-        case 0xe6: printf("ANI    #$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0xe7: printf("RST    4"); printf("\n"); break;
-        case 0xe8: printf("RPE"); printf("\n"); break;
-        case 0xe9: printf("PCHL"); printf("\n"); break;
-        case 0xea: printf("JPE    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xeb: printf("XCHG"); printf("\n"); break;
-        case 0xec: printf("CPE    $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xed: printf("NOP"); printf("\n"); break;
-        case 0xee: printf("XRI    #$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0xef: printf("RST    5"); printf("\n"); break;
-        case 0xf0: printf("RP"); printf("\n"); break;
-        case 0xf1: printf("POP    PSW"); printf("\n"); break;
-        case 0xf2: printf("JP     $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xf3: printf("DI"); printf("\n"); break;
-        case 0xf4: printf("CP     $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xf5: printf("PUSH   PSW"); printf("\n"); break;
-        case 0xf6: printf("ORI    #$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0xf7: printf("RST    6"); printf("\n"); break;
-        case 0xf8: printf("RM"); printf("\n"); break;
-        case 0xf9: printf("SPHL"); printf("\n"); break;
-        case 0xfa: printf("JM     $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xfb: printf("EI"); printf("\n"); break;
-        case 0xfc: printf("CM     $%02x%02x", code[2], code[1]); opbytes = 3; printf("\n"); break;
-        case 0xfd: printf("NOP"); printf("\n"); break;
-        case 0xfe: printf("CPI    #$%02x", code[1]); opbytes = 2; printf("\n"); break;
-        case 0xff: printf("RST    7"); printf("\n"); break;
+    static unsigned char empty_file[1];
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
     }
-    return opbytes;
+
+    *size = st.st_size;
+    if (*size == 0) {
+        close(fd);
+        return empty_file;
+    }
+    unsigned char *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return data == MAP_FAILED ? NULL : data;
+}
+
+void unmap_file(unsigned char *data, size_t size) {
+    if (size > 0)
+        munmap(data, size);
+}
+
+int open_input(const char *path, Input *input) {
+    /* maps path, or reads all of stdin for "-"
+     * return 0, or -1 if it can't be read */
+
+    if (strcmp(path, "-") != 0) {
+        input->data = map_file(path, &input->size);
+        input->mapped = 1;
+    } else {
+        size_t capacity = 1 << 16;
+        input->data = malloc(capacity);
+        input->size = 0;
+        input->mapped = 0;
+        for (;;) {
+            if (input->size == capacity)
+                input->data = realloc(input->data, capacity *= 2);
+            ssize_t n = read(STDIN_FILENO, input->data + input->size, capacity - input->size);
+            if (n == 0)
+                break;
+            if (n < 0 && errno != EINTR) {
+                free(input->data);
+                input->data = NULL;
+                break;
+            }
+            if (n > 0)
+                input->size += n;
+        }
+    }
+
+    if (input->data == NULL) {
+        fprintf(stderr, "error: could not open %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+void close_input(Input *input) {
+    if (input->mapped)
+        unmap_file(input->data, input->size);
+    else
+        free(input->data);
+}
+
+char *reserve_output(OutputBuffer *out, size_t needed) {
+    /* makes room for needed more chars in out, writing out what it holds
+     * first if there is less, then the caller adds what it puts there to
+     * out->len
+     * return where the chars go */
+
+    if (out->size - out->len < needed)
+        flush_output(out);
+    return out->data + out->len;
+}
+
+int flush_output(OutputBuffer *out) {
+    /* writes what out holds to out->fd and empties it
+     * return 0, or -1 if this or an earlier write failed */
+
+    const char *data = out->data;
+    while (out->len > 0 && !out->failed) {
+        ssize_t n = write(out->fd, data, out->len);
+        if (n < 0 && errno != EINTR)
+            out->failed = 1;
+        if (n > 0) {
+            data += n;
+            out->len -= n;
+        }
+    }
+    out->len = 0;
+    return out->failed ? -1 : 0;
 }
 
 //int main(int argc, char** argv) {
@@ -292,7 +477,7 @@ int disassemble_machine_code(unsigned char *codebuffer, int pc) {
 //    int pc = 0;
 //
 //    while (pc<fsize) {
-//        pc += disassemble_machine_code(buffer, pc);
+//        pc += disassemble_machine_code(buffer, pc, fsize);
 //    }
 //    return 0;
 //}
@@ -1,3 +1,84 @@
+#ifndef TOOLS_H
+#define TOOLS_H
+
 #include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+
+/* Longest line format_instruction() can produce:
+ * "ffff " (up to "ffffffff " past 64KB) + mnemonic + operand + "\n" */
+#define DISASM_LINE_MAX 32
+/* Longest line format_chip_state() can produce */
+#define CHIP_STATE_LINE_MAX 64
+
+/* Output gathered in one large buffer and written to fd as it fills */
+typedef struct OutputBuffer {
+    char *data;
+    size_t size;
+    size_t len;             // Chars in data not written yet
+    int fd;
+    int failed;             // 1 once a write to fd has failed
+} OutputBuffer;
+
+/* A file mapped into memory, or standard input read into it */
+typedef struct Input {
+    unsigned char *data;
+    size_t size;
+    int mapped;
+} Input;
+
+typedef struct Opcode {
+    const char *mnemonic;   // Text up to (and including) the operand prefix
+    u_int8_t mnemonic_len;
+    u_int8_t size;          // Instruction Size in bytes (1, 2 or 3)
+} Opcode;
+
+extern const Opcode opcode_table[256];
+
+/* Little endian fields of the file formats */
+static inline void put_u16(u_int8_t *out, u_int16_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+}
+
+static inline void put_u32(u_int8_t *out, u_int32_t value) {
+    put_u16(out, value);
+    put_u16(out + 2, value >> 16);
+}
+
+static inline void put_u64(u_int8_t *out, u_int64_t value) {
+    put_u32(out, value);
+    put_u32(out + 4, value >> 32);
+}
+
+static inline u_int16_t get_u16(const u_int8_t *in) {
+    return in[0] | (in[1] << 8);
+}
+
+static inline u_int32_t get_u32(const u_int8_t *in) {
+    return get_u16(in) | ((u_int32_t) get_u16(in + 2) << 16);
+}
+
+static inline u_int64_t get_u64(const u_int8_t *in) {
+    return get_u32(in) | ((u_int64_t) get_u32(in + 4) << 32);
+}
+
+/* Two lowercase hex digits; return the position after them */
+static inline char *put_hex8(char *out, u_int8_t value) {
+    out[0] = "0123456789abcdef"[value >> 4];
+    out[1] = "0123456789abcdef"[value & 0x0f];
+    return out + 2;
+}
+
+int disassemble_machine_code(unsigned char*, int, int);
+int format_instruction(const unsigned char*, int, int, char*, int*);
+size_t disassemble_range(const unsigned char*, int*, int, char*, size_t);
+int format_chip_state(const Chip8080*, char*);
+unsigned char *map_file(const char*, size_t*);
+void unmap_file(unsigned char*, size_t);
+int open_input(const char*, Input*);
+void close_input(Input*);
+char *reserve_output(OutputBuffer*, size_t);
+int flush_output(OutputBuffer*);
 
-int disassemble_machine_code(unsigned char*, int);
+#endif
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "chip8080.h"
+#include "video.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+void init_rasterizer(Rasterizer *rasterizer, int overlay) {
+    memset(rasterizer->planes, 0, sizeof(rasterizer->planes));
+    rasterizer->overlay = overlay;
+}
+
+u_int32_t overlay_color(int x, int y) {
+    /* Color of the cabinet overlay at picture position x, y:
+     * red over the UFO, green over the shields, player and the
+     * reserve ships at the bottom left, white elsewhere */
+    if (y >= 32 && y < 64)
+        return PIXEL_RED;
+    if (y >= 184 && y < 240)
+        return PIXEL_GREEN;
+    if (y >= 240 && x >= 16 && x < 134)
+        return PIXEL_GREEN;
+    return PIXEL_WHITE;
+}
+
+static void load_planes(Rasterizer *rasterizer, const u_int8_t *memory) {
+    const u_int8_t *vram = memory + VIDEO_RAM;
+    for (int x = 0; x < VIDEO_WIDTH; x++)
+        for (int j = 0; j < VIDEO_LINE_BYTES; j++)
+            rasterizer->planes[j][x] = vram[x * VIDEO_LINE_BYTES + j];
+}
+
+/*
+ *  Row kernels: expand bit `bit` of the 224 plane bytes into one row
+ *  of the picture. Set pixels are found with and + compare-equal,
+ *  giving a 0x00/0xff byte mask that is widened for RGBA.
+ */
+
+static void expand_row_gray(const u_int8_t *plane, u_int8_t bit, u_int8_t *row) {
+    int x = 0;
+#if defined(__AVX2__)
+    __m256i mask_256 = _mm256_set1_epi8(bit);
+    for (; x + 32 <= VIDEO_WIDTH; x += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) &plane[x]);
+        v = _mm256_cmpeq_epi8(_mm256_and_si256(v, mask_256), mask_256);
+        _mm256_storeu_si256((__m256i*) &row[x], v);
+    }
+#elif defined(__SSE2__)
+    __m128i mask_128 = _mm_set1_epi8(bit);
+    for (; x + 16 <= VIDEO_WIDTH; x += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) &plane[x]);
+        v = _mm_cmpeq_epi8(_mm_and_si128(v, mask_128), mask_128);
+        _mm_storeu_si128((__m128i*) &row[x], v);
+    }
+#endif
+    for (; x < VIDEO_WIDTH; x++)
+        row[x] = (plane[x] & bit) ? 0xff : 0x00;
+}
+
+static void expand_row_rgba(const u_int8_t *plane, u_int8_t bit, u_int32_t *row, u_int32_t color) {
+    int x = 0;
+#if defined(__AVX2__)
+    __m128i mask_64 = _mm_set1_epi8(bit);
+    __m256i color_256 = _mm256_set1_epi32(color);
+    __m256i black_256 = _mm256_set1_epi32(PIXEL_BLACK);
+    for (; x + 8 <= VIDEO_WIDTH; x += 8) {
+        __m128i v = _mm_loadl_epi64((const __m128i*) &plane[x]);
+        v = _mm_cmpeq_epi8(_mm_and_si128(v, mask_64), mask_64);
+        __m256i pixels = _mm256_and_si256(_mm256_cvtepi8_epi32(v), color_256);
+        _mm256_storeu_si256((__m256i*) &row[x], _mm256_or_si256(pixels, black_256));
+    }
+#elif defined(__SSE2__)
+    __m128i mask_128 = _mm_set1_epi8(bit);
+    __m128i color_128 = _mm_set1_epi32(color);
+    __m128i black_128 = _mm_set1_epi32(PIXEL_BLACK);
+    for (; x + 16 <= VIDEO_WIDTH; x += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) &plane[x]);
+        v = _mm_cmpeq_epi8(_mm_and_si128(v, mask_128), mask_128);
+        __m128i lo = _mm_unpacklo_epi8(v, v);
+        __m128i hi = _mm_unpackhi_epi8(v, v);
+        __m128i quads[4] = {
+            _mm_unpacklo_epi16(lo, lo), _mm_unpackhi_epi16(lo, lo),
+            _mm_unpacklo_epi16(hi, hi), _mm_unpackhi_epi16(hi, hi)
+        };
+        for (int i = 0; i < 4; i++) {
+            __m128i pixels = _mm_or_si128(_mm_and_si128(quads[i], color_128), black_128);
+            _mm_storeu_si128((__m128i*) &row[x + 4 * i], pixels);
+        }
+    }
+#endif
+    for (; x < VIDEO_WIDTH; x++)
+        row[x] = (plane[x] & bit) ? color : PIXEL_BLACK;
+}
+
+void rasterize_gray(Rasterizer *rasterizer, const u_int8_t *memory, u_int8_t *frame) {
+    /* Converts the video RAM in memory into frame, VIDEO_WIDTH x
+     * VIDEO_HEIGHT bytes top row first, 0xff for a lit pixel */
+    load_planes(rasterizer, memory);
+    for (int y = 0; y < VIDEO_HEIGHT; y++) {
+        int k = VIDEO_HEIGHT - 1 - y;
+        expand_row_gray(rasterizer->planes[k >> 3], 1 << (k & 7), &frame[y * VIDEO_WIDTH]);
+    }
+}
+
+void rasterize_rgba(Rasterizer *rasterizer, const u_int8_t *memory, u_int32_t *frame) {
+    /* Like rasterize_gray() with RGBA pixels, white or overlay tinted */
+    load_planes(rasterizer, memory);
+    for (int y = 0; y < VIDEO_HEIGHT; y++) {
+        int k = VIDEO_HEIGHT - 1 - y;
+        u_int32_t *row = &frame[y * VIDEO_WIDTH];
+        u_int8_t bit = 1 << (k & 7);
+
+        if (!rasterizer->overlay) {
+            expand_row_rgba(rasterizer->planes[k >> 3], bit, row, PIXEL_WHITE);
+            continue;
+        }
+        expand_row_rgba(rasterizer->planes[k >> 3], bit, row, overlay_color(VIDEO_WIDTH - 1, y));
+        if (y >= 240) {
+            /* The only band that doesn't span the whole row */
+            for (int x = 16; x < 134; x++)
+                if (row[x] != PIXEL_BLACK)
+                    row[x] = PIXEL_GREEN;
+        }
+    }
+}
+
+/*
+ *  Incremental rendering
+ *
+ *  The frame passed in holds the previous picture; only the columns of
+ *  lines written since then are redrawn, one strided column each.
+ */
+
+void take_dirty_lines(Chip8080 *chip, u_int8_t *lines) {
+    /* Moves the dirty bits of the video lines into lines
+     * (VIDEO_DIRTY_BYTES, bit x for line x) and clears them on chip */
+    memcpy(lines, &chip->dirty[VIDEO_DIRTY_OFFSET], VIDEO_DIRTY_BYTES);
+    memset(&chip->dirty[VIDEO_DIRTY_OFFSET], 0, VIDEO_DIRTY_BYTES);
+}
+
+int count_dirty_lines(const u_int8_t *lines) {
+    int count = 0;
+    for (int i = 0; i < VIDEO_DIRTY_BYTES; i++)
+        count += __builtin_popcount(lines[i]);
+    return count;
+}
+
+static inline int line_is_dirty(const u_int8_t *lines, int x) {
+    return (lines[x >> 3] >> (x & 7)) & 1;
+}
+
+void rasterize_gray_lines(Rasterizer *rasterizer, const u_int8_t *memory,
+                          const u_int8_t *lines, u_int8_t *frame) {
+    /* Like rasterize_gray(), redrawing only the lines set in lines */
+    if (count_dirty_lines(lines) > FULL_REDRAW_LINES) {
+        rasterize_gray(rasterizer, memory, frame);
+        return;
+    }
+
+    const u_int8_t *vram = memory + VIDEO_RAM;
+    for (int x = 0; x < VIDEO_WIDTH; x++) {
+        if (!line_is_dirty(lines, x))
+            continue;
+        u_int8_t *column = &frame[(VIDEO_HEIGHT - 1) * VIDEO_WIDTH + x];
+        for (int j = 0; j < VIDEO_LINE_BYTES; j++) {
+            u_int8_t v = vram[x * VIDEO_LINE_BYTES + j];
+            for (int b = 0; b < 8; b++, column -= VIDEO_WIDTH)
+                *column = ((v >> b) & 1) ? 0xff : 0x00;
+        }
+    }
+}
+
+void rasterize_rgba_lines(Rasterizer *rasterizer, const u_int8_t *memory,
+                          const u_int8_t *lines, u_int32_t *frame) {
+    /* Like rasterize_rgba(), redrawing only the lines set in lines */
+    if (count_dirty_lines(lines) > FULL_REDRAW_LINES) {
+        rasterize_rgba(rasterizer, memory, frame);
+        return;
+    }
+
+    const u_int8_t *vram = memory + VIDEO_RAM;
+    for (int x = 0; x < VIDEO_WIDTH; x++) {
+        if (!line_is_dirty(lines, x))
+            continue;
+        int y = VIDEO_HEIGHT - 1;
+        for (int j = 0; j < VIDEO_LINE_BYTES; j++) {
+            u_int8_t v = vram[x * VIDEO_LINE_BYTES + j];
+            for (int b = 0; b < 8; b++, y--) {
+                u_int32_t color = rasterizer->overlay ? overlay_color(x, y) : PIXEL_WHITE;
+                frame[y * VIDEO_WIDTH + x] = ((v >> b) & 1) ? color : PIXEL_BLACK;
+            }
+        }
+    }
+}
+
+/*
+ *  Frame skip
+ */
+
+void init_frame_skip(FrameSkip *skip, u_int32_t every) {
+    /* The first frame let through is redrawn in full */
+    skip->every = every;
+    skip->frames = 0;
+    skip->rasterized = 0;
+    memset(skip->pending, 0xff, VIDEO_DIRTY_BYTES);
+    skip->clear_pending = 0;
+}
+
+const u_int8_t* next_frame_lines(FrameSkip *skip, const u_int8_t *lines) {
+    /* Takes the dirty lines of a finished frame
+     * return NULL if the frame is to be skipped, else the lines to
+     * redraw since the last rasterized frame (valid until the next call) */
+    if (skip->clear_pending) {
+        memset(skip->pending, 0, VIDEO_DIRTY_BYTES);
+        skip->clear_pending = 0;
+    }
+    for (int i = 0; i < VIDEO_DIRTY_BYTES; i++)
+        skip->pending[i] |= lines[i];
+
+    u_int64_t frame = skip->frames++;
+    if (skip->every == 0 || frame % skip->every != 0)
+        return NULL;
+    skip->rasterized++;
+    skip->clear_pending = 1;
+    return skip->pending;
+}
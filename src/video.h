@@ -0,0 +1,59 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "chip8080.h"
+
+/* Space Invaders video: 1 bit per pixel at 0x2400-0x3fff, 224 lines of
+ * 32 bytes. The monitor is rotated, so each line is a column of the
+ * 224x256 picture, bit 0 of its first byte at the bottom. */
+#define VIDEO_RAM 0x2400
+#define VIDEO_RAM_SIZE 0x1c00
+#define VIDEO_LINE_BYTES 32
+#define VIDEO_WIDTH 224
+#define VIDEO_HEIGHT 256
+
+/* A video line is one dirty block of Chip8080, so the dirty bits of the
+ * 224 lines are 28 bytes of chip->dirty */
+#define VIDEO_DIRTY_BYTES (VIDEO_WIDTH / 8)
+#define VIDEO_DIRTY_OFFSET (VIDEO_RAM >> DIRTY_BLOCK_SHIFT >> 3)
+/* Past this many dirty lines a full redraw is cheaper */
+#define FULL_REDRAW_LINES 48
+
+/* RGBA pixels, R in the low byte */
+#define PIXEL_BLACK 0xff000000
+#define PIXEL_WHITE 0xffffffff
+#define PIXEL_RED 0xff0000ff
+#define PIXEL_GREEN 0xff00ff00
+
+typedef struct Rasterizer {
+    /* planes[j][x] is byte j of line x: one plane byte per column, so
+     * a picture row is 224 consecutive bytes tested against one bit */
+    u_int8_t planes[VIDEO_LINE_BYTES][VIDEO_WIDTH] __attribute__((aligned(32)));
+    int overlay;        // Tint rows like the cabinet's colored gel
+} Rasterizer;
+
+/* Picks the frames worth rasterizing when running faster than real
+ * time; the lines of skipped frames are carried over to the next
+ * rasterized one, so incremental redraws stay exact */
+typedef struct FrameSkip {
+    u_int32_t every;                        // Rasterize one frame in every, 0 for none
+    u_int64_t frames;                       // Frames seen
+    u_int64_t rasterized;                   // Frames let through
+    u_int8_t pending[VIDEO_DIRTY_BYTES];    // Lines changed since the last one let through
+    int clear_pending;
+} FrameSkip;
+
+void init_rasterizer(Rasterizer*, int);
+void rasterize_gray(Rasterizer*, const u_int8_t*, u_int8_t*);
+void rasterize_rgba(Rasterizer*, const u_int8_t*, u_int32_t*);
+u_int32_t overlay_color(int, int);
+void take_dirty_lines(Chip8080*, u_int8_t*);
+int count_dirty_lines(const u_int8_t*);
+void rasterize_gray_lines(Rasterizer*, const u_int8_t*, const u_int8_t*, u_int8_t*);
+void rasterize_rgba_lines(Rasterizer*, const u_int8_t*, const u_int8_t*, u_int32_t*);
+void init_frame_skip(FrameSkip*, u_int32_t);
+const u_int8_t* next_frame_lines(FrameSkip*, const u_int8_t*);
+
+#endif
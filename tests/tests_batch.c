@@ -0,0 +1,112 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "../src/tools.h"
+#include "../src/batch.h"
+
+#define IMAGE_SIZE 200000
+
+static unsigned char *make_random_image() {
+    unsigned char *image = malloc(IMAGE_SIZE);
+    u_int32_t seed = 8080;
+    for (int i = 0; i < IMAGE_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        image[i] = seed >> 16;
+    }
+    return image;
+}
+
+static char *linear_sweep(const unsigned char *image, int size, size_t *len) {
+    size_t out_size = (size_t) size * DISASM_LINE_MAX;
+    char *out = malloc(out_size);
+    int pc = 0;
+    *len = disassemble_range(image, &pc, size, out, out_size);
+    return out;
+}
+
+static void test_find_resync_point(void **state) {
+    /* Test that the split point is an instruction start of the
+     * sequential sweep: 0x01 (LXI) swallows the boundary byte */
+    unsigned char code[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+    assert_int_equal(4, find_resync_point(code, sizeof(code), 2));
+    assert_int_equal(4, find_resync_point(code, sizeof(code), 3));
+    assert_int_equal(5, find_resync_point(code, sizeof(code), 5));
+}
+
+static void test_split_image_matches_linear_sweep(void **state) {
+    /* Test that concatenating the listings of all jobs gives
+     * exactly the single threaded listing */
+    unsigned char *image = make_random_image();
+    DisasmJob jobs[64];
+    size_t expected_len;
+    char *expected = linear_sweep(image, IMAGE_SIZE, &expected_len);
+
+    int n_jobs = split_image(image, IMAGE_SIZE, 4096, jobs, 64);
+    assert_true(n_jobs > 1);
+    assert_int_equal(0, jobs[0].start);
+    assert_int_equal(IMAGE_SIZE, jobs[n_jobs - 1].end);
+
+    FILE *f = tmpfile();
+    assert_int_equal(0, run_disasm_jobs(jobs, n_jobs, 4, fileno(f)));
+
+    char *actual = malloc(expected_len + 1);
+    rewind(f);
+    assert_int_equal(expected_len, fread(actual, 1, expected_len + 1, f));
+    assert_memory_equal(expected, actual, expected_len);
+
+    fclose(f);
+    free(actual);
+    free(expected);
+    free(image);
+}
+
+static void test_disassemble_files_reads_stdin(void **state) {
+    /* Test that a file of - is read from standard input, split and
+     * listed like any other */
+    unsigned char *image = make_random_image();
+    size_t expected_len;
+    char *expected = linear_sweep(image, IMAGE_SIZE, &expected_len);
+    char *paths[] = {"-"};
+    int saved_stdin = dup(STDIN_FILENO);
+
+    FILE *in = tmpfile();
+    assert_int_equal(IMAGE_SIZE, fwrite(image, 1, IMAGE_SIZE, in));
+    fflush(in);
+    rewind(in);
+    dup2(fileno(in), STDIN_FILENO);
+
+    FILE *out = tmpfile();
+    int status = disassemble_files(paths, 1, 2, fileno(out));
+    dup2(saved_stdin, STDIN_FILENO);
+    close(saved_stdin);
+    assert_int_equal(0, status);
+
+    char *actual = malloc(expected_len + 1);
+    rewind(out);
+    assert_int_equal(expected_len, fread(actual, 1, expected_len + 1, out));
+    assert_memory_equal(expected, actual, expected_len);
+
+    fclose(out);
+    fclose(in);
+    free(actual);
+    free(expected);
+    free(image);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_find_resync_point),
+        cmocka_unit_test(test_split_image_matches_linear_sweep),
+        cmocka_unit_test(test_disassemble_files_reads_stdin),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -50,6 +50,7 @@ static void test_stax_b(void **state) {
 
     assert_int_equal(0x0a, chip->memory[0x0001]);
     assert_int_equal(1, chip->reg_pc);
+    assert_int_equal(0x01, chip->dirty[0]); // 32 byte block 0 was written
 
     // We check that only the specified memory offset has the data,
     // and the adjacents places are empty (0)
@@ -88,7 +89,7 @@ static void test_inr_b(void **state) {
 
     /* Scenario A: reg_b = -1
      * Expected Result: reg_b = 0
-     * Flags: Z=1, S=0, P=1, AC=0
+     * Flags: Z=1, S=0, P=1, AC=1 (the low nibble carries)
      */
 
     Chip8080 *chip = make_chip8080();
@@ -101,7 +102,7 @@ static void test_inr_b(void **state) {
     assert_int_equal(0x01, chip->flags.z);
     assert_int_equal(0x00, chip->flags.s);
     assert_int_equal(0x01, chip->flags.p);
-    assert_int_equal(0x00, chip->flags.ac);
+    assert_int_equal(0x01, chip->flags.ac);
     assert_int_equal(0x0100, chip->reg_pc);
 
     destroy_chip8080(chip);
@@ -136,7 +137,7 @@ static void test_dcr_b(void **state) {
      *
      * Scenario: reg_b = 1
      * Expected Result: reg_b = 0
-     * Flags: Z=1, S=0, P=1, AC=0
+     * Flags: Z=1, S=0, P=1, AC=1 (no borrow from the high nibble)
      */
 
     Chip8080 *chip = make_chip8080();
@@ -149,7 +150,7 @@ static void test_dcr_b(void **state) {
     assert_int_equal(0x1, chip->flags.z);
     assert_int_equal(0x0, chip->flags.s);
     assert_int_equal(0x01, chip->flags.p);
-    assert_int_equal(0x00, chip->flags.ac);
+    assert_int_equal(0x01, chip->flags.ac);
     assert_int_equal(0x0100, chip->reg_pc);
 
     destroy_chip8080(chip);
@@ -256,7 +257,7 @@ static void test_inr_c(void **state) {
      *
      * Scenario C = 0xff
      * Expected Result: 0x00
-     * Flags: Z=1, S=0, P=1, AC=0
+     * Flags: Z=1, S=0, P=1, AC=1
      */
 
     Chip8080 *chip = make_chip8080();
@@ -269,7 +270,7 @@ static void test_inr_c(void **state) {
     assert_int_equal(0x01, chip->flags.z);
     assert_int_equal(0x00, chip->flags.s);
     assert_int_equal(0x01, chip->flags.p);
-    assert_int_equal(0x00, chip->flags.ac);
+    assert_int_equal(0x01, chip->flags.ac);
     assert_int_equal(0x0100, chip->reg_pc);
 
     destroy_chip8080(chip);
@@ -420,7 +421,7 @@ static void test_inr_d(void **state) {
     assert_int_equal(0x01, chip->flags.z);
     assert_int_equal(0x00, chip->flags.s);
     assert_int_equal(0x01, chip->flags.p);
-    assert_int_equal(0x00, chip->flags.ac);
+    assert_int_equal(0x01, chip->flags.ac);
     assert_int_equal(0x0100, chip->reg_pc);
 
     destroy_chip8080(chip);
@@ -440,7 +441,7 @@ static void test_dcr_d(void **state) {
     assert_int_equal(0x01, chip->flags.z);
     assert_int_equal(0x00, chip->flags.s);
     assert_int_equal(0x01, chip->flags.p);
-    assert_int_equal(0x00, chip->flags.ac);
+    assert_int_equal(0x01, chip->flags.ac);
     assert_int_equal(0x00ff, chip->reg_pc);
 
     destroy_chip8080(chip);
@@ -549,7 +550,7 @@ static void test_inr_e(void **state) {
     assert_int_equal(0x01, chip->flags.z);
     assert_int_equal(0x00, chip->flags.s);
     assert_int_equal(0x01, chip->flags.p);
-    assert_int_equal(0x00, chip->flags.ac);
+    assert_int_equal(0x01, chip->flags.ac);
     assert_int_equal(0x0100, chip->reg_pc);
 
     destroy_chip8080(chip);
@@ -571,7 +572,7 @@ static void test_dcr_e(void **state) {
     assert_int_equal(0x1, chip->flags.z);
     assert_int_equal(0x0, chip->flags.s);
     assert_int_equal(0x01, chip->flags.p);
-    assert_int_equal(0x00, chip->flags.ac);
+    assert_int_equal(0x01, chip->flags.ac);
     assert_int_equal(0x0100, chip->reg_pc);
 
     destroy_chip8080(chip);
@@ -714,7 +715,7 @@ static void test_dcr_h(void **state) {
     assert_int_equal(0x01, chip->flags.z);
     assert_int_equal(0x00, chip->flags.s);
     assert_int_equal(0x01, chip->flags.p);
-    assert_int_equal(0x00, chip->flags.ac);
+    assert_int_equal(0x01, chip->flags.ac);
     assert_int_equal(0x1100, chip->reg_pc);
 
     destroy_chip8080(chip);
@@ -873,6 +874,372 @@ static void test_cma(void **state) {
     destroy_chip8080(chip);
 }
 
+static u_int8_t in_handler_port;
+
+static u_int8_t test_port_in(Chip8080 *chip, u_int8_t port) {
+    in_handler_port = port;
+    return 0x5a;
+}
+
+static void test_out_d8(void **state) {
+    /* Tests that: OUT D8: Port Byte 2 <- A, calling the port handler */
+    Chip8080 *chip = make_chip8080();
+    chip->reg_a = 0x11;
+    chip->reg_pc = 0x00;
+    u_int8_t program_data[] = {0xd3, 0x05};
+
+    out_d8(chip, program_data);
+
+    assert_int_equal(0x11, chip->out_ports[0x05]);
+    assert_int_equal(0x02, chip->reg_pc);
+
+    destroy_chip8080(chip);
+}
+
+static void test_in_d8(void **state) {
+    /* Tests that: IN D8: A <- Port Byte 2, from the latch or the handler */
+    Chip8080 *chip = make_chip8080();
+    chip->reg_pc = 0x00;
+    chip->in_ports[0x01] = 0x08;
+    u_int8_t program_data[] = {0xdb, 0x01};
+
+    in_d8(chip, program_data);
+
+    assert_int_equal(0x08, chip->reg_a);
+    assert_int_equal(0x02, chip->reg_pc);
+
+    set_port_handlers(chip, 0x01, test_port_in, NULL);
+    in_d8(chip, program_data);
+
+    assert_int_equal(0x5a, chip->reg_a);
+    assert_int_equal(0x01, in_handler_port);
+    assert_int_equal(0x04, chip->reg_pc);
+
+    destroy_chip8080(chip);
+}
+
+static void test_di_ei(void **state) {
+    /* Tests that: EI and DI set and clear the interrupt enable */
+    Chip8080 *chip = make_chip8080();
+    chip->reg_pc = 0x00;
+
+    ei(chip);
+    assert_int_equal(0x01, chip->irq_enable);
+    assert_int_equal(0x01, chip->reg_pc);
+
+    di(chip);
+    assert_int_equal(0x00, chip->irq_enable);
+    assert_int_equal(0x02, chip->reg_pc);
+
+    destroy_chip8080(chip);
+}
+
+static void test_run8080_until(void **state) {
+    /* Tests that: the run loop counts clock cycles per opcode and
+     * stops on the first instruction boundary past the deadline */
+    Chip8080 *chip = make_chip8080();
+    chip->memory[0x0000] = 0x01; // LXI B, 10 cycles
+    chip->memory[0x0003] = 0x04; // INR B, 5 cycles
+    chip->memory[0x0004] = 0x06; // MVI B, 7 cycles
+
+    assert_int_equal(RUN_BUDGET, run8080_until(chip, 12));
+    assert_int_equal(15, chip->cycles);
+    assert_int_equal(0x0004, chip->reg_pc);
+
+    assert_int_equal(RUN_BUDGET, run8080_until(chip, 15));
+    assert_int_equal(15, chip->cycles);
+    assert_int_equal(RUN_BUDGET, run8080_until(chip, 16));
+    assert_int_equal(22, chip->cycles);
+    assert_int_equal(0x0006, chip->reg_pc);
+
+    destroy_chip8080(chip);
+}
+
+static void test_run_status(void **state) {
+    /* Tests that: an opcode the core lacks is reported, not executed,
+     * with PC left on it, and a chip halted with interrupts off is
+     * reported as halted */
+    Chip8080 *chip = make_chip8080();
+    chip->memory[0x0000] = 0x04; // INR B
+    chip->memory[0x0001] = 0x07; // RLC, not in the core
+    chip->memory[0x0002] = 0x76; // HLT
+
+    assert_int_equal(RUN_OK, run8080(chip));
+    assert_int_equal(RUN_UNIMPLEMENTED, run8080(chip));
+    assert_int_equal(0x0001, chip->reg_pc);
+    assert_int_equal(5, chip->cycles);
+
+    assert_int_equal(RUN_UNIMPLEMENTED, run8080_until(chip, 1000));
+    assert_int_equal(0x0001, chip->reg_pc);
+    assert_int_equal(5, chip->cycles);
+
+    chip->reg_pc = 0x0002;
+    assert_int_equal(RUN_HALTED, run8080_until(chip, 1000));
+    assert_int_equal(1000, chip->cycles);
+    assert_int_equal(RUN_HALTED, run8080(chip));
+
+    destroy_chip8080(chip);
+}
+
+static void test_generate_interrupt(void **state) {
+    /* Tests that: an interrupt pushes PC and jumps to the RST vector,
+     * and is dropped while interrupts are disabled */
+    Chip8080 *chip = make_chip8080();
+    chip->reg_pc = 0x1234;
+    chip->reg_sp = 0x0000;
+
+    assert_int_equal(0, generate_interrupt(chip, 2));
+    assert_int_equal(0x1234, chip->reg_pc);
+
+    chip->irq_enable = 1;
+    assert_int_equal(1, generate_interrupt(chip, 2));
+    assert_int_equal(0x0010, chip->reg_pc);
+    assert_int_equal(0xfffe, chip->reg_sp);
+    assert_int_equal(0x12, chip->memory[0xffff]);
+    assert_int_equal(0x34, chip->memory[0xfffe]);
+    assert_int_equal(0x00, chip->irq_enable);
+    assert_int_equal(11, chip->cycles);
+
+    destroy_chip8080(chip);
+}
+
+static void test_wrap_at_top_of_memory(void **state) {
+    /* Tests that: operands of an instruction at 0xffff come from 0x0000
+     * on, and LHLD of 0xffff takes H from 0x0000 */
+    Chip8080 *chip = make_chip8080();
+    chip->memory[0xffff] = 0x01;    // LXI B,$1234
+    chip->memory[0x0000] = 0x34;
+    chip->memory[0x0001] = 0x12;
+    chip->reg_pc = 0xffff;
+
+    run8080(chip);
+
+    assert_int_equal(0x12, chip->reg_b);
+    assert_int_equal(0x34, chip->reg_c);
+    assert_int_equal(0x0002, chip->reg_pc);
+
+    chip->memory[0x0002] = 0x2a;    // LHLD $ffff
+    chip->memory[0x0003] = 0xff;
+    chip->memory[0x0004] = 0xff;
+    chip->memory[0xffff] = 0xcd;
+    chip->memory[0x0000] = 0xab;
+
+    run8080(chip);
+
+    assert_int_equal(0xab, chip->reg_h);
+    assert_int_equal(0xcd, chip->reg_l);
+    assert_int_equal(0x0005, chip->reg_pc);
+
+    destroy_chip8080(chip);
+}
+
+static void test_sta_lda(void **state) {
+    /* Tests that: STA stores A at the operand address and LDA reads it back */
+    Chip8080 *chip = make_chip8080();
+    unsigned char program[] = {0x32, 0x00, 0x24, 0x3a, 0x01, 0x24};
+    load_memory(chip, program, sizeof(program), 0);
+    chip->reg_a = 0x5a;
+    chip->memory[0x2401] = 0xa5;
+
+    run8080(chip);
+    assert_int_equal(0x5a, chip->memory[0x2400]);
+    run8080(chip);
+    assert_int_equal(0xa5, chip->reg_a);
+    assert_int_equal(0x0006, chip->reg_pc);
+    assert_int_equal(26, chip->cycles);
+
+    destroy_chip8080(chip);
+}
+
+static void test_ana(void **state) {
+    /* Tests that: ANA clears CY, takes AC from bit 3 of either operand
+     * and sets Z, S, P from the result */
+    Chip8080 *chip = make_chip8080();
+    chip->memory[0] = 0xa0;     // ANA B
+    chip->memory[1] = 0xa6;     // ANA M
+    chip->reg_a = 0xf8;
+    chip->reg_b = 0x81;
+    chip->flags.cy = 1;
+    chip->reg_h = 0x20;
+    chip->memory[0x2000] = 0x77;
+
+    run8080(chip);
+    assert_int_equal(0x80, chip->reg_a);
+    assert_int_equal(0, chip->flags.cy);
+    assert_int_equal(1, chip->flags.ac);
+    assert_int_equal(1, chip->flags.s);
+    assert_int_equal(0, chip->flags.z);
+    assert_int_equal(0, chip->flags.p);
+
+    run8080(chip);
+    assert_int_equal(0x00, chip->reg_a);
+    assert_int_equal(0, chip->flags.ac);
+    assert_int_equal(1, chip->flags.z);
+    assert_int_equal(1, chip->flags.p);
+    assert_int_equal(11, chip->cycles);
+
+    destroy_chip8080(chip);
+}
+
+static void test_jumps(void **state) {
+    /* Tests that: JMP always jumps and each conditional jump follows
+     * its flag, taken or not costing 10 cycles */
+    Chip8080 *chip = make_chip8080();
+    u_int8_t opcodes[] = {0xc2, 0xca, 0xd2, 0xda, 0xe2, 0xea, 0xf2, 0xfa};
+
+    for (int i = 0; i < 8; i++) {
+        for (int set = 0; set < 2; set++) {
+            reset_chip_state(chip);
+            chip->memory[0] = opcodes[i];
+            chip->memory[1] = 0x34;
+            chip->memory[2] = 0x12;
+            switch (i / 2) {
+                case 0: chip->flags.z = set; break;
+                case 1: chip->flags.cy = set; break;
+                case 2: chip->flags.p = set; break;
+                case 3: chip->flags.s = set; break;
+            }
+            run8080(chip);
+            assert_int_equal((i & 1) == set ? 0x1234 : 0x0003, chip->reg_pc);
+            assert_int_equal(10, chip->cycles);
+        }
+    }
+    reset_chip_state(chip);
+    chip->memory[0] = 0xc3;
+    run8080(chip);
+    assert_int_equal(0x1234, chip->reg_pc);
+
+    destroy_chip8080(chip);
+}
+
+static void test_cpi(void **state) {
+    /* Tests that: CPI leaves A alone, sets CY when A is below the operand
+     * and AC when the low nibble doesn't borrow */
+    Chip8080 *chip = make_chip8080();
+    unsigned char program[] = {0xfe, 0x40, 0xfe, 0x02, 0xfe, 0x4a};
+    load_memory(chip, program, sizeof(program), 0);
+    chip->reg_a = 0x4a;
+
+    run8080(chip);
+    assert_int_equal(0x4a, chip->reg_a);
+    assert_int_equal(0, chip->flags.cy);
+    assert_int_equal(1, chip->flags.ac);
+    assert_int_equal(0, chip->flags.z);
+
+    run8080(chip);
+    assert_int_equal(0, chip->flags.cy);
+    assert_int_equal(1, chip->flags.ac);
+    assert_int_equal(1, chip->flags.p);
+
+    chip->reg_a = 0x49;
+    run8080(chip);
+    assert_int_equal(1, chip->flags.cy);
+    assert_int_equal(0, chip->flags.ac);
+    assert_int_equal(1, chip->flags.s);
+    assert_int_equal(21, chip->cycles);
+
+    destroy_chip8080(chip);
+}
+
+static void test_hlt(void **state) {
+    /* Tests that: HLT stops the chip, which then only counts machine
+     * cycles, run8080_until() sleeps to the deadline and an interrupt
+     * resumes after the HLT */
+    Chip8080 *chip = make_chip8080();
+    chip->memory[0x0000] = 0x76;    // HLT
+    chip->reg_sp = 0x2400;
+    chip->irq_enable = 1;
+
+    run8080(chip);
+    assert_int_equal(1, chip->halted);
+    assert_int_equal(0x0001, chip->reg_pc);
+    assert_int_equal(7, chip->cycles);
+
+    run8080(chip);
+    assert_int_equal(0x0001, chip->reg_pc);
+    assert_int_equal(11, chip->cycles);
+
+    assert_int_equal(RUN_BUDGET, run8080_until(chip, 1000));
+    assert_int_equal(1000, chip->cycles);
+
+    assert_int_equal(1, generate_interrupt(chip, 7));
+    assert_int_equal(0, chip->halted);
+    assert_int_equal(0x0038, chip->reg_pc);
+    assert_int_equal(0x01, chip->memory[0x23fe]);
+
+    destroy_chip8080(chip);
+}
+
+static Chip8080* make_idle_program(void) {
+    /* EI, then polls $2000 until the RST 2 handler sets it, counts in C
+     * and spins on a bare JMP; the handler counts in B and returns to
+     * the poll, which it leaves at once */
+    Chip8080 *chip = make_chip8080();
+    unsigned char main_loop[] = {
+        0xfb,                   // 0000 EI
+        0x3a, 0x00, 0x20,       // 0001 LDA $2000
+        0xa7,                   // 0004 ANA A
+        0xca, 0x01, 0x00,       // 0005 JZ $0001
+        0x0c,                   // 0008 INR C
+        0xc3, 0x09, 0x00,       // 0009 JMP $0009
+    };
+    unsigned char handler[] = {
+        0x21, 0x01, 0x00,       // 0010 LXI H,$0001
+        0x22, 0x00, 0x20,       // 0013 SHLD $2000
+        0x04,                   // 0016 INR B
+        0xfb,                   // 0017 EI
+        0xc3, 0x01, 0x00,       // 0018 JMP $0001
+    };
+    load_memory(chip, main_loop, sizeof(main_loop), 0x0000);
+    load_memory(chip, handler, sizeof(handler), 0x0010);
+    chip->reg_sp = 0x2400;
+    return chip;
+}
+
+static void test_idle_loop_skip(void **state) {
+    /* Tests that: polling loops are fast-forwarded to the deadline, and
+     * the machine ends up exactly where running every iteration leaves it */
+    Chip8080 *fast = make_idle_program();
+    Chip8080 *slow = make_idle_program();
+    slow->idle.enabled = 0;
+
+    for (u_int64_t deadline = 1000; deadline <= 10000; deadline += 1000) {
+        run8080_until(fast, deadline);
+        run8080_until(slow, deadline);
+        assert_int_equal(slow->cycles, fast->cycles);
+        assert_int_equal(slow->reg_pc, fast->reg_pc);
+        generate_interrupt(fast, 2);
+        generate_interrupt(slow, 2);
+    }
+
+    assert_int_equal(9, fast->reg_b);
+    assert_int_equal(9, fast->reg_c);
+    assert_memory_equal(slow->memory, fast->memory, MAX_MEMORY);
+    assert_memory_equal(&slow->flags, &fast->flags, sizeof(fast->flags));
+    assert_true(fast->idle.skipped > 8000);
+    assert_int_equal(0, slow->idle.skipped);
+
+    destroy_chip8080(fast);
+    destroy_chip8080(slow);
+}
+
+static void test_idle_loop_with_store(void **state) {
+    /* Tests that: a loop that writes memory is never skipped */
+    Chip8080 *chip = make_chip8080();
+    unsigned char program[] = {
+        0x32, 0x00, 0x20,       // 0000 STA $2000
+        0xc3, 0x00, 0x00,       // 0003 JMP $0000
+    };
+    load_memory(chip, program, sizeof(program), 0);
+
+    run8080_until(chip, 1000);
+
+    assert_int_equal(0, chip->idle.skipped);
+    assert_int_equal(1002, chip->cycles);
+
+    destroy_chip8080(chip);
+}
+
 int main() {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_lxi_b_d16),
@@ -915,6 +1282,20 @@ int main() {
         cmocka_unit_test(test_inr_l),
         cmocka_unit_test(test_mvi_l_d8),
         cmocka_unit_test(test_cma),
+        cmocka_unit_test(test_out_d8),
+        cmocka_unit_test(test_in_d8),
+        cmocka_unit_test(test_di_ei),
+        cmocka_unit_test(test_run8080_until),
+        cmocka_unit_test(test_run_status),
+        cmocka_unit_test(test_generate_interrupt),
+        cmocka_unit_test(test_wrap_at_top_of_memory),
+        cmocka_unit_test(test_sta_lda),
+        cmocka_unit_test(test_ana),
+        cmocka_unit_test(test_jumps),
+        cmocka_unit_test(test_cpi),
+        cmocka_unit_test(test_hlt),
+        cmocka_unit_test(test_idle_loop_skip),
+        cmocka_unit_test(test_idle_loop_with_store),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -0,0 +1,106 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+#include "../src/debugger.h"
+
+/*  0000 LXI B,$2000; LXI D,$0000
+ *  0006 INR E; CMA; STAX B; INR C; JNZ $0006
+ *  000d HLT
+ */
+static Chip8080* make_store_loop(void) {
+    const unsigned char program[] = {
+        0x01, 0x00, 0x20, 0x11, 0x00, 0x00,
+        0x1c, 0x2f, 0x02, 0x0c, 0xc2, 0x06, 0x00,
+        0x76,
+    };
+    Chip8080 *chip = make_chip8080();
+    load_memory(chip, program, sizeof(program), 0x0000);
+    return chip;
+}
+
+static void test_breakpoints(void **state) {
+    /* Test that a run stops before an instruction with a breakpoint,
+     * goes on past it once resumed and no more once it is cleared */
+    Chip8080 *chip = make_store_loop();
+    set_breakpoint(chip, 0x0009);
+
+    assert_int_equal(RUN_BREAKPOINT, run8080_until(chip, 100000));
+    assert_int_equal(0x0009, chip->reg_pc);
+    assert_int_equal(1, chip->reg_e);
+    assert_int_equal(RUN_BREAKPOINT, run8080_until(chip, 100000));
+    assert_int_equal(1, chip->reg_e);
+
+    resume_debugged(chip);
+    assert_int_equal(RUN_BREAKPOINT, run8080_until(chip, 100000));
+    assert_int_equal(0x0009, chip->reg_pc);
+    assert_int_equal(2, chip->reg_e);
+
+    clear_breakpoint(chip, 0x0009);
+    resume_debugged(chip);
+    assert_int_equal(RUN_HALTED, run8080_until(chip, 100000));
+    assert_int_equal(0x000e, chip->reg_pc);
+
+    detach_debugger(chip);
+    destroy_chip8080(chip);
+}
+
+static void test_watchpoints(void **state) {
+    /* Test that a run stops after the instruction writing a watched
+     * address, and that writes elsewhere on its page don't stop it */
+    Chip8080 *chip = make_store_loop();
+    set_watchpoint(chip, 0x2010);
+
+    assert_int_equal(RUN_WATCHPOINT, run8080_until(chip, 100000));
+    assert_int_equal(0x0009, chip->reg_pc);
+    assert_int_equal(0x11, chip->reg_e);
+    assert_int_equal(0x2010, chip->debug->watch_address);
+    assert_int_equal(0xff, chip->memory[0x2010]);
+
+    resume_debugged(chip);
+    clear_watchpoint(chip, 0x2010);
+    assert_int_equal(0, chip->watched_pages[0x20 >> 3]);
+    assert_int_equal(RUN_HALTED, run8080_until(chip, 100000));
+
+    detach_debugger(chip);
+    destroy_chip8080(chip);
+}
+
+static void test_watched_pages(void **state) {
+    /* Test that only pages with a watchpoint take the slow write path,
+     * and that writes without a debugger never stop anything */
+    Chip8080 *chip = make_chip8080();
+    set_watchpoint(chip, 0x2010);
+    set_watchpoint(chip, 0x2020);
+    assert_int_equal(1, chip->watched_pages[0x20 >> 3] & 1);
+
+    write_memory(chip, 0x2100, 1);
+    write_memory(chip, 0x2011, 1);
+    assert_int_equal(0, chip->debug->watch_hit);
+
+    clear_watchpoint(chip, 0x2010);
+    assert_int_equal(1, chip->watched_pages[0x20 >> 3] & 1);
+    write_memory(chip, 0x2020, 1);
+    assert_int_equal(1, chip->debug->watch_hit);
+
+    detach_debugger(chip);
+    assert_int_equal(0, chip->watched_pages[0x20 >> 3]);
+    write_memory(chip, 0x2020, 2);
+    assert_int_equal(2, chip->memory[0x2020]);
+
+    destroy_chip8080(chip);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_breakpoints),
+        cmocka_unit_test(test_watchpoints),
+        cmocka_unit_test(test_watched_pages),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
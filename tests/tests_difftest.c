@@ -0,0 +1,133 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+#include "../src/reference8080.h"
+#include "../src/difftest.h"
+
+static void test_reference_step(void **state) {
+    /* Spot checks of the reference model against the 8080 manual */
+    RefState *ref = calloc(1, sizeof(RefState));
+    const u_int8_t program[] = {
+        0x06, 0x0f,         // MVI B,$0f
+        0x04,               // INR B      AC from the low nibble
+        0x0e, 0x10,         // MVI C,$10
+        0x0d,               // DCR C      borrow, so no AC
+        0x2a, 0x00, 0x30,   // LHLD $3000
+    };
+    memcpy(ref->memory, program, sizeof(program));
+    ref->memory[0x3000] = 0x34;
+    ref->memory[0x3001] = 0x12;
+
+    for (int i = 0; i < 5; i++)
+        assert_int_equal(0, reference_step(ref));
+
+    assert_int_equal(0x10, ref->reg[REF_B]);
+    assert_int_equal(0x0f, ref->reg[REF_C]);
+    assert_int_equal(0, ref->ac);
+    assert_int_equal(0x12, ref->reg[REF_H]);
+    assert_int_equal(0x34, ref->reg[REF_L]);
+    assert_int_equal(sizeof(program), ref->pc);
+    assert_int_equal(7 + 5 + 7 + 5 + 16, ref->cycles);
+
+    ref->memory[ref->pc] = 0xcd;    // CALL isn't modelled
+    assert_int_equal(-1, reference_step(ref));
+
+    free(ref);
+}
+
+static void test_random_programs_match(void **state) {
+    Chip8080 *chip = make_chip8080();
+    RefState *ref = malloc(sizeof(RefState));
+    char *report = malloc(DIFF_REPORT_MAX);
+    u_int32_t seed = 39;
+    u_int64_t steps = 0;
+
+    for (int stream = 0; stream < 40; stream++) {
+        reset_chip_state(chip);
+        make_random_program(chip->memory, 0x1000, &seed);
+        chip->reg_b = 0x20 | (seed >> 16);
+        chip->reg_d = 0x20 | (seed >> 24);
+        DiffResult result = difftest(chip, ref, DIFF_STREAM_STEPS, report);
+        if (result.diverged)
+            fail_msg("%s", report);
+        steps += result.steps;
+    }
+    assert_true(steps > 10000);
+
+    free(report);
+    free(ref);
+    destroy_chip8080(chip);
+}
+
+static u_int8_t in_handler(Chip8080 *chip, u_int8_t port) {
+    return 0x5a;
+}
+
+static void test_difftest_reports_divergence(void **state) {
+    /* Test that a difference stops the run with a trace: the reference
+     * has no port handlers, so an IN through one diverges */
+    Chip8080 *chip = make_chip8080();
+    RefState *ref = malloc(sizeof(RefState));
+    char *report = malloc(DIFF_REPORT_MAX);
+    const u_int8_t program[] = {0x06, 0x01, 0x04, 0xdb, 0x07, 0x00};  // MVI B,$01  INR B  IN $07  NOP
+    memcpy(chip->memory, program, sizeof(program));
+    set_port_handlers(chip, 7, in_handler, NULL);
+
+    DiffResult result = difftest(chip, ref, 100, report);
+
+    assert_int_equal(1, result.diverged);
+    assert_int_equal(3, result.steps);
+    assert_non_null(strstr(report, "divergence at instruction 2"));
+    assert_non_null(strstr(report, "0003 IN     #$07"));
+    assert_non_null(strstr(report, "core:      A=5a"));
+    assert_non_null(strstr(report, "reference: A=00"));
+
+    free(report);
+    free(ref);
+    destroy_chip8080(chip);
+}
+
+static void __attribute__((noinline)) dirty_stack(void) {
+    volatile char junk[16384];
+    memset((char*) junk, 0x7f, sizeof(junk));
+}
+
+static void test_report_on_dirty_stack(void **state) {
+    /* Test that the trace lines are terminated, so the report holds
+     * them alone whatever was on the stack before */
+    Chip8080 *chip = make_chip8080();
+    RefState *ref = malloc(sizeof(RefState));
+    char *report = malloc(DIFF_REPORT_MAX);
+    const u_int8_t program[] = {0x06, 0x01, 0x04, 0xdb, 0x07, 0x00};  // MVI B,$01  INR B  IN $07  NOP
+    memcpy(chip->memory, program, sizeof(program));
+    set_port_handlers(chip, 7, in_handler, NULL);
+
+    dirty_stack();
+    DiffResult result = difftest(chip, ref, 100, report);
+
+    assert_int_equal(1, result.diverged);
+    assert_true(strlen(report) < DIFF_REPORT_MAX);
+    assert_null(strchr(report, 0x7f));
+    assert_non_null(strstr(report, "0002 INR    B\tA=00 BC=0100"));
+
+    free(report);
+    free(ref);
+    destroy_chip8080(chip);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_reference_step),
+        cmocka_unit_test(test_random_programs_match),
+        cmocka_unit_test(test_difftest_reports_divergence),
+        cmocka_unit_test(test_report_on_dirty_stack),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,146 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "../src/flow.h"
+
+/* 0000 JMP $0006
+ * 0003 DB $ff,$01,$02 (never reached)
+ * 0006 CALL $000b
+ * 0009 HLT
+ * 000a NOP
+ * 000b MVI A,#$05
+ * 000d RET */
+static const u_int8_t program[] = {
+    0xc3, 0x06, 0x00, 0xff, 0x01, 0x02, 0xcd, 0x0b, 0x00, 0x76, 0x00, 0x3e, 0x05, 0xc9
+};
+
+static void test_analyze_flow_separates_data(void **state) {
+    /* Test that bytes skipped by a JMP are left as data and that
+     * jump and call targets are labeled */
+    FlowMap *map = malloc(sizeof(FlowMap));
+    u_int16_t entry = 0x0000;
+
+    analyze_flow(program, sizeof(program), &entry, 1, map);
+
+    for (int addr = 0x00; addr <= 0x02; addr++)
+        assert_int_equal(1, bitmap_test(map->code, addr));
+    for (int addr = 0x03; addr <= 0x05; addr++)
+        assert_int_equal(0, bitmap_test(map->code, addr));
+    for (int addr = 0x06; addr < sizeof(program); addr++)
+        assert_int_equal(1, bitmap_test(map->code, addr));
+
+    assert_int_equal(1, bitmap_test(map->start, 0x000b));
+    assert_int_equal(0, bitmap_test(map->start, 0x000c));
+    assert_int_equal(1, bitmap_test(map->label, 0x0000));
+    assert_int_equal(1, bitmap_test(map->label, 0x0006));
+    assert_int_equal(1, bitmap_test(map->label, 0x000b));
+    assert_int_equal(0, bitmap_test(map->label, 0x0009));
+
+    free(map);
+}
+
+static void test_analyze_flow_skips_vectors_inside_code(void **state) {
+    /* Test that an entry point landing inside a decoded
+     * instruction is not decoded again */
+    FlowMap *map = malloc(sizeof(FlowMap));
+    u_int16_t entries[] = {0x0000, 0x0007};
+
+    analyze_flow(program, sizeof(program), entries, 2, map);
+
+    assert_int_equal(0, bitmap_test(map->start, 0x0007));
+    assert_int_equal(0, bitmap_test(map->label, 0x0007));
+
+    free(map);
+}
+
+static void test_analyze_flow_labels_decoded_entries(void **state) {
+    /* Test that entry points already decoded from an earlier entry, like
+     * RST handlers that code runs into, still get their labels */
+    u_int8_t code[0x18] = {0};
+    FlowMap *map = malloc(sizeof(FlowMap));
+    code[0x17] = 0x76;  // HLT after a NOP sled over the RST 1 and 2 vectors
+
+    analyze_flow(code, sizeof(code), default_entry_points, 9, map);
+
+    assert_int_equal(1, bitmap_test(map->label, 0x0008));
+    assert_int_equal(1, bitmap_test(map->label, 0x0010));
+    assert_int_equal(0, bitmap_test(map->label, 0x0009));
+
+    free(map);
+}
+
+static void test_disassemble_flow(void **state) {
+    /* Test that the listing labels targets, names them in operands and
+     * emits data as DB */
+    const char *expected =
+        "L0000:\n"
+        "0000 JMP    L0006\n"
+        "0003 DB     $ff,$01,$02\n"
+        "L0006:\n"
+        "0006 CALL   L000b\n"
+        "0009 HLT\n"
+        "000a NOP\n"
+        "L000b:\n"
+        "000b MVI    A,#$05\n"
+        "000d RET\n";
+    FlowMap *map = malloc(sizeof(FlowMap));
+    u_int16_t entry = 0x0000;
+    char out[1024];
+    int pc = 0;
+
+    analyze_flow(program, sizeof(program), &entry, 1, map);
+    size_t written = disassemble_flow(program, &pc, sizeof(program), map, out, sizeof(out));
+
+    assert_int_equal(strlen(expected), written);
+    assert_memory_equal(expected, out, written);
+    assert_int_equal(sizeof(program), pc);
+
+    free(map);
+}
+
+static void test_disassemble_flow_into_instruction(void **state) {
+    /* Test that a jump into the middle of a listed instruction keeps its
+     * address, as the listing has no label line for it */
+    const u_int8_t code[] = {
+        0x06, 0xc3,         // 0000 MVI B,#$c3
+        0xc2, 0x01, 0x00,   // 0002 JNZ $0001, which is JMP $01c2
+        0xc3, 0x00, 0x00,   // 0005 JMP $0000
+    };
+    const char *expected =
+        "L0000:\n"
+        "0000 MVI    B,#$c3\n"
+        "0002 JNZ    $0001\n"
+        "0005 JMP    L0000\n";
+    FlowMap *map = malloc(sizeof(FlowMap));
+    u_int16_t entry = 0x0000;
+    char out[1024];
+    int pc = 0;
+
+    analyze_flow(code, sizeof(code), &entry, 1, map);
+    assert_int_equal(1, bitmap_test(map->label, 0x0001));
+    assert_int_equal(0, bitmap_test(map->listed, 0x0001));
+    assert_int_equal(1, bitmap_test(map->listed, 0x0002));
+
+    size_t written = disassemble_flow(code, &pc, sizeof(code), map, out, sizeof(out));
+    assert_int_equal(strlen(expected), written);
+    assert_memory_equal(expected, out, written);
+
+    free(map);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_analyze_flow_separates_data),
+        cmocka_unit_test(test_analyze_flow_skips_vectors_inside_code),
+        cmocka_unit_test(test_analyze_flow_labels_decoded_entries),
+        cmocka_unit_test(test_disassemble_flow),
+        cmocka_unit_test(test_disassemble_flow_into_instruction),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
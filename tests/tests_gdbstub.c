@@ -0,0 +1,186 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+#include "../src/scheduler.h"
+#include "../src/debugger.h"
+#include "../src/gdbstub.h"
+
+/*  0000 LXI B,$2000; LXI D,$0000
+ *  0006 INR E; CMA; STAX B; INR C; JNZ $0006
+ *  000d HLT
+ */
+static Chip8080* make_store_loop(void) {
+    const unsigned char program[] = {
+        0x01, 0x00, 0x20, 0x11, 0x00, 0x00,
+        0x1c, 0x2f, 0x02, 0x0c, 0xc2, 0x06, 0x00,
+        0x76,
+    };
+    Chip8080 *chip = make_chip8080();
+    load_memory(chip, program, sizeof(program), 0x0000);
+    return chip;
+}
+
+static void test_registers(void **state) {
+    /* Test that registers go out and come back in gdb's z80 layout,
+     * 16 bits little endian, with the flags as the low byte of AF */
+    Chip8080 *chip = make_chip8080();
+    GdbTarget target = {chip, NULL};
+    char reply[GDB_PACKET_MAX + 1];
+
+    chip->reg_a = 0x12;
+    chip->flags.z = 1;
+    chip->flags.cy = 1;
+    chip->reg_b = 0x34;
+    chip->reg_c = 0x56;
+    chip->reg_sp = 0x2400;
+    chip->reg_pc = 0x1a5c;
+    assert_int_equal(GDB_REPLY, handle_gdb_packet(&target, "g", reply));
+    assert_int_equal(GDB_REGISTERS * 4, strlen(reply));
+    assert_memory_equal("431256340000000000245c1a00000000", reply, 32);
+
+    assert_int_equal(GDB_REPLY, handle_gdb_packet(&target, "P5=0001", reply));
+    assert_string_equal("OK", reply);
+    assert_int_equal(0x0100, chip->reg_pc);
+    handle_gdb_packet(&target, "G8277", reply);
+    assert_int_equal(0x77, chip->reg_a);
+    assert_int_equal(1, chip->flags.s);
+    assert_int_equal(0, chip->flags.z);
+    handle_gdb_packet(&target, "p0", reply);
+    assert_string_equal("8277", reply);
+
+    destroy_chip8080(chip);
+}
+
+static void test_memory(void **state) {
+    /* Test that memory reads wrap around the address space and that
+     * writes go through write_memory() */
+    Chip8080 *chip = make_chip8080();
+    GdbTarget target = {chip, NULL};
+    char reply[GDB_PACKET_MAX + 1];
+
+    assert_int_equal(GDB_REPLY, handle_gdb_packet(&target, "M2000,3:0aff10", reply));
+    assert_string_equal("OK", reply);
+    assert_int_equal(0xff, chip->memory[0x2001]);
+    assert_int_equal(1, chip->dirty[0x2000 >> DIRTY_BLOCK_SHIFT >> 3] & 1);
+    chip->memory[0x0000] = 0xc3;
+    handle_gdb_packet(&target, "mffff,2", reply);
+    assert_string_equal("00c3", reply);
+    handle_gdb_packet(&target, "M2000,3:0a", reply);
+    assert_string_equal("E01", reply);
+
+    destroy_chip8080(chip);
+}
+
+static void test_points_and_stops(void **state) {
+    /* Test that Z packets set the debugger's breakpoints and watchpoints,
+     * and what continuing and stepping then report */
+    Chip8080 *chip = make_store_loop();
+    Scheduler scheduler;
+    GdbTarget target = {chip, &scheduler};
+    char reply[GDB_PACKET_MAX + 1];
+    init_scheduler(&scheduler);
+
+    assert_int_equal(GDB_REPLY, handle_gdb_packet(&target, "Z0,9,1", reply));
+    assert_string_equal("OK", reply);
+    assert_int_equal(GDB_STEP, handle_gdb_packet(&target, "s", reply));
+    assert_int_equal(RUN_OK, gdb_step(&target));
+    assert_int_equal(0x0003, chip->reg_pc);
+
+    assert_int_equal(RUN_BREAKPOINT, run_scheduled(&scheduler, chip, 100000));
+    assert_int_equal(0x0009, chip->reg_pc);
+    format_stop_reply(&target, RUN_BREAKPOINT, reply);
+    assert_string_equal("S05", reply);
+
+    handle_gdb_packet(&target, "z0,9,1", reply);
+    handle_gdb_packet(&target, "Z2,2010,1", reply);
+    resume_debugged(chip);
+    assert_int_equal(RUN_WATCHPOINT, run_scheduled(&scheduler, chip, 100000));
+    format_stop_reply(&target, RUN_WATCHPOINT, reply);
+    assert_string_equal("T05watch:2010;", reply);
+
+    handle_gdb_packet(&target, "Z4,2010,1", reply);
+    assert_string_equal("", reply);
+
+    destroy_chip8080(chip);
+}
+
+static void test_debugger_only_while_needed(void **state) {
+    /* Test that the debugger goes with the last breakpoint or watchpoint,
+     * so runs are batched again, and that a watchpoint is at most the
+     * whole address space */
+    Chip8080 *chip = make_store_loop();
+    GdbTarget target = {chip, NULL};
+    char reply[GDB_PACKET_MAX + 1];
+
+    handle_gdb_packet(&target, "Z0,9,1", reply);
+    handle_gdb_packet(&target, "Z2,2010,2", reply);
+    handle_gdb_packet(&target, "z0,9,1", reply);
+    assert_non_null(chip->debug);
+    handle_gdb_packet(&target, "z2,2010,2", reply);
+    assert_string_equal("OK", reply);
+    assert_null(chip->debug);
+    assert_int_equal(0, chip->watched_pages[0x20 >> 3]);
+
+    assert_int_equal(GDB_REPLY, handle_gdb_packet(&target, "Z2,0,ffffffff", reply));
+    assert_string_equal("OK", reply);
+    assert_int_equal(0xff, chip->watched_pages[0]);
+    assert_int_equal(0xff, chip->watched_pages[WATCH_PAGE_BYTES - 1]);
+
+    detach_debugger(chip);
+    destroy_chip8080(chip);
+}
+
+static void send_test_packet(int fd, const char *payload) {
+    char frame[256];
+    int size = sprintf(frame, "$%s#%02x", payload, gdb_checksum(payload, strlen(payload)));
+    assert_int_equal(size, write(fd, frame, size));
+}
+
+static void test_serve(void **state) {
+    /* Test a session over a socket: packets are acked, a bad checksum is
+     * naked, continue runs to the breakpoint and k ends the session,
+     * taking the debugger with it */
+    Chip8080 *chip = make_store_loop();
+    GdbTarget target = {chip, NULL};
+    int fds[2];
+    char replies[512];
+
+    assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    assert_int_equal(6, write(fds[0], "$g#00+", 6));
+    send_test_packet(fds[0], "Z0,9,1");
+    send_test_packet(fds[0], "c");
+    send_test_packet(fds[0], "m2000,1");
+    send_test_packet(fds[0], "k");
+
+    assert_int_equal(1, serve_gdb(fds[1], &target));
+    close(fds[1]);
+    ssize_t n = read(fds[0], replies, sizeof(replies) - 1);
+    replies[n > 0 ? n : 0] = '\0';
+    assert_string_equal("-+$OK#9a+$S05#b8+$ff#cc+", replies);
+    assert_int_equal(0x0009, chip->reg_pc);
+    assert_null(chip->debug);
+
+    close(fds[0]);
+    destroy_chip8080(chip);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_registers),
+        cmocka_unit_test(test_memory),
+        cmocka_unit_test(test_points_and_stops),
+        cmocka_unit_test(test_debugger_only_while_needed),
+        cmocka_unit_test(test_serve),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,120 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+#include "../src/heatmap.h"
+
+/*  0000 LXI B,$2000; LDA $2100
+ *  0006 LDAX B; CMA; STAX B; INR C; JNZ $0006
+ *  000d HLT
+ */
+static Chip8080* make_copy_loop(void) {
+    const unsigned char program[] = {
+        0x01, 0x00, 0x20, 0x3a, 0x00, 0x21,
+        0x0a, 0x2f, 0x02, 0x0c, 0xc2, 0x06, 0x00,
+        0x76,
+    };
+    Chip8080 *chip = make_chip8080();
+    load_memory(chip, program, sizeof(program), 0x0000);
+    return chip;
+}
+
+static void test_counting(void **state) {
+    /* Test that instructions count their reads, writes and executes at
+     * the addresses they touch, and nothing else */
+    Chip8080 *chip = make_copy_loop();
+    assert_int_equal(RUN_HALTED, run8080_until(chip, 100000));
+
+    assert_int_equal(1, chip->heat->executes[0x0000]);
+    assert_int_equal(0, chip->heat->executes[0x0001]);
+    assert_int_equal(256, chip->heat->executes[0x0006]);
+    assert_int_equal(256, chip->heat->executes[0x000a]);
+    assert_int_equal(1, chip->heat->executes[0x000d]);
+    assert_int_equal(1, chip->heat->reads[0x2100]);
+    assert_int_equal(1, chip->heat->reads[0x20ff]);
+    assert_int_equal(1, chip->heat->writes[0x20ff]);
+    assert_int_equal(0, chip->heat->reads[0x0006]);
+    assert_int_equal(0, chip->heat->writes[0x2100]);
+
+    destroy_chip8080(chip);
+}
+
+static void test_idle_loops_counted(void **state) {
+    /* Test that a polling loop runs every iteration, which idle loop
+     * skipping would otherwise credit without counting */
+    const unsigned char program[] = {0x3a, 0x00, 0x21, 0xc3, 0x00, 0x00}; // LDA $2100; JMP $0000
+    Chip8080 *chip = make_chip8080();
+    load_memory(chip, program, sizeof(program), 0x0000);
+
+    run8080_until(chip, 23000);
+    assert_int_equal(1000, chip->heat->executes[0x0000]);
+    assert_int_equal(1000, chip->heat->executes[0x0003]);
+    assert_int_equal(1000, chip->heat->reads[0x2100]);
+    assert_int_equal(0, chip->idle.skipped);
+
+    destroy_chip8080(chip);
+}
+
+static void test_render(void **state) {
+    /* Test that the image is black where nothing was counted and scales
+     * the rest by bit length, up to white for the busiest address */
+    u_int64_t *counts = calloc(MAX_MEMORY, sizeof(u_int64_t));
+    u_int8_t *image = malloc(HEATMAP_SIDE * HEATMAP_SIDE);
+    counts[0x0001] = 1;
+    counts[0x2400] = 255;
+    counts[0xffff] = 256;
+
+    render_heatmap(counts, image);
+    assert_int_equal(0, image[0x0000]);
+    assert_int_equal(255 / 9, image[0x0001]);
+    assert_int_equal(255 * 8 / 9, image[0x2400]);
+    assert_int_equal(255, image[0xffff]);
+
+    memset(counts, 0, MAX_MEMORY * sizeof(u_int64_t));
+    render_heatmap(counts, image);
+    assert_int_equal(0, image[0xffff]);
+
+    free(image);
+    free(counts);
+}
+
+static void test_table(void **state) {
+    /* Test that the table lists the busiest addresses first, ties by
+     * address, with the instruction run there or the byte as DB */
+    Chip8080 *chip = make_copy_loop();
+    char table[4 * HEATMAP_LINE_MAX];
+    run8080_until(chip, 100000);
+
+    size_t size = format_heatmap_table(chip->heat, chip->memory, 3, table);
+    table[size] = '\0';
+    assert_string_equal(
+        "addr        reads       writes     executes  instruction\n"
+        "0006            0            0          256  LDAX   B\n"
+        "0007            0            0          256  CMA\n"
+        "0008            0            0          256  STAX   B\n", table);
+
+    memset(chip->heat, 0, sizeof(Heatmap));
+    chip->heat->reads[0x1234] = 5;
+    chip->memory[0x1234] = 0xab;
+    size = format_heatmap_table(chip->heat, chip->memory, 3, table);
+    table[size] = '\0';
+    assert_non_null(strstr(table, "\n1234            5            0            0  DB     $ab\n"));
+
+    destroy_chip8080(chip);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_counting),
+        cmocka_unit_test(test_idle_loops_counted),
+        cmocka_unit_test(test_render),
+        cmocka_unit_test(test_table),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
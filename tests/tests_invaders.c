@@ -0,0 +1,153 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+#include "../src/invaders.h"
+#include "../src/sound.h"
+
+static void test_shift_register(void **state) {
+    /* Test that: OUT 4 shifts bytes into the register, OUT 2 sets
+     * the offset and IN 3 reads 8 bits offset bits from the top */
+    Invaders *invaders = make_invaders();
+    Chip8080 *chip = invaders->chip;
+    u_int8_t out_4[] = {0xd3, 0x04};
+    u_int8_t out_2[] = {0xd3, 0x02};
+    u_int8_t in_3[] = {0xdb, 0x03};
+
+    chip->reg_a = 0xaa;
+    out_d8(chip, out_4);
+    chip->reg_a = 0xff;
+    out_d8(chip, out_4);
+    assert_int_equal(0xffaa, invaders->shift_register);
+
+    in_d8(chip, in_3);
+    assert_int_equal(0xff, chip->reg_a);
+
+    chip->reg_a = 0x03;
+    out_d8(chip, out_2);
+    in_d8(chip, in_3);
+    assert_int_equal(0xfd, chip->reg_a);
+
+    chip->reg_a = 0x0f; // only the low 3 bits count
+    out_d8(chip, out_2);
+    in_d8(chip, in_3);
+    assert_int_equal(0xd5, chip->reg_a);
+    assert_int_equal(0x0e, chip->reg_pc);
+
+    destroy_invaders(invaders);
+}
+
+static void test_inputs(void **state) {
+    /* Test that key presses show up on ports 1 and 2 */
+    Invaders *invaders = make_invaders();
+    Chip8080 *chip = invaders->chip;
+    u_int8_t in_1[] = {0xdb, 0x01};
+
+    invaders_key_down(invaders, INVADERS_PORT_INPUTS_1, INVADERS_COIN | INVADERS_P1_LEFT);
+    in_d8(chip, in_1);
+    assert_int_equal(0x08 | INVADERS_COIN | INVADERS_P1_LEFT, chip->reg_a);
+
+    invaders_key_up(invaders, INVADERS_PORT_INPUTS_1, INVADERS_COIN);
+    in_d8(chip, in_1);
+    assert_int_equal(0x08 | INVADERS_P1_LEFT, chip->reg_a);
+
+    destroy_invaders(invaders);
+}
+
+static void test_load_invaders_rom(void **state) {
+    /* Test that only an 8KB image is accepted */
+    Invaders *invaders = make_invaders();
+    u_int8_t *rom = calloc(INVADERS_ROM_SIZE, 1);
+    rom[INVADERS_ROM_SIZE - 1] = 0x42;
+
+    assert_int_equal(-1, load_invaders_rom(invaders, rom, 0x800));
+    assert_int_equal(0, load_invaders_rom(invaders, rom, INVADERS_ROM_SIZE));
+    assert_int_equal(0x42, invaders->chip->memory[0x1fff]);
+
+    free(rom);
+    destroy_invaders(invaders);
+}
+
+static void test_run_frame(void **state) {
+    /* Test that a frame is CYCLES_PER_FRAME long and that RST 1 is
+     * taken mid-screen; RST 2 is dropped as the handler never runs EI */
+    Invaders *invaders = make_invaders();
+    Chip8080 *chip = invaders->chip;
+    chip->memory[0x0000] = 0xfb; // EI, then NOPs
+    chip->reg_sp = 0x4000;       // out of the way of two frames of NOPs
+
+    invaders_run_frame(invaders);
+
+    assert_int_equal(1, invaders->frames);
+    assert_in_range(chip->cycles, CYCLES_PER_FRAME, CYCLES_PER_FRAME + 4);
+    assert_int_equal(0x3ffe, chip->reg_sp);
+    assert_int_equal(0, chip->irq_enable);
+    assert_in_range(chip->reg_pc, 0x0008, 0x0008 + CYCLES_PER_FRAME / 2);
+
+    invaders_run_frame(invaders);
+    assert_int_equal(2, invaders->frames);
+
+    destroy_invaders(invaders);
+}
+
+static void test_sound_events(void **state) {
+    /* Test that OUT 3 and OUT 5 log the bits they toggle with the cycle
+     * of the OUT, that repeated values log nothing and that a full log
+     * counts what it drops */
+    Invaders *invaders = make_invaders();
+    Chip8080 *chip = invaders->chip;
+    SoundEvent events[3];
+    SoundLog sound;
+    u_int8_t out_3[] = {0xd3, 0x03};
+    u_int8_t out_5[] = {0xd3, 0x05};
+    const struct {u_int8_t *op; u_int8_t a;} writes[] = {
+        {out_3, SOUND_SHOT},
+        {out_3, SOUND_SHOT},                    // no change
+        {out_3, SOUND_UFO},                     // shot off, ufo on
+        {out_5, SOUND_FLEET_1 | SOUND_UFO_HIT},
+        {out_5, 0},                             // dropped
+    };
+    init_sound_log(&sound, events, 3);
+    invaders->sound = &sound;
+
+    for (int i = 0; i < 5; i++) {
+        chip->cycles = 100 * i;
+        chip->reg_a = writes[i].a;
+        out_d8(chip, writes[i].op);
+    }
+
+    assert_int_equal(3, sound.n_events);
+    assert_int_equal(1, sound.dropped);
+    assert_int_equal(0, events[0].cycle);
+    assert_int_equal(SOUND_SHOT, events[0].changed);
+    assert_int_equal(200, events[1].cycle);
+    assert_int_equal(3, events[1].port);
+    assert_int_equal(SOUND_UFO, events[1].value);
+    assert_int_equal(SOUND_UFO | SOUND_SHOT, events[1].changed);
+    assert_int_equal(5, events[2].port);
+    assert_int_equal(SOUND_FLEET_1 | SOUND_UFO_HIT, events[2].changed);
+
+    char line[SOUND_EVENT_LINE_MAX];
+    int len = format_sound_event(&events[1], line);
+    assert_string_equal("{\"cycle\":200,\"port\":3,\"value\":1,\"on\":[\"ufo\"],\"off\":[\"shot\"]}\n", line);
+    assert_int_equal(strlen(line), len);
+
+    destroy_invaders(invaders);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_shift_register),
+        cmocka_unit_test(test_inputs),
+        cmocka_unit_test(test_load_invaders_rom),
+        cmocka_unit_test(test_run_frame),
+        cmocka_unit_test(test_sound_events),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,198 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+#include "../src/invaders.h"
+#include "../src/movie.h"
+
+#define MOVIE_PATH "test_movie.i8mv"
+#define N_FRAMES 120
+
+static Invaders *make_test_machine(void) {
+    /* Both interrupts land on EI and fall through NOPs; the vblank
+     * handler at 0x10 also stores port 1 at (BC) and moves BC on, so
+     * the inputs of every frame end up in RAM */
+    unsigned char rom[INVADERS_ROM_SIZE] = {0};
+    const unsigned char handler[] = {0xdb, 0x01, 0x02, 0x03, 0xfb};   // IN 1, STAX B, INX B, EI
+    rom[0x00] = 0xfb;
+    rom[0x08] = 0xfb;
+    memcpy(&rom[0x10], handler, sizeof(handler));
+
+    Invaders *invaders = make_invaders();
+    load_invaders_rom(invaders, rom, sizeof(rom));
+    invaders->chip->reg_sp = 0x4000;
+    invaders->chip->reg_b = 0x21;
+    return invaders;
+}
+
+static Movie *record_test_movie(Invaders *invaders) {
+    Movie *movie = make_movie();
+    invaders_run_frame(invaders);
+    begin_movie(movie, invaders);
+    for (int frame = 0; frame < N_FRAMES; frame++) {
+        if (frame % 10 == 3)
+            movie_set_input(movie, invaders, INVADERS_PORT_INPUTS_1, 0x08 | frame);
+        if (frame % 25 == 0)
+            movie_set_input(movie, invaders, INVADERS_PORT_INPUTS_2, frame);
+        invaders_run_frame(invaders);
+        movie_end_frame(movie, invaders);
+    }
+    return movie;
+}
+
+static void test_snapshot_round_trip(void **state) {
+    /* Test that restoring a snapshot into another machine gives the
+     * same state and the same run from there on */
+    Invaders *invaders = make_test_machine();
+    Invaders *copy = make_invaders();
+    u_int8_t *snapshot = malloc(INVADERS_SNAPSHOT_SIZE);
+    u_int8_t *snapshot_copy = malloc(INVADERS_SNAPSHOT_SIZE);
+    for (int i = 0; i < 5; i++)
+        invaders_run_frame(invaders);
+
+    save_invaders_state(invaders, snapshot);
+    restore_invaders_state(copy, snapshot);
+    save_invaders_state(copy, snapshot_copy);
+    assert_memory_equal(snapshot, snapshot_copy, INVADERS_SNAPSHOT_SIZE);
+
+    for (int i = 0; i < 5; i++) {
+        invaders_run_frame(invaders);
+        invaders_run_frame(copy);
+        assert_true(hash_invaders_state(invaders) == hash_invaders_state(copy));
+    }
+    assert_int_equal(10, copy->frames);
+
+    free(snapshot_copy);
+    free(snapshot);
+    destroy_invaders(copy);
+    destroy_invaders(invaders);
+}
+
+static void test_replay_matches_recording(void **state) {
+    Invaders *invaders = make_test_machine();
+    Movie *movie = record_test_movie(invaders);
+    assert_int_equal(0, save_movie(movie, MOVIE_PATH));
+
+    Movie *loaded = load_movie(MOVIE_PATH);
+    assert_non_null(loaded);
+    assert_int_equal(movie->n_events, loaded->n_events);
+    assert_int_equal(N_FRAMES, loaded->n_frames);
+
+    Invaders *replay = make_invaders();
+    u_int64_t hashes[N_FRAMES];
+    assert_int_equal(-1, replay_movie(loaded, replay, hashes, NULL));
+    assert_memory_equal(movie->hashes, hashes, sizeof(hashes));
+    assert_memory_equal(&invaders->chip->memory[INVADERS_RAM], &replay->chip->memory[INVADERS_RAM], INVADERS_RAM_SIZE);
+    u_int16_t bc = (replay->chip->reg_b << 8) | replay->chip->reg_c;
+    assert_int_equal(0x08 | 113, replay->chip->memory[bc - 1]);
+
+    destroy_invaders(replay);
+    destroy_movie(loaded);
+    destroy_movie(movie);
+    destroy_invaders(invaders);
+    remove(MOVIE_PATH);
+}
+
+static void test_replay_detects_divergence(void **state) {
+    /* Test that a changed input shows up in the hash of its frame */
+    Invaders *invaders = make_test_machine();
+    Movie *movie = record_test_movie(invaders);
+    Invaders *replay = make_invaders();
+
+    assert_int_equal(INVADERS_PORT_INPUTS_1, movie->events[3].port);
+    movie->events[3].value ^= 0x40;
+    assert_int_equal(movie->events[3].frame, replay_movie(movie, replay, NULL, NULL));
+
+    destroy_invaders(replay);
+    destroy_movie(movie);
+    destroy_invaders(invaders);
+}
+
+static void test_keys_are_recorded(void **state) {
+    /* Test that key presses reach the movie being recorded as latch
+     * values, and the latches alone once it is unhooked */
+    Invaders *invaders = make_test_machine();
+    Movie *movie = make_movie();
+    begin_movie(movie, invaders);
+    invaders->movie = movie;
+
+    invaders_key_down(invaders, INVADERS_PORT_INPUTS_1, INVADERS_COIN);
+    invaders_run_frame(invaders);
+    movie_end_frame(movie, invaders);
+    invaders_key_up(invaders, INVADERS_PORT_INPUTS_1, INVADERS_COIN);
+    assert_int_equal(2, movie->n_events);
+    assert_int_equal(0, movie->events[0].frame);
+    assert_int_equal(0x08 | INVADERS_COIN, movie->events[0].value);
+    assert_int_equal(1, movie->events[1].frame);
+    assert_int_equal(0x08, movie->events[1].value);
+
+    invaders->movie = NULL;
+    invaders_key_down(invaders, INVADERS_PORT_INPUTS_2, INVADERS_TILT);
+    assert_int_equal(2, movie->n_events);
+    assert_int_equal(INVADERS_TILT, invaders->chip->in_ports[INVADERS_PORT_INPUTS_2]);
+
+    destroy_movie(movie);
+    destroy_invaders(invaders);
+}
+
+static void test_replay_reports_stop(void **state) {
+    /* Test that a replay running into an opcode the core lacks stops
+     * there and says so rather than matching */
+    Invaders *invaders = make_test_machine();
+    Movie *movie = record_test_movie(invaders);
+    Invaders *replay = make_invaders();
+    RunStatus status;
+
+    // RLC over the NOPs the test machine runs through
+    memset(movie->snapshot + INVADERS_STATE_HEADER_SIZE + 2 * 256 + 0x20, 0x07, INVADERS_ROM_SIZE - 0x20);
+    assert_int_equal(0, replay_movie(movie, replay, NULL, &status));
+    assert_int_equal(RUN_UNIMPLEMENTED, status);
+    assert_int_equal(0x07, replay->chip->memory[replay->chip->reg_pc]);
+
+    destroy_invaders(replay);
+    destroy_movie(movie);
+    destroy_invaders(invaders);
+}
+
+static void test_load_checks_counts(void **state) {
+    /* Test that a movie whose header counts don't match its size, as
+     * when truncated or forged, is rejected before they are trusted */
+    Invaders *invaders = make_test_machine();
+    Movie *movie = record_test_movie(invaders);
+    assert_int_equal(0, save_movie(movie, MOVIE_PATH));
+
+    FILE *file = fopen(MOVIE_PATH, "r+b");
+    const u_int8_t huge[4] = {0xff, 0xff, 0xff, 0xff};
+    fseek(file, 8, SEEK_SET);
+    fwrite(huge, 1, sizeof(huge), file);
+    fclose(file);
+    assert_null(load_movie(MOVIE_PATH));
+
+    assert_int_equal(0, save_movie(movie, MOVIE_PATH));
+    assert_int_equal(0, truncate(MOVIE_PATH, MOVIE_HEADER_SIZE + INVADERS_SNAPSHOT_SIZE + 5));
+    assert_null(load_movie(MOVIE_PATH));
+
+    destroy_movie(movie);
+    destroy_invaders(invaders);
+    remove(MOVIE_PATH);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_snapshot_round_trip),
+        cmocka_unit_test(test_replay_matches_recording),
+        cmocka_unit_test(test_replay_detects_divergence),
+        cmocka_unit_test(test_load_checks_counts),
+        cmocka_unit_test(test_keys_are_recorded),
+        cmocka_unit_test(test_replay_reports_stop),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,99 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/types.h>
+#include "../src/pacing.h"
+
+static int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void busy_wait(int64_t ns) {
+    int64_t end = now_ns() + ns;
+    while (now_ns() < end)
+        ;
+}
+
+static void test_pace_frame_holds_the_rate(void **state) {
+    /* Test that 50 frames at 500Hz take 100ms, with uneven frame times
+     * not adding up as drift */
+    Pacer pacer;
+    int64_t start = now_ns();
+    init_pacer(&pacer, 500, DEFAULT_MAX_CATCH_UP);
+
+    for (int i = 0; i < 50; i++) {
+        busy_wait((i % 3) * 300000);
+        assert_int_equal(0, pace_frame(&pacer));
+    }
+
+    int64_t elapsed = now_ns() - start;
+    assert_true(elapsed >= 100000000);
+    assert_true(elapsed < 150000000);
+    assert_int_equal(50, pacer.frames);
+}
+
+static void test_pace_frame_catches_up(void **state) {
+    /* Test that a frame late by less than max_catch_up periods is made
+     * up by the following frames, not skipped */
+    Pacer pacer;
+    int64_t start = now_ns();
+    init_pacer(&pacer, 500, 4);
+
+    busy_wait(5000000);
+    assert_int_equal(0, pace_frame(&pacer));
+    for (int i = 1; i < 10; i++)
+        assert_int_equal(0, pace_frame(&pacer));
+
+    assert_true(now_ns() - start >= 20000000);
+    assert_true(pacer.late >= 2);
+    assert_int_equal(0, pacer.skipped);
+}
+
+static void test_pace_frame_skips(void **state) {
+    /* Test that a stall of 10 periods with max_catch_up 2 resyncs
+     * instead of rushing through the backlog */
+    Pacer pacer;
+    init_pacer(&pacer, 500, 2);
+
+    busy_wait(20000000);
+    u_int64_t skipped = pace_frame(&pacer);
+    assert_true(skipped >= 8);
+    assert_int_equal(skipped, pacer.skipped);
+
+    int64_t start = now_ns();
+    assert_int_equal(0, pace_frame(&pacer));
+    assert_true(now_ns() - start >= 1500000);
+}
+
+static void test_pacing_stats(void **state) {
+    Pacer pacer;
+    PacingStats stats;
+    init_pacer(&pacer, 60, DEFAULT_MAX_CATCH_UP);
+    for (int i = 0; i < 100; i++)
+        pacer.jitter[i] = (i * 37) % 100 * 1000;
+    pacer.n_jitter = 100;
+    pacer.frames = 100;
+
+    get_pacing_stats(&pacer, &stats);
+    assert_int_equal(100, stats.frames);
+    assert_int_equal(49000, stats.p50_ns);
+    assert_int_equal(98000, stats.p99_ns);
+    assert_int_equal(99000, stats.max_ns);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_pace_frame_holds_the_rate),
+        cmocka_unit_test(test_pace_frame_catches_up),
+        cmocka_unit_test(test_pace_frame_skips),
+        cmocka_unit_test(test_pacing_stats),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
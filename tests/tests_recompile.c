@@ -0,0 +1,168 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+#include "../src/scheduler.h"
+#include "../src/recompile.h"
+#include "../src/recompiled.h"
+
+/* tests/poll.rom, built in as poll_recompiled.c by the Makefile:
+ *
+ *  0000 LXI B,$2000; LXI D,$1234; EI; HLT
+ *  0010 LHLD $3000; INX H; SHLD $3000; EI; JMP $0040     RST 2 handler
+ *  0040 LDAX B; CMA; ANA D; STAX B; DAD D; DCR C; JNZ $0040
+ *  0049 OUT $03; IN $01; CPI $80; JC $0055; MVI E,$55; NOP
+ *  0055 INR B; JP $0040; MVI B,$20; JMP $004a
+ *
+ *  The last jump lands inside OUT $03 and runs its operand as INX B,
+ *  so 004b on is decoded in the blocks at both 0049 and 004a.
+ */
+#define POLL_ROM_SIZE 0x5e
+
+static Chip8080* load_poll_rom(void) {
+    Chip8080 *chip = make_chip8080();
+    FILE *file = fopen("tests/poll.rom", "rb");
+    assert_non_null(file);
+    assert_int_equal(POLL_ROM_SIZE, fread(chip->memory, 1, MAX_MEMORY, file));
+    fclose(file);
+    chip->reg_sp = 0x2400;
+    return chip;
+}
+
+static void rst_2(Chip8080 *chip, void *context) {
+    generate_interrupt(chip, 2);
+    chip->in_ports[1] += 0x35;
+}
+
+static void test_recompiled_matches_interpreter(void **state) {
+    /* Tests that: the recompiled ROM goes through the same states as the
+     * interpreter at every event, with blocks doing most of the work,
+     * including past the jump into OUT $03 after about 1.4M cycles */
+    Chip8080 *fast = load_poll_rom();
+    Chip8080 *slow = load_poll_rom();
+    Scheduler fast_scheduler, slow_scheduler;
+
+    assert_int_equal(0, install_recompiled(&recompiled_rom, fast));
+    init_scheduler(&fast_scheduler);
+    init_scheduler(&slow_scheduler);
+    fast_scheduler.run_until = run_recompiled_until;
+    schedule_event(&fast_scheduler, 997, 997, rst_2, NULL);
+    schedule_event(&slow_scheduler, 997, 997, rst_2, NULL);
+
+    for (u_int64_t until = 100; until <= 1500000; until += 100) {
+        run_scheduled(&fast_scheduler, fast, until);
+        run_scheduled(&slow_scheduler, slow, until);
+        assert_int_equal(slow->cycles, fast->cycles);
+        assert_int_equal(slow->reg_pc, fast->reg_pc);
+        assert_int_equal(slow->reg_a, fast->reg_a);
+        assert_int_equal(slow->reg_b, fast->reg_b);
+        assert_int_equal(slow->reg_c, fast->reg_c);
+        assert_int_equal(slow->reg_d, fast->reg_d);
+        assert_int_equal(slow->reg_e, fast->reg_e);
+        assert_int_equal(slow->reg_h, fast->reg_h);
+        assert_int_equal(slow->reg_l, fast->reg_l);
+        assert_int_equal(slow->reg_sp, fast->reg_sp);
+        assert_memory_equal(&slow->flags, &fast->flags, sizeof(fast->flags));
+        assert_int_equal(slow->irq_enable, fast->irq_enable);
+        assert_int_equal(slow->halted, fast->halted);
+        // Before the loop's stores reach the counter at 0x3000
+        if (until == 100000)
+            assert_true(slow->memory[0x3000] > 90);
+    }
+    assert_memory_equal(slow->memory, fast->memory, MAX_MEMORY);
+    assert_memory_equal(slow->dirty, fast->dirty, DIRTY_BYTES);
+    assert_memory_equal(slow->out_ports, fast->out_ports, 256);
+    assert_true(slow->reg_b < 0x30);    // Set back to $20 on the way to 004a
+    assert_true(recompiled_stats.blocks > 10 * recompiled_stats.fallbacks);
+
+    destroy_chip8080(fast);
+    destroy_chip8080(slow);
+}
+
+static void test_entries(void **state) {
+    /* Tests that: every address is listed once, in order, even where it
+     * is in two blocks */
+    int shared = 0;
+    for (int i = 1; i < recompiled_rom.n_entries; i++)
+        assert_true(recompiled_rom.entries[i - 1].address < recompiled_rom.entries[i].address);
+    for (int i = 0; i < recompiled_rom.n_entries; i++) {
+        if (recompiled_rom.entries[i].address == 0x004b) {
+            assert_true(recompiled_rom.entries[i].run == recompiled_rom.entries[i - 2].run);
+            shared = 1;
+        }
+    }
+    assert_true(shared);
+}
+
+static void test_install_checks_rom(void **state) {
+    /* Tests that: blocks are only installed over the ROM they came from */
+    Chip8080 *chip = load_poll_rom();
+    chip->memory[0x0041] = 0x00;
+    assert_int_equal(-1, install_recompiled(&recompiled_rom, chip));
+    destroy_chip8080(chip);
+}
+
+static void test_blocks(void **state) {
+    /* Tests that: blocks start at labels, entry points and after block
+     * ends, and opcodes the core lacks are left to the interpreter */
+    const unsigned char program[] = {
+        0x04,               // 0000 INR B
+        0xc2, 0x00, 0x00,   // 0001 JNZ $0000
+        0x3c,               // 0004 INR A (not in the core)
+        0x0c,               // 0005 INR C
+        0x76,               // 0006 HLT
+    };
+    char *text = NULL;
+    size_t text_size = 0;
+    FILE *out = open_memstream(&text, &text_size);
+
+    assert_int_equal(2, recompile_rom(program, sizeof(program), "dir/test\".rom", out));
+    fclose(out);
+
+    assert_non_null(strstr(text, "from test_.rom;"));
+    assert_non_null(strstr(text, "static void block_0000("));
+    assert_null(strstr(text, "static void block_0004("));
+    assert_non_null(strstr(text, "static void block_0005("));
+    assert_non_null(strstr(text, "if (!z) BLOCK_GOTO(0x0000, i_0000); BLOCK_EXIT(0x0004);"));
+    assert_non_null(strstr(text, "chip->halted = 1; cycles += 7; BLOCK_EXIT(0x0007);"));
+    assert_non_null(strstr(text, "\"test_.rom\", 7, "));
+    free(text);
+}
+
+static void test_jump_into_instruction(void **state) {
+    /* Tests that a jump into the middle of an instruction of its own
+     * block leaves the block instead of going to a label it lacks */
+    const unsigned char program[] = {
+        0x06, 0xc3,         // 0000 MVI B,$c3
+        0xc2, 0x01, 0x00,   // 0002 JNZ $0001, which is JMP $01c2
+        0xc3, 0x00, 0x00,   // 0005 JMP $0000
+    };
+    char *text = NULL;
+    size_t text_size = 0;
+    FILE *out = open_memstream(&text, &text_size);
+
+    recompile_rom(program, sizeof(program), "overlap.rom", out);
+    fclose(out);
+
+    assert_non_null(strstr(text, "if (!z) BLOCK_EXIT(0x0001); BLOCK_EXIT(0x0005);"));
+    assert_null(strstr(text, "BLOCK_GOTO(0x0001"));
+    free(text);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_recompiled_matches_interpreter),
+        cmocka_unit_test(test_entries),
+        cmocka_unit_test(test_install_checks_rom),
+        cmocka_unit_test(test_blocks),
+        cmocka_unit_test(test_jump_into_instruction),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,150 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+#include "../src/video.h"
+#include "../src/recorder.h"
+
+#define CAPTURE_PATH "test_recorder.i8vr"
+#define N_FRAMES 50
+#define KEYFRAME_INTERVAL 16
+
+static void draw_frame(u_int8_t *memory, int frame) {
+    /* A few bytes change every frame, sometimes a whole line */
+    u_int32_t seed = frame * 2654435761u;
+    for (int i = 0; i < 8; i++) {
+        seed = seed * 1103515245 + 12345;
+        memory[VIDEO_RAM + (seed >> 8) % VIDEO_RAM_SIZE] = seed >> 16;
+    }
+    if (frame % 7 == 0)
+        memset(&memory[VIDEO_RAM + (frame % VIDEO_WIDTH) * VIDEO_LINE_BYTES], frame, VIDEO_LINE_BYTES);
+}
+
+static u_int8_t *record_test_capture(void) {
+    /* Records N_FRAMES frames through write_memory and the dirty lines
+     * and returns all their video RAMs */
+    Chip8080 *chip = make_chip8080();
+    u_int8_t *scratch = calloc(MAX_MEMORY, 1);
+    u_int8_t *frames = malloc(N_FRAMES * VIDEO_RAM_SIZE);
+    u_int8_t lines[VIDEO_DIRTY_BYTES];
+    Recorder *recorder = open_recorder(CAPTURE_PATH, KEYFRAME_INTERVAL);
+    assert_non_null(recorder);
+
+    for (int frame = 0; frame < N_FRAMES; frame++) {
+        draw_frame(scratch, frame);
+        for (int i = VIDEO_RAM; i < VIDEO_RAM + VIDEO_RAM_SIZE; i++)
+            if (chip->memory[i] != scratch[i])
+                write_memory(chip, i, scratch[i]);
+        take_dirty_lines(chip, lines);
+        assert_int_equal(0, record_frame(recorder, chip->memory, lines));
+        memcpy(&frames[frame * VIDEO_RAM_SIZE], &chip->memory[VIDEO_RAM], VIDEO_RAM_SIZE);
+    }
+    assert_int_equal(0, close_recorder(recorder));
+
+    free(scratch);
+    destroy_chip8080(chip);
+    return frames;
+}
+
+static void test_playback_is_lossless(void **state) {
+    u_int8_t *frames = record_test_capture();
+    Playback *playback = open_playback(CAPTURE_PATH);
+    assert_non_null(playback);
+    assert_int_equal(N_FRAMES, playback->n_frames);
+    assert_int_equal((N_FRAMES + KEYFRAME_INTERVAL - 1) / KEYFRAME_INTERVAL, playback->n_keyframes);
+
+    for (int frame = 0; frame < N_FRAMES; frame++) {
+        assert_int_equal(0, read_frame(playback));
+        assert_memory_equal(&frames[frame * VIDEO_RAM_SIZE], &playback->memory[VIDEO_RAM], VIDEO_RAM_SIZE);
+    }
+    assert_int_equal(-1, read_frame(playback));
+
+    close_playback(playback);
+    free(frames);
+    remove(CAPTURE_PATH);
+}
+
+static void test_seek_frame(void **state) {
+    /* Test seeking backwards and forwards, onto and between keyframes */
+    u_int8_t *frames = record_test_capture();
+    Playback *playback = open_playback(CAPTURE_PATH);
+    int targets[] = {37, 3, KEYFRAME_INTERVAL * 2, N_FRAMES - 1, 0};
+
+    for (int i = 0; i < 5; i++) {
+        assert_int_equal(0, seek_frame(playback, targets[i]));
+        assert_int_equal(0, read_frame(playback));
+        assert_memory_equal(&frames[targets[i] * VIDEO_RAM_SIZE], &playback->memory[VIDEO_RAM], VIDEO_RAM_SIZE);
+    }
+    assert_int_equal(-1, seek_frame(playback, N_FRAMES));
+
+    close_playback(playback);
+    free(frames);
+    remove(CAPTURE_PATH);
+}
+
+static void test_idle_frames_are_small(void **state) {
+    /* Test that unchanged frames cost only their 5 byte header */
+    u_int8_t *memory = calloc(MAX_MEMORY, 1);
+    u_int8_t lines[VIDEO_DIRTY_BYTES];
+    struct stat info;
+    memset(lines, 0xff, sizeof(lines));
+    memset(&memory[VIDEO_RAM], 0x5a, VIDEO_RAM_SIZE);
+
+    Recorder *recorder = open_recorder(CAPTURE_PATH, 1000);
+    record_frame(recorder, memory, NULL);
+    for (int frame = 1; frame < 1000; frame++)
+        record_frame(recorder, memory, lines);
+    close_recorder(recorder);
+
+    assert_int_equal(0, stat(CAPTURE_PATH, &info));
+    off_t keyframe_size = RECORDER_FRAME_HEADER_SIZE + VIDEO_RAM_SIZE + VIDEO_RAM_SIZE / 128;
+    assert_int_equal(RECORDER_HEADER_SIZE + keyframe_size + 999 * RECORDER_FRAME_HEADER_SIZE
+                     + 8 + RECORDER_TRAILER_SIZE, info.st_size);
+
+    free(memory);
+    remove(CAPTURE_PATH);
+}
+
+static void test_worst_case_frames(void **state) {
+    /* Test that frames where every other byte changes, the largest the
+     * encoding gets, fit the payload and play back */
+    u_int8_t *memory = calloc(MAX_MEMORY, 1);
+    u_int8_t lines[VIDEO_DIRTY_BYTES];
+    memset(lines, 0xff, sizeof(lines));
+
+    Recorder *recorder = open_recorder(CAPTURE_PATH, 1000);
+    for (int frame = 0; frame < 3; frame++) {
+        for (int i = 0; i < VIDEO_RAM_SIZE; i++)
+            memory[VIDEO_RAM + i] = (i & 1) == (frame & 1) ? 0 : 0xa5 + frame;
+        assert_int_equal(0, record_frame(recorder, memory, frame == 0 ? NULL : lines));
+    }
+    assert_int_equal(0, close_recorder(recorder));
+
+    Playback *playback = open_playback(CAPTURE_PATH);
+    assert_non_null(playback);
+    for (int frame = 0; frame < 3; frame++)
+        assert_int_equal(0, read_frame(playback));
+    assert_memory_equal(&memory[VIDEO_RAM], &playback->memory[VIDEO_RAM], VIDEO_RAM_SIZE);
+
+    close_playback(playback);
+    free(memory);
+    remove(CAPTURE_PATH);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_playback_is_lossless),
+        cmocka_unit_test(test_seek_frame),
+        cmocka_unit_test(test_idle_frames_are_small),
+        cmocka_unit_test(test_worst_case_frames),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
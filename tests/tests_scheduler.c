@@ -0,0 +1,167 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+#include "../src/scheduler.h"
+
+static int fired[8];
+static u_int64_t fired_at[8];
+static int n_fired;
+
+static void record(Chip8080 *chip, void *context) {
+    fired[n_fired] = (int) (size_t) context;
+    fired_at[n_fired] = chip->cycles;
+    n_fired++;
+}
+
+static void test_events_fire_in_deadline_order(void **state) {
+    /* Test that events fire in deadline order whatever order they
+     * were scheduled in, each as soon as its deadline is reached.
+     * Memory is all NOPs, so the clock moves 4 cycles at a time. */
+    Chip8080 *chip = make_chip8080();
+    Scheduler scheduler;
+    n_fired = 0;
+
+    init_scheduler(&scheduler);
+    schedule_event(&scheduler, 30, 0, record, (void*) 3);
+    schedule_event(&scheduler, 10, 0, record, (void*) 1);
+    schedule_event(&scheduler, 20, 0, record, (void*) 2);
+
+    run_scheduled(&scheduler, chip, 100);
+
+    assert_int_equal(3, n_fired);
+    assert_int_equal(1, fired[0]);
+    assert_int_equal(12, fired_at[0]);
+    assert_int_equal(2, fired[1]);
+    assert_int_equal(20, fired_at[1]);
+    assert_int_equal(3, fired[2]);
+    assert_int_equal(32, fired_at[2]);
+    assert_int_equal(100, chip->cycles);
+    assert_int_equal(0, scheduler.n_events);
+    assert_true(next_deadline(&scheduler) == NO_DEADLINE);
+
+    destroy_chip8080(chip);
+}
+
+static void test_periodic_event(void **state) {
+    /* Test that a periodic event keeps its own phase */
+    Chip8080 *chip = make_chip8080();
+    Scheduler scheduler;
+    n_fired = 0;
+
+    init_scheduler(&scheduler);
+    schedule_event(&scheduler, 8, 16, record, (void*) 1);
+
+    run_scheduled(&scheduler, chip, 60);
+
+    assert_int_equal(4, n_fired);
+    assert_int_equal(8, fired_at[0]);
+    assert_int_equal(24, fired_at[1]);
+    assert_int_equal(40, fired_at[2]);
+    assert_int_equal(56, fired_at[3]);
+    assert_int_equal(72, next_deadline(&scheduler));
+
+    destroy_chip8080(chip);
+}
+
+static void rst_1(Chip8080 *chip, void *context) {
+    generate_interrupt(chip, 1);
+}
+
+static void test_interrupt_injection(void **state) {
+    /* Test that an interrupt event delivers RST 1 once EI ran */
+    Chip8080 *chip = make_chip8080();
+    Scheduler scheduler;
+    chip->memory[0x0000] = 0xfb; // EI
+    chip->reg_sp = 0x2400;
+
+    init_scheduler(&scheduler);
+    schedule_event(&scheduler, 12, 0, rst_1, NULL);
+    run_scheduled(&scheduler, chip, 12);
+
+    assert_int_equal(0x0008, chip->reg_pc);
+    assert_int_equal(0x23fe, chip->reg_sp);
+    assert_int_equal(0x03, chip->memory[0x23fe]);
+    assert_int_equal(0x00, chip->memory[0x23ff]);
+    assert_int_equal(0, chip->irq_enable);
+    assert_int_equal(12 + 11, chip->cycles);
+
+    destroy_chip8080(chip);
+}
+
+static void rst_1_recorded(Chip8080 *chip, void *context) {
+    record(chip, context);
+    generate_interrupt(chip, 1);
+}
+
+static void test_halted_chip_sleeps_to_events(void **state) {
+    /* Test that a halted chip skips straight to each event, wakes on
+     * its interrupt and that one with no events left sleeps to the end */
+    Chip8080 *chip = make_chip8080();
+    Scheduler scheduler;
+    unsigned char program[] = {0xfb, 0x76};            // EI; HLT
+    unsigned char handler[] = {0x04, 0xfb, 0x76};      // INR B; EI; HLT
+    load_memory(chip, program, sizeof(program), 0x0000);
+    load_memory(chip, handler, sizeof(handler), 0x0008);
+    chip->reg_sp = 0x2400;
+    n_fired = 0;
+
+    init_scheduler(&scheduler);
+    schedule_event(&scheduler, 100, 100, rst_1_recorded, NULL);
+    assert_int_equal(RUN_BUDGET, run_scheduled(&scheduler, chip, 350));
+
+    assert_int_equal(3, n_fired);
+    assert_int_equal(100, fired_at[0]);
+    assert_int_equal(200, fired_at[1]);
+    assert_int_equal(300, fired_at[2]);
+    assert_int_equal(3, chip->reg_b);
+    assert_int_equal(1, chip->halted);
+    assert_int_equal(350, chip->cycles);
+
+    chip->irq_enable = 0;
+    init_scheduler(&scheduler);
+    assert_int_equal(RUN_HALTED, run_scheduled(&scheduler, chip, 1000000));
+    assert_true(is_parked(chip));
+    assert_int_equal(1000000, chip->cycles);
+
+    destroy_chip8080(chip);
+}
+
+static void test_unimplemented_opcode_stops(void **state) {
+    /* Test that an opcode the core lacks stops the run before it, with
+     * the events due after it left for the host to decide about */
+    Chip8080 *chip = make_chip8080();
+    Scheduler scheduler;
+    unsigned char program[] = {0x04, 0x04, 0x07};      // INR B; INR B; RLC
+    load_memory(chip, program, sizeof(program), 0x0000);
+    n_fired = 0;
+
+    init_scheduler(&scheduler);
+    schedule_event(&scheduler, 5, 0, rst_1_recorded, NULL);
+    schedule_event(&scheduler, 100, 0, rst_1_recorded, NULL);
+    assert_int_equal(RUN_UNIMPLEMENTED, run_scheduled(&scheduler, chip, 1000));
+
+    assert_int_equal(0x0002, chip->reg_pc);
+    assert_int_equal(2, chip->reg_b);
+    assert_int_equal(10, chip->cycles);
+    assert_int_equal(1, n_fired);
+    assert_int_equal(1, scheduler.n_events);
+
+    destroy_chip8080(chip);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_events_fire_in_deadline_order),
+        cmocka_unit_test(test_periodic_event),
+        cmocka_unit_test(test_interrupt_injection),
+        cmocka_unit_test(test_halted_chip_sleeps_to_events),
+        cmocka_unit_test(test_unimplemented_opcode_stops),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,151 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "../src/tools.h"
+
+static void test_format_instruction_sizes(void **state) {
+    /* Test that every opcode reports the right Instruction Size
+     * and formats into the expected line */
+    char line[DISASM_LINE_MAX];
+    int line_len;
+
+    u_int8_t nop[] = {0x00};
+    assert_int_equal(1, format_instruction(nop, 0, 1, line, &line_len));
+    assert_int_equal(9, line_len);
+    assert_memory_equal("0000 NOP\n", line, line_len);
+
+    u_int8_t mvi_b[] = {0x06, 0x3f};
+    assert_int_equal(2, format_instruction(mvi_b, 0, 2, line, &line_len));
+    assert_memory_equal("0000 MVI    B,#$3f\n", line, line_len);
+
+    u_int8_t jmp[] = {0x00, 0xc3, 0xd4, 0x18};
+    assert_int_equal(3, format_instruction(jmp, 1, 4, line, &line_len));
+    assert_memory_equal("0001 JMP    $18d4\n", line, line_len);
+}
+
+static void test_format_instruction_fixed_opcodes(void **state) {
+    /* Test that LHLD (0x2a) takes 3 bytes, MVI L (0x2e) takes 2 and
+     * 0xcb is the 3 byte JMP the core runs it as */
+    char line[DISASM_LINE_MAX];
+    int line_len;
+
+    u_int8_t lhld[] = {0x2a, 0x00, 0x20};
+    assert_int_equal(3, format_instruction(lhld, 0, 3, line, &line_len));
+    assert_memory_equal("0000 LHLD   $2000\n", line, line_len);
+
+    u_int8_t mvi_l[] = {0x2e, 0x05};
+    assert_int_equal(2, format_instruction(mvi_l, 0, 2, line, &line_len));
+    assert_memory_equal("0000 MVI    L,#$05\n", line, line_len);
+
+    u_int8_t jmp_copy[] = {0xcb, 0xd4, 0x18};
+    assert_int_equal(3, format_instruction(jmp_copy, 0, 3, line, &line_len));
+    assert_memory_equal("0000 JMP    $18d4\n", line, line_len);
+}
+
+static void test_format_instruction_wide_addresses(void **state) {
+    /* Test that addresses past 64KB, in large batch images, are printed
+     * in full rather than wrapping */
+    char line[DISASM_LINE_MAX];
+    int line_len;
+    u_int8_t *image = calloc(0x1000003, 1);
+    image[0x10000] = 0xc3;
+    image[0x10001] = 0x34;
+    image[0x10002] = 0x12;
+
+    assert_int_equal(1, format_instruction(image, 0xffff, 0x1000003, line, &line_len));
+    assert_memory_equal("ffff NOP\n", line, line_len);
+    assert_int_equal(3, format_instruction(image, 0x10000, 0x1000003, line, &line_len));
+    assert_memory_equal("010000 JMP    $1234\n", line, line_len);
+    format_instruction(image, 0x1000002, 0x1000003, line, &line_len);
+    assert_memory_equal("01000002 NOP\n", line, line_len);
+
+    free(image);
+}
+
+static void test_format_instruction_truncated(void **state) {
+    /* Test that operand bytes past the end of the buffer read as 0 */
+    char line[DISASM_LINE_MAX];
+    int line_len;
+    u_int8_t code[] = {0x00, 0xc3, 0x12};
+
+    assert_int_equal(3, format_instruction(code, 1, 3, line, &line_len));
+    assert_memory_equal("0001 JMP    $0012\n", line, line_len);
+}
+
+static void test_disassemble_range(void **state) {
+    /* Test that a range disassembles into one buffer and that
+     * a short output buffer stops at a line boundary */
+    u_int8_t code[] = {0x00, 0x01, 0x34, 0x12, 0x2f};
+    const char *expected = "0000 NOP\n0001 LXI    B,#$1234\n0004 CMA\n";
+    char out[4 * DISASM_LINE_MAX];
+    int pc = 0;
+
+    size_t written = disassemble_range(code, &pc, sizeof(code), out, sizeof(out));
+
+    assert_int_equal(strlen(expected), written);
+    assert_memory_equal(expected, out, written);
+    assert_int_equal(5, pc);
+
+    pc = 0;
+    written = disassemble_range(code, &pc, sizeof(code), out, DISASM_LINE_MAX);
+    assert_int_equal(9, written);
+    assert_int_equal(1, pc);
+}
+
+static void test_output_buffer_full(void **state) {
+    /* Test that a buffer filled exactly is written out before the next
+     * line, which then starts it again, and that nothing goes past it */
+    FILE *file = tmpfile();
+    char *data = malloc(2 * CHIP_STATE_LINE_MAX + 16);
+    OutputBuffer out = {data, 2 * CHIP_STATE_LINE_MAX, 0, fileno(file), 0};
+    Chip8080 *chip = make_chip8080();
+    char written[4 * CHIP_STATE_LINE_MAX];
+
+    memset(data + out.size, 0x7f, 16);
+    for (int i = 0; i < 2; i++) {
+        memset(reserve_output(&out, CHIP_STATE_LINE_MAX), 'a' + i, CHIP_STATE_LINE_MAX);
+        out.len += CHIP_STATE_LINE_MAX;
+    }
+    assert_int_equal(out.size, out.len);
+
+    char *line = reserve_output(&out, CHIP_STATE_LINE_MAX);
+    assert_true(line == data);
+    int line_len = format_chip_state(chip, line);
+    out.len += line_len;
+    assert_int_equal(0, flush_output(&out));
+    for (int i = 0; i < 16; i++)
+        assert_int_equal(0x7f, data[out.size + i]);
+
+    rewind(file);
+    assert_int_equal(2 * CHIP_STATE_LINE_MAX + line_len, fread(written, 1, sizeof(written), file));
+    assert_int_equal('b', written[2 * CHIP_STATE_LINE_MAX - 1]);
+    assert_memory_equal("A=00 BC=0000", written + 2 * CHIP_STATE_LINE_MAX, 12);
+
+    out.fd = -1;
+    out.len = 1;
+    assert_int_equal(-1, flush_output(&out));
+    assert_int_equal(0, out.len);
+
+    destroy_chip8080(chip);
+    free(data);
+    fclose(file);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_format_instruction_sizes),
+        cmocka_unit_test(test_format_instruction_fixed_opcodes),
+        cmocka_unit_test(test_format_instruction_wide_addresses),
+        cmocka_unit_test(test_format_instruction_truncated),
+        cmocka_unit_test(test_disassemble_range),
+        cmocka_unit_test(test_output_buffer_full),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,203 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include "../src/chip8080.h"
+#include "../src/video.h"
+
+static int pixel_is_set(const u_int8_t *memory, int x, int y) {
+    /* Straight from the hardware description: line x, bit 255 - y */
+    int bit = VIDEO_HEIGHT - 1 - y;
+    return (memory[VIDEO_RAM + x * VIDEO_LINE_BYTES + bit / 8] >> (bit % 8)) & 1;
+}
+
+static u_int8_t *make_random_memory() {
+    u_int8_t *memory = calloc(MAX_MEMORY, 1);
+    u_int32_t seed = 2400;
+    for (int i = VIDEO_RAM; i < VIDEO_RAM + VIDEO_RAM_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        memory[i] = seed >> 16;
+    }
+    return memory;
+}
+
+static void test_rasterize_gray_single_pixel(void **state) {
+    /* Test that bit 0 of the first video byte is the bottom left
+     * pixel and bit 7 of the last one the top right */
+    u_int8_t *memory = calloc(MAX_MEMORY, 1);
+    u_int8_t *frame = malloc(VIDEO_WIDTH * VIDEO_HEIGHT);
+    Rasterizer *rasterizer = malloc(sizeof(Rasterizer));
+    init_rasterizer(rasterizer, 0);
+    memory[VIDEO_RAM] = 0x01;
+    memory[VIDEO_RAM + VIDEO_RAM_SIZE - 1] = 0x80;
+
+    rasterize_gray(rasterizer, memory, frame);
+
+    int lit = 0;
+    for (int i = 0; i < VIDEO_WIDTH * VIDEO_HEIGHT; i++)
+        lit += frame[i] != 0;
+    assert_int_equal(2, lit);
+    assert_int_equal(0xff, frame[(VIDEO_HEIGHT - 1) * VIDEO_WIDTH + 0]);
+    assert_int_equal(0xff, frame[0 * VIDEO_WIDTH + VIDEO_WIDTH - 1]);
+
+    free(rasterizer);
+    free(frame);
+    free(memory);
+}
+
+static void test_rasterize_gray_matches_reference(void **state) {
+    u_int8_t *memory = make_random_memory();
+    u_int8_t *frame = malloc(VIDEO_WIDTH * VIDEO_HEIGHT);
+    Rasterizer *rasterizer = malloc(sizeof(Rasterizer));
+    init_rasterizer(rasterizer, 0);
+
+    rasterize_gray(rasterizer, memory, frame);
+
+    for (int y = 0; y < VIDEO_HEIGHT; y++)
+        for (int x = 0; x < VIDEO_WIDTH; x++)
+            assert_int_equal(pixel_is_set(memory, x, y) ? 0xff : 0x00, frame[y * VIDEO_WIDTH + x]);
+
+    free(rasterizer);
+    free(frame);
+    free(memory);
+}
+
+static void test_rasterize_rgba_overlay_matches_reference(void **state) {
+    u_int8_t *memory = make_random_memory();
+    u_int32_t *frame = malloc(VIDEO_WIDTH * VIDEO_HEIGHT * sizeof(u_int32_t));
+    Rasterizer *rasterizer = malloc(sizeof(Rasterizer));
+    init_rasterizer(rasterizer, 1);
+
+    rasterize_rgba(rasterizer, memory, frame);
+
+    for (int y = 0; y < VIDEO_HEIGHT; y++)
+        for (int x = 0; x < VIDEO_WIDTH; x++) {
+            u_int32_t expected = pixel_is_set(memory, x, y) ? overlay_color(x, y) : PIXEL_BLACK;
+            assert_int_equal(expected, frame[y * VIDEO_WIDTH + x]);
+        }
+
+    free(rasterizer);
+    free(frame);
+    free(memory);
+}
+
+static void test_take_dirty_lines(void **state) {
+    /* Test that writes to video RAM mark their line, and that taking
+     * the lines clears them */
+    Chip8080 *chip = make_chip8080();
+    u_int8_t lines[VIDEO_DIRTY_BYTES];
+
+    write_memory(chip, 0x2000, 0x01);                               // work RAM
+    write_memory(chip, VIDEO_RAM + 3 * VIDEO_LINE_BYTES + 5, 0x01); // line 3
+    write_memory(chip, VIDEO_RAM + VIDEO_RAM_SIZE - 1, 0x01);       // line 223
+
+    take_dirty_lines(chip, lines);
+    assert_int_equal(2, count_dirty_lines(lines));
+    assert_int_equal(0x08, lines[0]);
+    assert_int_equal(0x80, lines[VIDEO_DIRTY_BYTES - 1]);
+
+    take_dirty_lines(chip, lines);
+    assert_int_equal(0, count_dirty_lines(lines));
+
+    destroy_chip8080(chip);
+}
+
+static void test_rasterize_lines_matches_full_redraw(void **state) {
+    /* Test that redrawing only dirty lines over the previous frame
+     * gives the same picture as a full redraw, for a few lines and
+     * for more than FULL_REDRAW_LINES */
+    Chip8080 *chip = make_chip8080();
+    u_int8_t *random = make_random_memory();
+    u_int8_t lines[VIDEO_DIRTY_BYTES];
+    u_int8_t *gray = malloc(VIDEO_WIDTH * VIDEO_HEIGHT);
+    u_int8_t *gray_full = malloc(VIDEO_WIDTH * VIDEO_HEIGHT);
+    u_int32_t *rgba = malloc(VIDEO_WIDTH * VIDEO_HEIGHT * sizeof(u_int32_t));
+    u_int32_t *rgba_full = malloc(VIDEO_WIDTH * VIDEO_HEIGHT * sizeof(u_int32_t));
+    Rasterizer *rasterizer = malloc(sizeof(Rasterizer));
+    init_rasterizer(rasterizer, 1);
+
+    rasterize_gray(rasterizer, chip->memory, gray);
+    rasterize_rgba(rasterizer, chip->memory, rgba);
+
+    int n_writes[] = {5, VIDEO_RAM_SIZE};
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < n_writes[round]; i++) {
+            int offset = (i * 997) % VIDEO_RAM_SIZE;
+            write_memory(chip, VIDEO_RAM + offset, random[VIDEO_RAM + offset]);
+        }
+        take_dirty_lines(chip, lines);
+        rasterize_gray_lines(rasterizer, chip->memory, lines, gray);
+        rasterize_rgba_lines(rasterizer, chip->memory, lines, rgba);
+
+        rasterize_gray(rasterizer, chip->memory, gray_full);
+        rasterize_rgba(rasterizer, chip->memory, rgba_full);
+        assert_memory_equal(gray_full, gray, VIDEO_WIDTH * VIDEO_HEIGHT);
+        assert_memory_equal(rgba_full, rgba, VIDEO_WIDTH * VIDEO_HEIGHT * sizeof(u_int32_t));
+    }
+
+    free(rasterizer);
+    free(rgba_full);
+    free(rgba);
+    free(gray_full);
+    free(gray);
+    free(random);
+    destroy_chip8080(chip);
+}
+
+static void test_frame_skip_carries_dirty_lines(void **state) {
+    /* Test that rasterizing one frame in three from the lines handed
+     * back by next_frame_lines() matches a full redraw, even though the
+     * lines written during skipped frames are only redrawn later */
+    Chip8080 *chip = make_chip8080();
+    u_int8_t *random = make_random_memory();
+    u_int8_t lines[VIDEO_DIRTY_BYTES];
+    u_int8_t *gray = malloc(VIDEO_WIDTH * VIDEO_HEIGHT);
+    u_int8_t *gray_full = malloc(VIDEO_WIDTH * VIDEO_HEIGHT);
+    Rasterizer *rasterizer = malloc(sizeof(Rasterizer));
+    FrameSkip skip;
+    init_rasterizer(rasterizer, 0);
+    init_frame_skip(&skip, 3);
+
+    for (int frame = 0; frame < 9; frame++) {
+        for (int i = 0; i < 4; i++) {
+            int offset = (frame * 1231 + i * 997) % VIDEO_RAM_SIZE;
+            write_memory(chip, VIDEO_RAM + offset, random[VIDEO_RAM + offset]);
+        }
+        take_dirty_lines(chip, lines);
+        const u_int8_t *redraw = next_frame_lines(&skip, lines);
+        if (frame % 3 != 0) {
+            assert_null(redraw);
+            continue;
+        }
+        assert_non_null(redraw);
+        rasterize_gray_lines(rasterizer, chip->memory, redraw, gray);
+        rasterize_gray(rasterizer, chip->memory, gray_full);
+        assert_memory_equal(gray_full, gray, VIDEO_WIDTH * VIDEO_HEIGHT);
+    }
+    assert_int_equal(3, skip.rasterized);
+
+    init_frame_skip(&skip, 0);
+    assert_null(next_frame_lines(&skip, lines));
+
+    free(rasterizer);
+    free(gray_full);
+    free(gray);
+    free(random);
+    destroy_chip8080(chip);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_rasterize_gray_single_pixel),
+        cmocka_unit_test(test_rasterize_gray_matches_reference),
+        cmocka_unit_test(test_rasterize_rgba_overlay_matches_reference),
+        cmocka_unit_test(test_take_dirty_lines),
+        cmocka_unit_test(test_rasterize_lines_matches_full_redraw),
+        cmocka_unit_test(test_frame_skip_carries_dirty_lines),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}